@@ -30,6 +30,9 @@ function getOrCreateRoom(roomId) {
             clients: new Map(),
             boardState: [],
             textState: [],
+            stamps: new Map(),      // itemId -> { register: stamp }
+            tombstones: new Map(),  // itemId -> stamp of its removal
+            clock: 0,
             createdAt: Date.now()
         };
         console.log(`Room created: ${roomId}`);
@@ -37,6 +40,82 @@ function getOrCreateRoom(roomId) {
     return rooms[roomId];
 }
 
+// Concurrent edits resolve per property, newest Lamport stamp wins, the
+// same way the Qt server does it. A stamp is [counter, replicaId].
+const REGISTERS = {
+    x: 'pos', y: 'pos', rotation: 'rotation', scale: 'scale', zIndex: 'zIndex',
+    crop: 'crop', text: 'text', fontFamily: 'style', fontSize: 'style', textColor: 'style'
+};
+
+function stampLess(a, b) {
+    if (a[0] !== b[0]) return a[0] < b[0];
+    return a[1] < b[1];
+}
+
+// Clients that don't stamp get the room's clock instead
+function stampOp(room, msg) {
+    if (Array.isArray(msg.stamp) && msg.stamp[0] > 0) {
+        room.clock = Math.max(room.clock, msg.stamp[0]);
+    } else {
+        msg.stamp = [++room.clock, 'server'];
+    }
+}
+
+function isRemoved(room, itemId, stamp) {
+    const tombstone = room.tombstones.get(itemId);
+    if (!tombstone) return false;
+    return !Array.isArray(stamp) || !stampLess(tombstone, stamp);
+}
+
+// The fields of msg whose registers it wins, or null if it wins none
+function mergeFields(room, itemId, msg) {
+    if (isRemoved(room, itemId, msg.stamp)) return null;
+    room.tombstones.delete(itemId);
+    
+    let registers = room.stamps.get(itemId);
+    if (!registers) {
+        registers = {};
+        room.stamps.set(itemId, registers);
+    }
+    
+    const won = new Set();
+    for (const key of Object.keys(msg)) {
+        const reg = REGISTERS[key];
+        if (reg && (!registers[reg] || stampLess(registers[reg], msg.stamp))) {
+            won.add(reg);
+        }
+    }
+    if (won.size === 0) return null;
+    
+    const result = {};
+    for (const [key, value] of Object.entries(msg)) {
+        if (!REGISTERS[key] || won.has(REGISTERS[key])) {
+            result[key] = value;
+        }
+    }
+    for (const reg of won) {
+        registers[reg] = msg.stamp;
+    }
+    return result;
+}
+
+function removeItem(room, itemId, stamp) {
+    if (isRemoved(room, itemId, stamp)) return false;
+    room.tombstones.set(itemId, stamp);
+    room.stamps.delete(itemId);
+    return true;
+}
+
+function fullSyncMessage(room) {
+    return {
+        type: 'fullSync',
+        images: room.boardState,
+        texts: room.textState,
+        stamps: Object.fromEntries(room.stamps),
+        tombstones: Object.fromEntries(room.tombstones)
+    };
+}
+
 function cleanupEmptyRooms() {
     const now = Date.now();
     for (const [roomId, room] of Object.entries(rooms)) {
@@ -85,11 +164,7 @@ wss.on('connection', (ws) => {
                 
                 // Send current room state
                 if (currentRoom.boardState.length > 0 || currentRoom.textState.length > 0) {
-                    ws.send(JSON.stringify({
-                        type: 'fullSync',
-                        images: currentRoom.boardState,
-                        texts: currentRoom.textState
-                    }));
+                    ws.send(JSON.stringify(fullSyncMessage(currentRoom)));
                 }
                 
                 // Notify others
@@ -111,6 +186,10 @@ wss.on('connection', (ws) => {
                     users: users
                 }));
             }
+            else if (type === 'ping') {
+                // Echo the client's time with ours so it can measure the round trip
+                ws.send(JSON.stringify({ type: 'pong', t: msg.t, serverTime: Date.now() }));
+            }
             else if (!currentRoom) {
                 // Client must join a room first
                 ws.send(JSON.stringify({
@@ -123,31 +202,37 @@ wss.on('connection', (ws) => {
                 msg.oderId = clientId;
                 broadcast(currentRoom, msg, ws);
             }
+            else if ((type === 'imageUpdate' || type === 'textUpdate') && msg.live) {
+                // Mid-drag transforms are relayed only; the final update is stamped
+                msg.oderId = clientId;
+                broadcast(currentRoom, msg, ws);
+            }
             else if (type === 'imageAdd') {
-                // Check for duplicates
+                // Duplicates and adds older than the item's removal are dropped
                 const imageId = msg.imageId;
                 const exists = currentRoom.boardState.some(img => img.imageId === imageId);
-                if (!exists) {
-                    currentRoom.boardState.push(msg);
-                }
+                stampOp(currentRoom, msg);
+                if (exists || !mergeFields(currentRoom, imageId, msg)) return;
+                currentRoom.boardState.push(msg);
                 currentRoom.lastActivity = Date.now();
                 msg.oderId = clientId;
                 broadcast(currentRoom, msg, ws);
             }
             else if (type === 'imageUpdate') {
-                const imageId = msg.imageId;
-                for (let i = 0; i < currentRoom.boardState.length; i++) {
-                    if (currentRoom.boardState[i].imageId === imageId) {
-                        Object.assign(currentRoom.boardState[i], msg);
-                        break;
-                    }
-                }
+                const image = currentRoom.boardState.find(img => img.imageId === msg.imageId);
+                if (!image) return;
+                stampOp(currentRoom, msg);
+                const winning = mergeFields(currentRoom, msg.imageId, msg);
+                if (!winning) return;
+                Object.assign(image, winning);
                 currentRoom.lastActivity = Date.now();
-                msg.oderId = clientId;
-                broadcast(currentRoom, msg, ws);
+                winning.oderId = clientId;
+                broadcast(currentRoom, winning, ws);
             }
             else if (type === 'imageRemove') {
                 const imageId = msg.imageId;
+                stampOp(currentRoom, msg);
+                if (!removeItem(currentRoom, imageId, msg.stamp)) return;
                 currentRoom.boardState = currentRoom.boardState.filter(img => img.imageId !== imageId);
                 currentRoom.lastActivity = Date.now();
                 msg.oderId = clientId;
@@ -156,80 +241,88 @@ wss.on('connection', (ws) => {
             else if (type === 'textAdd') {
                 const textId = msg.textId;
                 const exists = currentRoom.textState.some(txt => txt.textId === textId);
-                if (!exists) {
-                    currentRoom.textState.push(msg);
-                }
+                stampOp(currentRoom, msg);
+                if (exists || !mergeFields(currentRoom, textId, msg)) return;
+                currentRoom.textState.push(msg);
                 currentRoom.lastActivity = Date.now();
                 msg.oderId = clientId;
                 broadcast(currentRoom, msg, ws);
             }
             else if (type === 'textUpdate') {
-                const textId = msg.textId;
-                for (let i = 0; i < currentRoom.textState.length; i++) {
-                    if (currentRoom.textState[i].textId === textId) {
-                        Object.assign(currentRoom.textState[i], msg);
-                        break;
-                    }
-                }
+                const text = currentRoom.textState.find(txt => txt.textId === msg.textId);
+                if (!text) return;
+                stampOp(currentRoom, msg);
+                const winning = mergeFields(currentRoom, msg.textId, msg);
+                if (!winning) return;
+                Object.assign(text, winning);
                 currentRoom.lastActivity = Date.now();
-                msg.oderId = clientId;
-                broadcast(currentRoom, msg, ws);
+                winning.oderId = clientId;
+                broadcast(currentRoom, winning, ws);
             }
             else if (type === 'textRemove') {
                 const textId = msg.textId;
+                stampOp(currentRoom, msg);
+                if (!removeItem(currentRoom, textId, msg.stamp)) return;
                 currentRoom.textState = currentRoom.textState.filter(txt => txt.textId !== textId);
                 currentRoom.lastActivity = Date.now();
                 msg.oderId = clientId;
                 broadcast(currentRoom, msg, ws);
             }
             else if (type === 'requestSync') {
-                ws.send(JSON.stringify({
-                    type: 'fullSync',
-                    images: currentRoom.boardState,
-                    texts: currentRoom.textState
-                }));
+                ws.send(JSON.stringify(fullSyncMessage(currentRoom)));
             }
             else if (type === 'pushSync') {
-                // Client pushing their local state
-                let stateChanged = false;
+                // Client pushing their local state. Anything new goes out as
+                // a regular add; the client already got our state on join.
                 
                 // Merge images
                 const clientImages = msg.images || [];
                 for (const img of clientImages) {
                     const exists = currentRoom.boardState.some(i => i.imageId === img.imageId);
-                    if (!exists) {
-                        currentRoom.boardState.push(img);
-                        stateChanged = true;
+                    if (exists) continue;
+                    
+                    // Deleted here while the client was away: don't bring it back
+                    if (isRemoved(currentRoom, img.imageId, img.stamp)) {
+                        ws.send(JSON.stringify({
+                            type: 'imageRemove',
+                            imageId: img.imageId,
+                            stamp: currentRoom.tombstones.get(img.imageId)
+                        }));
+                        continue;
                     }
+                    
+                    img.type = 'imageAdd';
+                    stampOp(currentRoom, img);
+                    mergeFields(currentRoom, img.imageId, img);
+                    currentRoom.boardState.push(img);
+                    img.oderId = clientId;
+                    broadcast(currentRoom, img, ws);
                 }
                 
                 // Merge texts
                 const clientTexts = msg.texts || [];
                 for (const txt of clientTexts) {
                     const exists = currentRoom.textState.some(t => t.textId === txt.textId);
-                    if (!exists) {
-                        currentRoom.textState.push(txt);
-                        stateChanged = true;
+                    if (exists) continue;
+                    
+                    if (isRemoved(currentRoom, txt.textId, txt.stamp)) {
+                        ws.send(JSON.stringify({
+                            type: 'textRemove',
+                            textId: txt.textId,
+                            stamp: currentRoom.tombstones.get(txt.textId)
+                        }));
+                        continue;
                     }
+                    
+                    txt.type = 'textAdd';
+                    stampOp(currentRoom, txt);
+                    mergeFields(currentRoom, txt.textId, txt);
+                    currentRoom.textState.push(txt);
+                    txt.oderId = clientId;
+                    broadcast(currentRoom, txt, ws);
                 }
                 
                 currentRoom.lastActivity = Date.now();
-                
-                // Send full state back to pushing client
-                ws.send(JSON.stringify({
-                    type: 'fullSync',
-                    images: currentRoom.boardState,
-                    texts: currentRoom.textState
-                }));
-                
-                // If state changed, broadcast to all others
-                if (stateChanged) {
-                    broadcast(currentRoom, {
-                        type: 'fullSync',
-                        images: currentRoom.boardState,
-                        texts: currentRoom.textState
-                    }, ws);
-                }
             }
             else {
                 // Forward unknown messages
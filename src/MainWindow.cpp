@@ -4,6 +4,8 @@
 #include "canvas/ImageItem.h"
 #include "canvas/TextItem.h"
 #include "network/CollabManager.h"
+#include "network/LatencyStats.h"
+#include "network/TrafficStats.h"
 #include "network/SyncServer.h"
 #include "data/Board.h"
 #include "data/BoardSerializer.h"
@@ -59,6 +61,7 @@ MainWindow::MainWindow(QWidget *parent)
     , m_collabManager(nullptr)
     , m_board(nullptr)
     , m_server(nullptr)
+    , m_trafficLog(nullptr)
     , m_isHosting(false)
     , m_isModified(false)
     , m_alwaysOnTop(false)
@@ -67,6 +70,8 @@ MainWindow::MainWindow(QWidget *parent)
     , m_isDragging(false)
     , m_resizeEdge(None)
     , m_autoSaveTimer(nullptr)
+    , m_reconnectTimer(nullptr)
+    , m_reconnectBackoff(RECONNECT_CHECK_MS, RECONNECT_CHECK_MAX_MS)
 {
     setupUI();
     setupMenus();
@@ -82,7 +87,10 @@ MainWindow::MainWindow(QWidget *parent)
     m_collabManager = new CollabManager(this);
     m_collabManager->setBoard(m_board);
     m_collabManager->setScene(m_canvasScene);
+    m_collabManager->setViewport(m_canvasView->visibleSceneRect(), m_canvasView->currentZoom());
     
+    connect(m_canvasView, &CanvasView::visibleRectChanged,
+            m_collabManager, &CollabManager::setViewport);
     connect(m_collabManager, &CollabManager::connectionStatusChanged,
             this, &MainWindow::onConnectionStatusChanged);
     connect(m_collabManager, &CollabManager::userJoined,
@@ -98,6 +106,11 @@ MainWindow::MainWindow(QWidget *parent)
                         QString("Synced: %1 images, %2 texts").arg(images).arg(texts));
                 }
             });
+    connect(m_collabManager, &CollabManager::latencyUpdated,
+            this, [this]() {
+                const LatencyStats &latency = m_collabManager->latency();
+                m_titleBar->setLatency(qRound(latency.rtt()), latency.summary());
+            });
     
     // Setup built-in server
     m_server = new SyncServer(this);
@@ -301,6 +314,22 @@ void MainWindow::saveSettings()
     }
 }
 
+void MainWindow::setTrafficLog(const QString &path, int intervalMs)
+{
+    delete m_trafficLog;
+    m_trafficLog = new TrafficLog(path, this);
+    m_trafficLog->addSource("client", [this]() {
+        return m_collabManager->traffic().toJson();
+    });
+    m_trafficLog->addSource("latency", [this]() {
+        return m_collabManager->latency().toJson();
+    });
+    m_trafficLog->addSource("server", [this]() {
+        return m_server->trafficJson();
+    });
+    m_trafficLog->start(intervalMs);
+}
+
 void MainWindow::connectToServer(const QString &url, const QString &roomId)
 {
     QString room = roomId;
@@ -457,7 +486,7 @@ void MainWindow::hostSession()
     
     // Connect to our own server
     QString localUrl = QString("ws://127.0.0.1:%1").arg(port);
-    connectToServer(localUrl, "host");
+    connectToServer(localUrl, m_configuredRoomId);
     
     QString localIP = m_server->localAddress();
     
@@ -617,7 +646,7 @@ void MainWindow::joinSession()
         if (!address.startsWith("ws://") && !address.startsWith("wss://")) {
             address = "wss://" + address;
         }
-        connectToServer(address, "guest");
+        connectToServer(address, m_configuredRoomId);
         return;
     }
     
@@ -636,7 +665,7 @@ void MainWindow::joinSession()
         address = "ws://" + address;
     }
     
-    connectToServer(address, "guest");
+    connectToServer(address, m_configuredRoomId);
 }
 
 void MainWindow::leaveSession()
@@ -1015,7 +1044,7 @@ void MainWindow::contextMenuEvent(QContextMenuEvent *event)
         
         QAction *syncAction = collabMenu->addAction("Sync Now");
         connect(syncAction, &QAction::triggered, this, [this]() {
-            m_collabManager->pushLocalState();
+            m_collabManager->reconcile();
             m_titleBar->showNotification("Syncing...");
         });
         
@@ -1031,7 +1060,7 @@ void MainWindow::contextMenuEvent(QContextMenuEvent *event)
         
         QAction *syncAction = collabMenu->addAction("Sync Now");
         connect(syncAction, &QAction::triggered, this, [this]() {
-            m_collabManager->pushLocalState();
+            m_collabManager->reconcile();
             m_titleBar->showNotification("Syncing...");
         });
         
@@ -1123,6 +1152,9 @@ void MainWindow::updateConnectionIndicator()
 {
     if (m_titleBar) {
         m_titleBar->setConnectionStatus(m_collabManager->isConnected());
+        if (!m_collabManager->isConnected()) {
+            m_titleBar->setLatency(-1, QString());
+        }
     }
 }
 
@@ -1204,13 +1236,15 @@ void MainWindow::autoConnectToServer()
     // Try to connect first - if it fails, we'll become the host
     m_collabManager->connectToServer(serverUrl, m_configuredRoomId);
     
-    // Setup reconnect timer that also tries to host if connection fails
+    // Setup reconnect timer that also tries to host if connection fails;
+    // tryReconnect() picks each next interval
     if (!m_reconnectTimer) {
         m_reconnectTimer = new QTimer(this);
-        m_reconnectTimer->setInterval(2000);
+        m_reconnectTimer->setSingleShot(true);
         connect(m_reconnectTimer, &QTimer::timeout, this, &MainWindow::tryReconnect);
     }
-    m_reconnectTimer->start();
+    m_reconnectBackoff.reset();
+    m_reconnectTimer->start(RECONNECT_CHECK_MS);
 }
 
 void MainWindow::tryReconnect()
@@ -1220,20 +1254,29 @@ void MainWindow::tryReconnect()
         if (!m_isHosting) {
             m_titleBar->showNotification("Connected!");
         }
-        m_reconnectTimer->setInterval(5000);  // Slow down checks
+        m_reconnectBackoff.reset();
+        m_reconnectTimer->start(CONNECTED_CHECK_MS);  // Slow down checks
         return;
     }
     
     if (m_isHosting) {
         // We're the host, just keep running
+        m_reconnectTimer->start(CONNECTED_CHECK_MS);
         return;
     }
     
-    // Not connected and not hosting - try to become host
-    static int attempts = 0;
-    attempts++;
+    // Checks back off like the client's own retries, so clients of a
+    // restarted host don't all knock (or all try to host) at once
+    m_reconnectTimer->start(m_reconnectBackoff.nextDelay());
+    int attempts = m_reconnectBackoff.attempts();
+    
+    // The client is still retrying on its own; piling on only resets it
+    if (m_collabManager->isReconnecting() && attempts < HOST_AFTER_ATTEMPTS) {
+        return;
+    }
     
-    if (attempts >= 2) {
+    // Not connected and not hosting - try to become host
+    if (attempts >= HOST_AFTER_ATTEMPTS) {
         // Failed to connect twice, become the host
         m_titleBar->showNotification("Starting server...");
         
@@ -1250,7 +1293,7 @@ void MainWindow::tryReconnect()
                 m_titleBar->showNotification("Hosting - others can join!");
             });
             
-            attempts = 0;
+            m_reconnectBackoff.reset();
         } else {
             // Port in use, keep trying to connect
             m_collabManager->connectToServer(m_configuredServerUrl, m_configuredRoomId);
@@ -4,6 +4,7 @@
 #include <QMainWindow>
 #include <QPoint>
 #include <QTimer>
+#include "network/ReconnectBackoff.h"
 
 class CanvasView;
 class CanvasScene;
@@ -12,6 +13,7 @@ class ToolBar;
 class CollabManager;
 class Board;
 class SyncServer;
+class TrafficLog;
 
 class MainWindow : public QMainWindow
 {
@@ -24,6 +26,9 @@ public:
     void connectToServer(const QString &url, const QString &roomId = "");
     void loadBoard(const QString &filePath);
     void saveBoard(const QString &filePath);
+    // Appends client and (when hosting) server traffic plus latency to
+    // path as JSON lines, every intervalMs
+    void setTrafficLog(const QString &path, int intervalMs = 10000);
 
 public slots:
     void newBoard();
@@ -84,6 +89,7 @@ private:
     CollabManager *m_collabManager;
     Board *m_board;
     SyncServer *m_server;  // Built-in server for hosting
+    TrafficLog *m_trafficLog;
     bool m_isHosting;
     QString m_ngrokUrl;  // Store ngrok URL for easy re-copying
 
@@ -115,10 +121,15 @@ private:
 
     QTimer *m_autoSaveTimer;
     QTimer *m_reconnectTimer;
+    ReconnectBackoff m_reconnectBackoff;    // Paces checks while disconnected
     QString m_configuredServerUrl;
     QString m_configuredRoomId;
     
     static constexpr int RESIZE_MARGIN = 8;
+    static constexpr int RECONNECT_CHECK_MS = 2000;     // First check; doubles up to the max
+    static constexpr int RECONNECT_CHECK_MAX_MS = 30000;
+    static constexpr int CONNECTED_CHECK_MS = 5000;
+    static constexpr int HOST_AFTER_ATTEMPTS = 2;       // Failed checks before hosting
 };
 
 #endif // MAINWINDOW_H
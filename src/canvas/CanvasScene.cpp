@@ -130,7 +130,8 @@ void CanvasScene::setBoard(Board *board)
             // Handle remote additions
             if (!m_items.contains(id)) {
                 BoardImage img = m_board->image(id);
-                addImageItem(id, img.image, img.position, img.rotation, img.scale);
+                addImageItem(id, img.image, img.position, img.rotation, img.scale,
+                             img.encoded);
             }
         });
         connect(m_board, &Board::imageRemoved, this, [this](const QString &id) {
@@ -159,7 +160,7 @@ void CanvasScene::loadBoardItems()
     
     for (const QString &id : m_board->imageIds()) {
         BoardImage img = m_board->image(id);
-        addImageItem(id, img.image, img.position, img.rotation, img.scale);
+        addImageItem(id, img.image, img.position, img.rotation, img.scale, img.encoded);
     }
 }
 
@@ -184,6 +185,10 @@ ImageItem *CanvasScene::addImageItem(const QImage &image, const QPointF &pos,
     } else {
         item = new ImageItem(id, image);
         item->setSourcePath(sourcePath);
+        // Dropped or opened files travel and save as the original bytes
+        if (!sourcePath.isEmpty()) {
+            item->setEncoded(EncodedImage::fromFile(sourcePath));
+        }
     }
     
     item->setPos(pos);
@@ -204,6 +209,7 @@ ImageItem *CanvasScene::addImageItem(const QImage &image, const QPointF &pos,
         boardImg.scale = 1.0;
         boardImg.zIndex = item->zValue();
         boardImg.sourcePath = sourcePath;
+        boardImg.encoded = item->encoded();
         m_board->addImage(boardImg);
     }
     
@@ -214,13 +220,15 @@ ImageItem *CanvasScene::addImageItem(const QImage &image, const QPointF &pos,
 }
 
 ImageItem *CanvasScene::addImageItem(const QString &id, const QImage &image,
-                                     const QPointF &pos, qreal rotation, qreal scale)
+                                     const QPointF &pos, qreal rotation, qreal scale,
+                                     const EncodedImage &encoded)
 {
     if (m_items.contains(id)) {
         return m_items.value(id);
     }
     
     ImageItem *item = new ImageItem(id, image);
+    item->setEncoded(encoded);
     item->setPos(pos);
     item->setRotation(rotation);
     item->setScale(scale);
@@ -311,6 +319,7 @@ TextItem *CanvasScene::addTextItem(const QString &id, const QString &text,
     m_textItems.insert(id, item);
     
     connect(item, &TextItem::textChanged, this, &CanvasScene::onTextItemChanged);
+    connect(item, &TextItem::textEdited, this, &CanvasScene::textEdited);
     
     emit textAdded(item);
     emit modificationChanged(true);
@@ -434,6 +443,8 @@ void CanvasScene::copySelected()
     
     // For now, just copy the first selected image
     ImageItem *item = selected.first();
+    // Only a preview so far; the original is still on its way
+    if (item->isPlaceholder()) return;
     QClipboard *clipboard = QApplication::clipboard();
     clipboard->setImage(item->image());
 }
@@ -633,6 +644,10 @@ void CanvasScene::mouseReleaseEvent(QGraphicsSceneMouseEvent *event)
     }
     
     QGraphicsScene::mouseReleaseEvent(event);
+    
+    if (!mouseGrabberItem()) {
+        emit interactionFinished();
+    }
 }
 
 void CanvasScene::keyPressEvent(QKeyEvent *event)
@@ -5,6 +5,7 @@
 #include <QList>
 #include <QHash>
 #include <QUndoStack>
+#include "data/EncodedImage.h"
 
 class ImageItem;
 class TextItem;
@@ -34,9 +35,11 @@ public:
     // Image operations
     ImageItem *addImageItem(const QImage &image, const QPointF &pos, 
                            const QString &sourcePath = QString());
+    // encoded: the file behind image, when there is one to reuse
     ImageItem *addImageItem(const QString &id, const QImage &image, 
                            const QPointF &pos, qreal rotation = 0,
-                           qreal scale = 1.0);
+                           qreal scale = 1.0,
+                           const EncodedImage &encoded = EncodedImage());
     ImageItem *addImageItemFromFile(const QString &id, const QString &filePath, 
                            const QPointF &pos, qreal rotation = 0,
                            qreal scale = 1.0);
@@ -90,9 +93,12 @@ signals:
     void textAdded(TextItem *item);
     void textRemoved(const QString &id);
     void textChanged(TextItem *item);
+    void textEdited(TextItem *item, int position, int removed, const QString &inserted);
     void selectionChanged();
     void localCursorMoved(const QPointF &pos);
     void modificationChanged(bool modified);
+    // A mouse drag, rotate or resize was released
+    void interactionFinished();
 
 protected:
     void mousePressEvent(QGraphicsSceneMouseEvent *event) override;
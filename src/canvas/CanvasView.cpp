@@ -14,6 +14,7 @@
 #include <QDragEnterEvent>
 #include <QDropEvent>
 #include <QUrl>
+#include <QTimer>
 
 CanvasView::CanvasView(CanvasScene *scene, QWidget *parent)
     : QGraphicsView(scene, parent)
@@ -24,6 +25,7 @@ CanvasView::CanvasView(CanvasScene *scene, QWidget *parent)
     , m_isPanning(false)
     , m_isSpacePressed(false)
     , m_scaleWithWindow(false)
+    , m_visibleRectTimer(new QTimer(this))
     , m_showGrid(false)
     , m_gridSize(50)
     , m_gridColor(60, 60, 60)
@@ -60,6 +62,15 @@ CanvasView::CanvasView(CanvasScene *scene, QWidget *parent)
     
     // Initialize last viewport size
     m_lastViewportSize = viewport()->size();
+    
+    // Collaboration only cares where the view ends up, not every step
+    m_visibleRectTimer->setSingleShot(true);
+    m_visibleRectTimer->setInterval(VISIBLE_RECT_DEBOUNCE_MS);
+    connect(m_visibleRectTimer, &QTimer::timeout, this, [this]() {
+        emit visibleRectChanged(visibleSceneRect(), m_currentZoom);
+    });
+    connect(this, &CanvasView::zoomChanged, this, &CanvasView::scheduleVisibleRectUpdate);
+    connect(this, &CanvasView::viewportMoved, this, &CanvasView::scheduleVisibleRectUpdate);
 }
 
 CanvasView::~CanvasView()
@@ -280,6 +291,17 @@ void CanvasView::resizeEvent(QResizeEvent *event)
     
     m_lastViewportSize = event->size();
     QGraphicsView::resizeEvent(event);
+    scheduleVisibleRectUpdate();
+}
+
+QRectF CanvasView::visibleSceneRect() const
+{
+    return mapToScene(viewport()->rect()).boundingRect();
+}
+
+void CanvasView::scheduleVisibleRectUpdate()
+{
+    m_visibleRectTimer->start();
 }
 
 void CanvasView::setScaleWithWindow(bool enabled)
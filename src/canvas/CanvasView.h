@@ -4,6 +4,9 @@
 #include <QGraphicsView>
 #include <QPointF>
 #include <QSize>
+#include <QRectF>
+
+class QTimer;
 
 class CanvasScene;
 
@@ -16,6 +19,7 @@ public:
     ~CanvasView();
 
     qreal currentZoom() const { return m_currentZoom; }
+    QRectF visibleSceneRect() const;
     bool isScaleWithWindow() const { return m_scaleWithWindow; }
     
 public slots:
@@ -34,6 +38,8 @@ signals:
     void zoomChanged(qreal zoom);
     void viewportMoved(QPointF center);
     void scaleWithWindowChanged(bool enabled);
+    // Debounced: fires once panning, zooming or resizing settles
+    void visibleRectChanged(const QRectF &rect, qreal zoom);
 
 protected:
     void wheelEvent(QWheelEvent *event) override;
@@ -51,6 +57,7 @@ protected:
 private:
     void applyZoom(qreal factor, QPointF centerPoint);
     void updateCursor();
+    void scheduleVisibleRectUpdate();
 
     CanvasScene *m_scene;
     qreal m_currentZoom;
@@ -65,11 +72,15 @@ private:
     bool m_scaleWithWindow;
     QSize m_lastViewportSize;
     
+    QTimer *m_visibleRectTimer;
+    
     // Grid settings
     bool m_showGrid;
     int m_gridSize;
     QColor m_gridColor;
     QColor m_backgroundColor;
+    
+    static constexpr int VISIBLE_RECT_DEBOUNCE_MS = 150;
 };
 
 #endif // CANVASVIEW_H
@@ -0,0 +1,86 @@
+#include "ImageDecoder.h"
+
+#include <QBuffer>
+#include <QImageReader>
+#include <QThread>
+
+ImageDecoder::ImageDecoder(QObject *parent)
+    : QObject(parent)
+{
+    // Leave a core for the GUI thread
+    m_pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+}
+
+ImageDecoder::~ImageDecoder()
+{
+    // Queued results die with this object; running jobs only have to end
+    cancelAll();
+    m_pool.waitForDone();
+}
+
+QSize ImageDecoder::peekSize(const QByteArray &data)
+{
+    QBuffer buffer;
+    buffer.setData(data);
+    buffer.open(QIODevice::ReadOnly);
+    
+    QImageReader reader(&buffer);
+    return reader.size();
+}
+
+void ImageDecoder::decode(const QString &id, const QByteArray &data)
+{
+    cancel(id);
+    
+    CancelFlag flag = std::make_shared<std::atomic<bool>>(false);
+    m_jobs.insert(id, flag);
+    
+    m_pool.start([this, id, data, flag]() {
+        if (flag->load()) return;
+        
+        QImage image;
+        image.loadFromData(data);
+        
+        // In the format the raster engine paints from, so turning it into
+        // a pixmap on the GUI thread is a plain copy
+        if (!image.isNull()) {
+            image = image.convertToFormat(image.hasAlphaChannel()
+                                              ? QImage::Format_ARGB32_Premultiplied
+                                              : QImage::Format_RGB32);
+        }
+        if (flag->load()) return;
+        
+        QMetaObject::invokeMethod(this, [this, id, flag, image]() {
+            finish(id, flag, image);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void ImageDecoder::finish(const QString &id, const CancelFlag &flag, const QImage &image)
+{
+    // Cancelled or decoded again since
+    if (flag->load() || m_jobs.value(id) != flag) return;
+    m_jobs.remove(id);
+    
+    if (image.isNull()) {
+        emit failed(id);
+    } else {
+        emit decoded(id, image);
+    }
+}
+
+void ImageDecoder::cancel(const QString &id)
+{
+    CancelFlag flag = m_jobs.take(id);
+    if (flag) {
+        flag->store(true);
+    }
+}
+
+void ImageDecoder::cancelAll()
+{
+    for (const CancelFlag &flag : m_jobs) {
+        flag->store(true);
+    }
+    m_jobs.clear();
+}
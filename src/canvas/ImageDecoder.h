@@ -0,0 +1,48 @@
+#ifndef IMAGEDECODER_H
+#define IMAGEDECODER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QImage>
+#include <QSize>
+#include <QString>
+#include <QThreadPool>
+#include <atomic>
+#include <memory>
+
+// Decodes encoded image bytes on a thread pool so that a board streaming
+// in never stalls the canvas. Results come back on the decoder's thread
+// through decoded() or failed(). A job that was cancelled, or superseded
+// by a newer decode under the same id, reports nothing.
+class ImageDecoder : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ImageDecoder(QObject *parent = nullptr);
+    ~ImageDecoder();
+
+    // Pixel size from the header alone; cheap enough for the GUI thread.
+    // Invalid if the format doesn't say without decoding.
+    static QSize peekSize(const QByteArray &data);
+
+    void decode(const QString &id, const QByteArray &data);
+    void cancel(const QString &id);
+    void cancelAll();
+    bool isDecoding(const QString &id) const { return m_jobs.contains(id); }
+
+signals:
+    void decoded(const QString &id, const QImage &image);
+    void failed(const QString &id);
+
+private:
+    using CancelFlag = std::shared_ptr<std::atomic<bool>>;
+
+    void finish(const QString &id, const CancelFlag &flag, const QImage &image);
+
+    QThreadPool m_pool;
+    QHash<QString, CancelFlag> m_jobs;
+};
+
+#endif // IMAGEDECODER_H
@@ -11,6 +11,13 @@
 #include <QFileInfo>
 #include <QImageReader>
 
+// Blob cache files have no extension, so fall back to the content
+static bool isGifFile(const QString &path)
+{
+    if (QFileInfo(path).suffix().toLower() == "gif") return true;
+    return QImageReader::imageFormat(path) == "gif";
+}
+
 ImageItem::ImageItem(const QString &id, const QImage &image, QGraphicsItem *parent)
     : QGraphicsObject(parent)
     , m_id(id)
@@ -52,14 +59,11 @@ ImageItem::ImageItem(const QString &id, const QString &filePath, QGraphicsItem *
              QGraphicsItem::ItemSendsGeometryChanges);
     setAcceptHoverEvents(true);
     
-    // Check if this is an animated format
-    QFileInfo fileInfo(filePath);
-    QString suffix = fileInfo.suffix().toLower();
-    
-    if (suffix == "gif") {
+    if (isGifFile(filePath)) {
         setupAnimation(filePath);
     } else {
         m_image = QImage(filePath);
+        m_encoded = EncodedImage::fromFile(filePath);
         m_cropRect = QRectF(QPointF(0, 0), QSizeF(m_image.size()));
         updatePixmap();
     }
@@ -70,7 +74,10 @@ ImageItem::ImageItem(const QString &id, const QString &filePath, QGraphicsItem *
 
 void ImageItem::setupAnimation(const QString &filePath)
 {
+    m_placeholderSize = QSize();
+    
     m_movie = new QMovie(filePath, QByteArray(), this);
+    m_encoded = EncodedImage::fromFile(filePath);
     
     if (m_movie->isValid()) {
         connect(m_movie, &QMovie::frameChanged, this, &ImageItem::onMovieFrameChanged);
@@ -104,12 +111,63 @@ void ImageItem::setSourcePath(const QString &path)
     m_sourcePath = path;
     
     // Check if this is an animated GIF and set up animation
-    QFileInfo fileInfo(path);
-    if (fileInfo.suffix().toLower() == "gif" && !m_movie) {
+    if (isGifFile(path) && !m_movie) {
+        prepareGeometryChange();
         setupAnimation(path);
+        update();
     }
 }
 
+void ImageItem::setPlaceholderSize(const QSize &fullSize)
+{
+    if (!fullSize.isValid()) return;
+    
+    prepareGeometryChange();
+    m_placeholderSize = fullSize;
+    m_cropRect = QRectF(QPointF(0, 0), QSizeF(fullSize));
+    updatePixmap();
+    update();
+}
+
+void ImageItem::setPreviewImage(const QImage &preview)
+{
+    if (!isPlaceholder() || preview.isNull()) return;
+    
+    m_image = preview;
+    updatePixmap();
+    update();
+}
+
+void ImageItem::replaceImage(const QImage &image, const EncodedImage &encoded)
+{
+    if (image.isNull()) return;
+    
+    bool uncropped = m_cropRect == QRectF(QPointF(0, 0), imageSize());
+    
+    prepareGeometryChange();
+    m_placeholderSize = QSize();
+    m_image = image;
+    m_encoded = encoded;
+    QRectF bounds(QPointF(0, 0), QSizeF(m_image.size()));
+    m_cropRect = uncropped ? bounds : m_cropRect.intersected(bounds);
+    updatePixmap();
+    update();
+}
+
+EncodedImage ImageItem::encoded() const
+{
+    // A preview's pixels aren't the image
+    if (m_encoded.isNull() && !isPlaceholder()) {
+        m_encoded = EncodedImage::encode(m_image);
+    }
+    return m_encoded;
+}
+
+QSizeF ImageItem::imageSize() const
+{
+    return isPlaceholder() ? QSizeF(m_placeholderSize) : QSizeF(m_image.size());
+}
+
 ImageItem::~ImageItem()
 {
     if (m_movie) {
@@ -161,7 +219,7 @@ void ImageItem::setImageScale(qreal s)
 
 void ImageItem::setCrop(const QRectF &cropRect)
 {
-    m_cropRect = cropRect.intersected(QRectF(QPointF(0, 0), m_image.size()));
+    m_cropRect = cropRect.intersected(QRectF(QPointF(0, 0), imageSize()));
     updatePixmap();
     update();
     emit itemChanged(this);
@@ -169,7 +227,7 @@ void ImageItem::setCrop(const QRectF &cropRect)
 
 void ImageItem::resetCrop()
 {
-    m_cropRect = QRectF(QPointF(0, 0), m_image.size());
+    m_cropRect = QRectF(QPointF(0, 0), imageSize());
     updatePixmap();
     update();
     emit itemChanged(this);
@@ -200,7 +258,7 @@ void ImageItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option,
     
     if (!m_pixmap.isNull()) {
         painter->drawPixmap(destRect.toRect(), m_pixmap);
-    } else {
+    } else if (!isPlaceholder()) {
         // Draw red X if pixmap is null
         painter->setPen(QPen(Qt::red, 3));
         painter->drawLine(destRect.topLeft(), destRect.bottomRight());
@@ -274,6 +332,7 @@ void ImageItem::mouseMoveEvent(QGraphicsSceneMouseEvent *event)
         
         setRotation(newRotation);
         emit itemRotated(this);
+        emit itemChanged(this);
         event->accept();
         return;
     }
@@ -332,6 +391,7 @@ void ImageItem::mouseMoveEvent(QGraphicsSceneMouseEvent *event)
         
         setScale(newScale);
         emit itemScaled(this);
+        emit itemChanged(this);
         event->accept();
         return;
     }
@@ -489,7 +549,18 @@ void ImageItem::drawHandles(QPainter *painter)
 
 void ImageItem::updatePixmap()
 {
-    QImage cropped = m_image.copy(m_cropRect.toRect());
+    // The crop is in full-size coordinates; map it onto a preview
+    QRectF source = m_cropRect;
+    if (isPlaceholder()) {
+        qreal sx = m_image.width() / qreal(m_placeholderSize.width());
+        qreal sy = m_image.height() / qreal(m_placeholderSize.height());
+        source = QRectF(source.x() * sx, source.y() * sy,
+                        source.width() * sx, source.height() * sy);
+    }
+    
+    // Uncropped, the image is shared rather than copied
+    QRect sourceRect = source.toRect();
+    QImage cropped = sourceRect == m_image.rect() ? m_image : m_image.copy(sourceRect);
     
     // Apply flips
     if (m_flippedH || m_flippedV) {
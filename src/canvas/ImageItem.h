@@ -6,6 +6,7 @@
 #include <QPixmap>
 #include <QMovie>
 #include <QPointer>
+#include "data/EncodedImage.h"
 
 class ImageItem : public QGraphicsObject
 {
@@ -27,8 +28,24 @@ public:
     QString sourcePath() const { return m_sourcePath; }
     void setSourcePath(const QString &path);
     
+    // The file behind the pixels, sent and saved as is. Items without one
+    // encode their pixels once on first use; null while a placeholder.
+    EncodedImage encoded() const;
+    void setEncoded(const EncodedImage &encoded) { m_encoded = encoded; }
+    
     bool isAnimated() const { return m_movie != nullptr; }
     
+    // A low-resolution preview (or no image at all) standing in for an
+    // image still being downloaded or decoded; the item is laid out at
+    // the full size meanwhile
+    void setPlaceholderSize(const QSize &fullSize);
+    bool isPlaceholder() const { return m_placeholderSize.isValid(); }
+    // A sharper preview, the item staying a placeholder
+    void setPreviewImage(const QImage &preview);
+    // Swaps in the full image, keeping crop and transforms; encoded is
+    // the file it came from, if known
+    void replaceImage(const QImage &image, const EncodedImage &encoded = EncodedImage());
+    
     // Transform operations
     void flipHorizontal();
     void flipVertical();
@@ -83,11 +100,14 @@ private:
     void drawHandles(QPainter *painter);
     void updatePixmap();
     void setupAnimation(const QString &filePath);
+    QSizeF imageSize() const;
     
     QString m_id;
     QImage m_image;
     QPixmap m_pixmap;
     QString m_sourcePath;
+    mutable EncodedImage m_encoded; // Cached; dropped when the pixels change
+    QSize m_placeholderSize;    // Full size while m_image is only a preview
     
     // Animation support
     QPointer<QMovie> m_movie;
@@ -5,6 +5,7 @@
 #include <QFocusEvent>
 #include <QKeyEvent>
 #include <QTextCursor>
+#include <QTextDocument>
 #include <QJsonObject>
 
 TextItem::TextItem(const QString &id, const QString &text, QGraphicsItem *parent)
@@ -27,6 +28,9 @@ TextItem::TextItem(const QString &id, const QString &text, QGraphicsItem *parent
     
     // Set a minimum width
     setTextWidth(200);
+    
+    m_plainText = toPlainText();
+    connect(document(), &QTextDocument::contentsChange, this, &TextItem::onContentsChange);
 }
 
 TextItem::~TextItem()
@@ -43,6 +47,60 @@ QString TextItem::text() const
     return toPlainText();
 }
 
+bool TextItem::applyEdit(int position, int removed, const QString &inserted)
+{
+    // The document counts one more character than its plain text
+    if (position < 0 || removed < 0 ||
+        position + removed > document()->characterCount() - 1) {
+        return false;
+    }
+    
+    QTextCursor cursor(document());
+    cursor.setPosition(position);
+    cursor.setPosition(position + removed, QTextCursor::KeepAnchor);
+    if (cursor.hasSelection()) {
+        cursor.removeSelectedText();
+    }
+    if (!inserted.isEmpty()) {
+        cursor.insertText(inserted);
+    }
+    return true;
+}
+
+void TextItem::onContentsChange(int position, int charsRemoved, int charsAdded)
+{
+    QString previous = m_plainText;
+    m_plainText = toPlainText();
+    
+    // Whole-document replacements are reported including the final block
+    // separator; work the change out from the texts when numbers don't fit
+    if (position < 0 || position + charsRemoved > previous.size() ||
+        position + charsAdded > m_plainText.size() ||
+        previous.size() - charsRemoved + charsAdded != m_plainText.size()) {
+        int shorter = qMin(previous.size(), m_plainText.size());
+        position = 0;
+        while (position < shorter && previous.at(position) == m_plainText.at(position)) {
+            ++position;
+        }
+        int suffix = 0;
+        while (suffix < shorter - position &&
+               previous.at(previous.size() - 1 - suffix) ==
+               m_plainText.at(m_plainText.size() - 1 - suffix)) {
+            ++suffix;
+        }
+        charsRemoved = previous.size() - position - suffix;
+        charsAdded = m_plainText.size() - position - suffix;
+    }
+    
+    QString inserted = m_plainText.mid(position, charsAdded);
+    // Formatting only
+    if (charsRemoved == charsAdded && previous.mid(position, charsRemoved) == inserted) {
+        return;
+    }
+    
+    emit textEdited(this, position, charsRemoved, inserted);
+}
+
 void TextItem::setTextFont(const QFont &font)
 {
     setFont(font);
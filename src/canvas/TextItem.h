@@ -18,6 +18,9 @@ public:
     
     void setText(const QString &text);
     QString text() const;
+    // Replaces removed characters at position in place, keeping the
+    // layout of the rest and any local cursor
+    bool applyEdit(int position, int removed, const QString &inserted);
     
     void setTextFont(const QFont &font);
     QFont textFont() const;
@@ -37,6 +40,8 @@ public:
 
 signals:
     void textChanged(TextItem *item);
+    // The plain text changed at one spot, whoever changed it
+    void textEdited(TextItem *item, int position, int removed, const QString &inserted);
     void editingFinished(TextItem *item);
 
 protected:
@@ -47,8 +52,12 @@ protected:
     void keyPressEvent(QKeyEvent *event) override;
     QVariant itemChange(GraphicsItemChange change, const QVariant &value) override;
 
+private slots:
+    void onContentsChange(int position, int charsRemoved, int charsAdded);
+
 private:
     QString m_id;
+    QString m_plainText;    // As of the last change, to tell what changed
     QColor m_backgroundColor;
     bool m_isEditing;
 };
@@ -5,6 +5,7 @@
 #include <QHash>
 #include <QImage>
 #include <QPointF>
+#include "EncodedImage.h"
 
 struct BoardImage {
     QString id;
@@ -14,6 +15,7 @@ struct BoardImage {
     qreal scale = 1.0;
     qreal zIndex = 0;
     QString sourcePath;
+    EncodedImage encoded;   // What image was decoded from; saved as is
     QRectF cropRect;
     bool flippedH = false;
     bool flippedV = false;
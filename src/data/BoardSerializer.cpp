@@ -3,7 +3,6 @@
 
 #include <QFile>
 #include <QDataStream>
-#include <QBuffer>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
@@ -61,8 +60,12 @@ Board* BoardSerializer::load(const QString &filePath)
         QByteArray imageData;
         stream >> imageData;
         
+        EncodedImage encoded;
+        encoded.data = imageData;
+        encoded.format = imgMeta["format"].toString("png").toLatin1();
+        
         QImage image;
-        image.loadFromData(imageData, "PNG");
+        image.loadFromData(encoded.data, encoded.format.constData());
         
         if (image.isNull()) {
             continue;
@@ -71,6 +74,7 @@ Board* BoardSerializer::load(const QString &filePath)
         BoardImage boardImg;
         boardImg.id = imgMeta["id"].toString();
         boardImg.image = image;
+        boardImg.encoded = encoded;
         boardImg.position = QPointF(imgMeta["x"].toDouble(), imgMeta["y"].toDouble());
         boardImg.rotation = imgMeta["rotation"].toDouble();
         boardImg.scale = imgMeta["scale"].toDouble(1.0);
@@ -138,6 +142,13 @@ bool BoardSerializer::save(Board *board, const QString &filePath)
         imgMeta["flippedH"] = img.flippedH;
         imgMeta["flippedV"] = img.flippedV;
         
+        // The original file where there is one, otherwise a lossless PNG
+        EncodedImage encoded = img.encoded;
+        if (encoded.isNull()) {
+            encoded = EncodedImage::encode(img.image);
+        }
+        imgMeta["format"] = QString::fromLatin1(encoded.format);
+        
         if (img.cropRect.isValid()) {
             QJsonObject crop;
             crop["x"] = img.cropRect.x();
@@ -150,13 +161,7 @@ bool BoardSerializer::save(Board *board, const QString &filePath)
         QByteArray imgMetaJson = QJsonDocument(imgMeta).toJson(QJsonDocument::Compact);
         stream << imgMetaJson;
         
-        // Image data as PNG
-        QByteArray imageData;
-        QBuffer buffer(&imageData);
-        buffer.open(QIODevice::WriteOnly);
-        img.image.save(&buffer, "PNG");
-        
-        stream << imageData;
+        stream << encoded.data;
     }
     
     file.close();
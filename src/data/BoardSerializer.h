@@ -14,7 +14,9 @@ public:
 private:
     BoardSerializer() = default;
     
-    static constexpr int FILE_VERSION = 1;
+    // 2: each image stored as its original file, named by "format";
+    // version 1 files hold PNGs
+    static constexpr int FILE_VERSION = 2;
     static constexpr char FILE_MAGIC[] = "CREF";
 };
 
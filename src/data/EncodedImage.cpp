@@ -0,0 +1,51 @@
+#include "EncodedImage.h"
+
+#include <QBuffer>
+#include <QFile>
+#include <QImageReader>
+
+EncodedImage EncodedImage::fromFile(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return EncodedImage();
+
+    EncodedImage encoded = fromData(file.readAll());
+    if (encoded.isNull()) return encoded;
+
+    QBuffer buffer(&encoded.data);
+    buffer.open(QIODevice::ReadOnly);
+    QImageReader reader(&buffer, encoded.format);
+    if (reader.transformation() != QImageIOHandler::TransformationNone) {
+        return EncodedImage();
+    }
+    return encoded;
+}
+
+EncodedImage EncodedImage::fromData(const QByteArray &data)
+{
+    QBuffer buffer;
+    buffer.setData(data);
+    buffer.open(QIODevice::ReadOnly);
+
+    EncodedImage encoded;
+    encoded.format = QImageReader::imageFormat(&buffer);
+    if (!encoded.format.isEmpty()) {
+        encoded.data = data;
+    }
+    return encoded;
+}
+
+EncodedImage EncodedImage::encode(const QImage &image)
+{
+    EncodedImage encoded;
+    if (image.isNull()) return encoded;
+
+    QBuffer buffer(&encoded.data);
+    buffer.open(QIODevice::WriteOnly);
+    if (image.save(&buffer, "PNG")) {
+        encoded.format = "png";
+    } else {
+        encoded.data.clear();
+    }
+    return encoded;
+}
@@ -0,0 +1,29 @@
+#ifndef ENCODEDIMAGE_H
+#define ENCODEDIMAGE_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QString>
+
+// An image as encoded file bytes plus the codec they are in. Kept from
+// import so that boards and the network carry the original file instead
+// of a re-encode; pixels without a file behind them are encoded once,
+// losslessly.
+struct EncodedImage {
+    QByteArray data;
+    QByteArray format;      // As QImageReader names it: "jpeg", "png", "gif", ...
+
+    bool isNull() const { return data.isEmpty(); }
+    bool isGif() const { return format == "gif"; }
+
+    // The file's bytes as they are. Null if it can't be read, or if it
+    // carries an orientation the pixels were rotated by on import, since
+    // other readers wouldn't apply it.
+    static EncodedImage fromFile(const QString &path);
+    // Codec sniffed from the bytes; null if no reader recognizes them
+    static EncodedImage fromData(const QByteArray &data);
+    // Lossless PNG of the pixels
+    static EncodedImage encode(const QImage &image);
+};
+
+#endif // ENCODEDIMAGE_H
@@ -0,0 +1,251 @@
+#include "LwwTable.h"
+
+#include <QJsonArray>
+#include <QSet>
+
+bool LamportStamp::operator<(const LamportStamp &other) const
+{
+    if (counter != other.counter) return counter < other.counter;
+    return replica < other.replica;
+}
+
+bool LamportStamp::operator==(const LamportStamp &other) const
+{
+    return counter == other.counter && replica == other.replica;
+}
+
+QJsonValue LamportStamp::toJson() const
+{
+    return QJsonArray{counter, replica};
+}
+
+LamportStamp LamportStamp::fromJson(const QJsonValue &value)
+{
+    QJsonArray array = value.toArray();
+    LamportStamp stamp;
+    stamp.counter = array.at(0).toVariant().toLongLong();
+    stamp.replica = array.at(1).toString();
+    return stamp;
+}
+
+LamportStamp LamportClock::tick()
+{
+    LamportStamp stamp;
+    stamp.counter = ++m_counter;
+    stamp.replica = m_replica;
+    return stamp;
+}
+
+void LamportClock::observe(const LamportStamp &stamp)
+{
+    m_counter = qMax(m_counter, stamp.counter);
+}
+
+QJsonObject LwwTable::merge(const QString &itemId, const QJsonObject &fields,
+                            const LamportStamp &stamp, bool *changed)
+{
+    if (stamp.isNull()) {
+        if (changed) *changed = true;
+        return fields;
+    }
+
+    // Removed after this op was made: nothing of it survives. A newer op
+    // leaves the tombstone in place, so older ones still arriving late
+    // stay rejected.
+    auto tombstone = m_tombstones.constFind(itemId);
+    if (tombstone != m_tombstones.constEnd() && !(tombstone.value() < stamp)) {
+        if (changed) *changed = false;
+        return QJsonObject();
+    }
+
+    // Decide per register first; x and y share one and must go together
+    QHash<QString, LamportStamp> &registers = m_stamps[itemId];
+    QSet<QString> won;
+    QSet<QString> lost;
+    for (auto it = fields.constBegin(); it != fields.constEnd(); ++it) {
+        QString reg = registerOf(it.key());
+        if (reg.isEmpty() || won.contains(reg) || lost.contains(reg)) continue;
+
+        auto current = registers.constFind(reg);
+        if (current == registers.constEnd() || current.value() < stamp) {
+            won.insert(reg);
+        } else {
+            lost.insert(reg);
+        }
+    }
+
+    QJsonObject result;
+    for (auto it = fields.constBegin(); it != fields.constEnd(); ++it) {
+        QString reg = registerOf(it.key());
+        if (reg.isEmpty() || won.contains(reg)) {
+            result.insert(it.key(), it.value());
+        }
+    }
+    for (const QString &reg : won) {
+        registers.insert(reg, stamp);
+    }
+
+    if (changed) *changed = !won.isEmpty();
+    return result;
+}
+
+QJsonObject LwwTable::mergeSnapshot(const QString &itemId, const QJsonObject &fields,
+                                    const QJsonObject &stamps)
+{
+    // Split by register so each is judged by its own stamp
+    QHash<QString, QJsonObject> byRegister;
+    QJsonObject result;
+    for (auto it = fields.constBegin(); it != fields.constEnd(); ++it) {
+        QString reg = registerOf(it.key());
+        if (reg.isEmpty()) {
+            result.insert(it.key(), it.value());
+        } else {
+            byRegister[reg].insert(it.key(), it.value());
+        }
+    }
+
+    for (auto it = byRegister.constBegin(); it != byRegister.constEnd(); ++it) {
+        LamportStamp stamp = LamportStamp::fromJson(stamps.value(it.key()));
+        if (stamp.isNull()) continue;
+
+        const QJsonObject won = merge(itemId, it.value(), stamp);
+        for (auto field = won.constBegin(); field != won.constEnd(); ++field) {
+            result.insert(field.key(), field.value());
+        }
+    }
+    return result;
+}
+
+bool LwwTable::remove(const QString &itemId, const LamportStamp &stamp)
+{
+    if (stamp.isNull()) {
+        m_stamps.remove(itemId);
+        return true;
+    }
+
+    auto tombstone = m_tombstones.constFind(itemId);
+    if (tombstone != m_tombstones.constEnd() && !(tombstone.value() < stamp)) {
+        return false;
+    }
+    m_tombstones.insert(itemId, stamp);
+    m_stamps.remove(itemId);
+    return true;
+}
+
+bool LwwTable::isRemoved(const QString &itemId, const LamportStamp &stamp) const
+{
+    auto tombstone = m_tombstones.constFind(itemId);
+    if (tombstone == m_tombstones.constEnd()) return false;
+    // Unstamped adds can't be ordered against it; the removal stands
+    return stamp.isNull() || !(tombstone.value() < stamp);
+}
+
+LamportStamp LwwTable::latest(const QString &itemId) const
+{
+    LamportStamp newest;
+    const QHash<QString, LamportStamp> registers = m_stamps.value(itemId);
+    for (const LamportStamp &stamp : registers) {
+        if (newest < stamp) {
+            newest = stamp;
+        }
+    }
+    return newest;
+}
+
+QJsonObject LwwTable::stampsJson(const QString &itemId) const
+{
+    QJsonObject stamps;
+    const QHash<QString, LamportStamp> registers = m_stamps.value(itemId);
+    for (auto it = registers.constBegin(); it != registers.constEnd(); ++it) {
+        stamps.insert(it.key(), it.value().toJson());
+    }
+    return stamps;
+}
+
+QJsonObject LwwTable::stampsJson() const
+{
+    QJsonObject all;
+    for (auto it = m_stamps.constBegin(); it != m_stamps.constEnd(); ++it) {
+        if (!it.value().isEmpty()) {
+            all.insert(it.key(), stampsJson(it.key()));
+        }
+    }
+    return all;
+}
+
+void LwwTable::loadStamps(const QJsonObject &allStamps)
+{
+    for (auto it = allStamps.constBegin(); it != allStamps.constEnd(); ++it) {
+        loadStamps(it.key(), it.value().toObject());
+    }
+}
+
+void LwwTable::loadStamps(const QString &itemId, const QJsonObject &stamps)
+{
+    QHash<QString, LamportStamp> &registers = m_stamps[itemId];
+    for (auto it = stamps.constBegin(); it != stamps.constEnd(); ++it) {
+        LamportStamp stamp = LamportStamp::fromJson(it.value());
+        auto current = registers.constFind(it.key());
+        if (current == registers.constEnd() || current.value() < stamp) {
+            registers.insert(it.key(), stamp);
+        }
+    }
+}
+
+QJsonObject LwwTable::tombstonesJson() const
+{
+    QJsonObject tombstones;
+    for (auto it = m_tombstones.constBegin(); it != m_tombstones.constEnd(); ++it) {
+        tombstones.insert(it.key(), it.value().toJson());
+    }
+    return tombstones;
+}
+
+void LwwTable::loadTombstones(const QJsonObject &tombstones)
+{
+    for (auto it = tombstones.constBegin(); it != tombstones.constEnd(); ++it) {
+        LamportStamp stamp = LamportStamp::fromJson(it.value());
+        if (stamp.isNull()) continue;
+        auto current = m_tombstones.constFind(it.key());
+        if (current == m_tombstones.constEnd() || current.value() < stamp) {
+            m_tombstones.insert(it.key(), stamp);
+        }
+    }
+}
+
+qint64 LwwTable::maxCounter() const
+{
+    qint64 counter = 0;
+    for (const QHash<QString, LamportStamp> &registers : m_stamps) {
+        for (const LamportStamp &stamp : registers) {
+            counter = qMax(counter, stamp.counter);
+        }
+    }
+    for (const LamportStamp &stamp : m_tombstones) {
+        counter = qMax(counter, stamp.counter);
+    }
+    return counter;
+}
+
+void LwwTable::clear()
+{
+    m_stamps.clear();
+    m_tombstones.clear();
+}
+
+QString LwwTable::registerOf(const QString &field)
+{
+    static const QHash<QString, QString> registers = {
+        {"x", "pos"},
+        {"y", "pos"},
+        {"rotation", "rotation"},
+        {"scale", "scale"},
+        {"zIndex", "zIndex"},
+        {"crop", "crop"},
+        {"text", "text"},
+        {"fontFamily", "style"},
+        {"fontSize", "style"},
+        {"textColor", "style"},
+    };
+    return registers.value(field);
+}
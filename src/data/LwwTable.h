@@ -0,0 +1,94 @@
+#ifndef LWWTABLE_H
+#define LWWTABLE_H
+
+#include <QHash>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QString>
+
+// Lamport timestamp: a counter ordered first, the replica id breaking
+// ties, so any two stamps from different writers compare the same way
+// everywhere. A null stamp comes from peers that don't stamp their ops.
+struct LamportStamp {
+    qint64 counter = 0;
+    QString replica;
+
+    bool isNull() const { return counter == 0; }
+    bool operator<(const LamportStamp &other) const;
+    bool operator==(const LamportStamp &other) const;
+    bool operator!=(const LamportStamp &other) const { return !(*this == other); }
+
+    // [counter, replica] on the wire
+    QJsonValue toJson() const;
+    static LamportStamp fromJson(const QJsonValue &value);
+};
+
+class LamportClock
+{
+public:
+    explicit LamportClock(const QString &replica = QString()) : m_replica(replica) {}
+
+    void setReplica(const QString &replica) { m_replica = replica; }
+    // Stamp for a local edit, later than everything seen so far
+    LamportStamp tick();
+    // Moves past a stamp seen from someone else
+    void observe(const LamportStamp &stamp);
+
+private:
+    qint64 m_counter = 0;
+    QString m_replica;
+};
+
+// Last-writer-wins bookkeeping for board items. Every mutable property
+// is a register holding the stamp of the op that last set it; an op only
+// takes the registers it is newer than, so replicas that see the same ops
+// in any order settle on the same values. Removals leave a tombstone that
+// keeps older adds and updates from bringing an item back; it stays until
+// its owner drops it, even if the item is added again.
+class LwwTable
+{
+public:
+    LwwTable() = default;
+
+    // Fields of an add or update that win; the rest are dropped. Fields
+    // that aren't registers (ids, blob hashes, ...) always pass. *changed
+    // tells whether any register was taken. Unstamped ops always win.
+    QJsonObject merge(const QString &itemId, const QJsonObject &fields,
+                      const LamportStamp &stamp, bool *changed = nullptr);
+    // Same for a snapshot of an item, whose registers each carry their
+    // own stamp (register -> stamp); registers without one are dropped
+    QJsonObject mergeSnapshot(const QString &itemId, const QJsonObject &fields,
+                              const QJsonObject &stamps);
+    // Tombstones the item unless a newer tombstone is already there
+    bool remove(const QString &itemId, const LamportStamp &stamp);
+    // Whether an add with this stamp is older than the item's removal
+    bool isRemoved(const QString &itemId, const LamportStamp &stamp) const;
+    LamportStamp tombstone(const QString &itemId) const { return m_tombstones.value(itemId); }
+    // Once nobody can still send ops made before the removal
+    void dropTombstone(const QString &itemId) { m_tombstones.remove(itemId); }
+    // Newest stamp among the item's registers
+    LamportStamp latest(const QString &itemId) const;
+
+    // Register stamps of one item, or itemId -> stamps for all of them,
+    // for snapshots and full syncs
+    QJsonObject stampsJson(const QString &itemId) const;
+    QJsonObject stampsJson() const;
+    void loadStamps(const QString &itemId, const QJsonObject &stamps);
+    void loadStamps(const QJsonObject &allStamps);
+    QJsonObject tombstonesJson() const;
+    void loadTombstones(const QJsonObject &tombstones);
+    // Highest counter recorded, to restore a clock after loading
+    qint64 maxCounter() const;
+
+    void forget(const QString &itemId) { m_stamps.remove(itemId); }
+    void clear();
+
+    // Register a field belongs to; empty for fields that never change
+    static QString registerOf(const QString &field);
+
+private:
+    QHash<QString, QHash<QString, LamportStamp>> m_stamps;  // itemId -> register -> stamp
+    QHash<QString, LamportStamp> m_tombstones;              // itemId -> removal stamp
+};
+
+#endif // LWWTABLE_H
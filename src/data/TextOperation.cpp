@@ -0,0 +1,269 @@
+#include "TextOperation.h"
+
+#include <QJsonValue>
+#include <limits>
+
+TextOperation &TextOperation::retain(int count)
+{
+    if (count <= 0) return *this;
+    m_baseLength += count;
+    m_targetLength += count;
+    if (!m_components.isEmpty() && m_components.last().kind == Kind::Retain) {
+        m_components.last().count += count;
+    } else {
+        m_components.append(Component{Kind::Retain, count, QString()});
+    }
+    return *this;
+}
+
+TextOperation &TextOperation::insert(const QString &text)
+{
+    if (text.isEmpty()) return *this;
+    m_targetLength += text.size();
+
+    // Inserts always go ahead of an adjacent delete, so equal edits have
+    // one form and transform() sees them the same way
+    int count = m_components.size();
+    if (count > 0 && m_components[count - 1].kind == Kind::Insert) {
+        m_components[count - 1].text += text;
+    } else if (count > 0 && m_components[count - 1].kind == Kind::Delete) {
+        if (count > 1 && m_components[count - 2].kind == Kind::Insert) {
+            m_components[count - 2].text += text;
+        } else {
+            m_components.insert(count - 1, Component{Kind::Insert, 0, text});
+        }
+    } else {
+        m_components.append(Component{Kind::Insert, 0, text});
+    }
+    return *this;
+}
+
+TextOperation &TextOperation::remove(int count)
+{
+    if (count <= 0) return *this;
+    m_baseLength += count;
+    if (!m_components.isEmpty() && m_components.last().kind == Kind::Delete) {
+        m_components.last().count += count;
+    } else {
+        m_components.append(Component{Kind::Delete, count, QString()});
+    }
+    return *this;
+}
+
+bool TextOperation::isNoop() const
+{
+    for (const Component &component : m_components) {
+        if (component.kind != Kind::Retain) return false;
+    }
+    return true;
+}
+
+bool TextOperation::apply(QString *text) const
+{
+    if (text->size() != m_baseLength) return false;
+
+    QString result;
+    result.reserve(m_targetLength);
+    int position = 0;
+    for (const Component &component : m_components) {
+        switch (component.kind) {
+        case Kind::Retain:
+            result.append(text->constData() + position, component.count);
+            position += component.count;
+            break;
+        case Kind::Insert:
+            result.append(component.text);
+            break;
+        case Kind::Delete:
+            position += component.count;
+            break;
+        }
+    }
+
+    *text = result;
+    return true;
+}
+
+QList<TextOperation::Splice> TextOperation::splices() const
+{
+    QList<Splice> splices;
+    int position = 0;
+    for (const Component &component : m_components) {
+        switch (component.kind) {
+        case Kind::Retain:
+            position += component.count;
+            break;
+        case Kind::Insert:
+            splices.append(Splice{position, 0, component.text});
+            position += component.text.size();
+            break;
+        case Kind::Delete:
+            // Right after an insert: replace in one go
+            if (!splices.isEmpty() &&
+                splices.last().position + splices.last().inserted.size() == position) {
+                splices.last().removed += component.count;
+            } else {
+                splices.append(Splice{position, component.count, QString()});
+            }
+            break;
+        }
+    }
+    return splices;
+}
+
+TextOperation TextOperation::fromSplice(int length, int position, int removed,
+                                        const QString &inserted)
+{
+    TextOperation operation;
+    operation.retain(position);
+    operation.remove(removed);
+    operation.insert(inserted);
+    operation.retain(length - position - removed);
+    return operation;
+}
+
+bool TextOperation::compose(const TextOperation &a, const TextOperation &b,
+                            TextOperation *composed)
+{
+    if (a.m_targetLength != b.m_baseLength) return false;
+
+    // Walk a's output and b's input together
+    TextOperation result;
+    QVector<Component> opsA = a.m_components;
+    QVector<Component> opsB = b.m_components;
+    int i = 0;
+    int j = 0;
+
+    while (i < opsA.size() || j < opsB.size()) {
+        // Deleted by a: b never saw it. Inserted by b: a never touched it.
+        if (i < opsA.size() && opsA[i].kind == Kind::Delete) {
+            result.remove(opsA[i].count);
+            ++i;
+            continue;
+        }
+        if (j < opsB.size() && opsB[j].kind == Kind::Insert) {
+            result.insert(opsB[j].text);
+            ++j;
+            continue;
+        }
+        if (i >= opsA.size() || j >= opsB.size()) return false;
+
+        Component &componentA = opsA[i];
+        Component &componentB = opsB[j];
+        int lengthA = componentA.kind == Kind::Insert ? componentA.text.size()
+                                                      : componentA.count;
+        int count = qMin(lengthA, componentB.count);
+
+        if (componentA.kind == Kind::Retain && componentB.kind == Kind::Retain) {
+            result.retain(count);
+        } else if (componentA.kind == Kind::Insert && componentB.kind == Kind::Retain) {
+            result.insert(componentA.text.left(count));
+        } else if (componentA.kind == Kind::Retain && componentB.kind == Kind::Delete) {
+            result.remove(count);
+        }
+        // Inserted by a, deleted by b: never happened
+
+        if (componentA.kind == Kind::Insert) {
+            componentA.text.remove(0, count);
+        } else {
+            componentA.count -= count;
+        }
+        componentB.count -= count;
+        if (lengthA == count) ++i;
+        if (componentB.count == 0) ++j;
+    }
+
+    *composed = result;
+    return true;
+}
+
+bool TextOperation::transform(const TextOperation &a, const TextOperation &b,
+                              TextOperation *aPrime, TextOperation *bPrime)
+{
+    if (a.m_baseLength != b.m_baseLength) return false;
+
+    TextOperation resultA;
+    TextOperation resultB;
+    QVector<Component> opsA = a.m_components;
+    QVector<Component> opsB = b.m_components;
+    int i = 0;
+    int j = 0;
+
+    while (i < opsA.size() || j < opsB.size()) {
+        // Inserted text is new to the other side, which just skips over it
+        if (i < opsA.size() && opsA[i].kind == Kind::Insert) {
+            resultA.insert(opsA[i].text);
+            resultB.retain(opsA[i].text.size());
+            ++i;
+            continue;
+        }
+        if (j < opsB.size() && opsB[j].kind == Kind::Insert) {
+            resultA.retain(opsB[j].text.size());
+            resultB.insert(opsB[j].text);
+            ++j;
+            continue;
+        }
+        if (i >= opsA.size() || j >= opsB.size()) return false;
+
+        Component &componentA = opsA[i];
+        Component &componentB = opsB[j];
+        int count = qMin(componentA.count, componentB.count);
+
+        if (componentA.kind == Kind::Retain && componentB.kind == Kind::Retain) {
+            resultA.retain(count);
+            resultB.retain(count);
+        } else if (componentA.kind == Kind::Delete && componentB.kind == Kind::Retain) {
+            resultA.remove(count);
+        } else if (componentA.kind == Kind::Retain && componentB.kind == Kind::Delete) {
+            resultB.remove(count);
+        }
+        // Deleted by both: already gone on either side
+
+        componentA.count -= count;
+        componentB.count -= count;
+        if (componentA.count == 0) ++i;
+        if (componentB.count == 0) ++j;
+    }
+
+    *aPrime = resultA;
+    *bPrime = resultB;
+    return true;
+}
+
+QJsonArray TextOperation::toJson() const
+{
+    QJsonArray json;
+    for (const Component &component : m_components) {
+        switch (component.kind) {
+        case Kind::Retain: json.append(component.count); break;
+        case Kind::Insert: json.append(component.text); break;
+        case Kind::Delete: json.append(-component.count); break;
+        }
+    }
+    return json;
+}
+
+bool TextOperation::fromJson(const QJsonArray &json, TextOperation *operation)
+{
+    TextOperation result;
+    for (const QJsonValue &value : json) {
+        if (value.isString()) {
+            result.insert(value.toString());
+            continue;
+        }
+        if (!value.isDouble()) return false;
+
+        double number = value.toDouble();
+        if (qAbs(number) > std::numeric_limits<int>::max()) return false;
+        int count = static_cast<int>(number);
+        if (count == 0 || count != number) return false;
+        if (count > 0) {
+            result.retain(count);
+        } else {
+            result.remove(-count);
+        }
+    }
+
+    *operation = result;
+    return true;
+}
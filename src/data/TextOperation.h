@@ -0,0 +1,72 @@
+#ifndef TEXTOPERATION_H
+#define TEXTOPERATION_H
+
+#include <QJsonArray>
+#include <QList>
+#include <QString>
+#include <QVector>
+
+// An edit of a plain-text document as a walk over it: retain n characters,
+// insert a string, delete n characters. Lengths are in QChar units, the
+// same positions QTextDocument uses. Two concurrent edits of the same text
+// can be transformed against each other so both orders end up with the
+// same document (operational transformation). On the wire an edit is a
+// JSON array: positive ints retain, negative ints delete, strings insert.
+class TextOperation
+{
+public:
+    // One contiguous change, positions relative to the document as
+    // changed by the splices before it
+    struct Splice {
+        int position = 0;
+        int removed = 0;
+        QString inserted;
+    };
+
+    TextOperation() = default;
+
+    TextOperation &retain(int count);
+    TextOperation &insert(const QString &text);
+    TextOperation &remove(int count);
+
+    // Length of the document it applies to, and of the result
+    int baseLength() const { return m_baseLength; }
+    int targetLength() const { return m_targetLength; }
+    bool isNoop() const;
+
+    // Fails if the text isn't baseLength() long
+    bool apply(QString *text) const;
+    QList<Splice> splices() const;
+
+    // Replaces removed characters at position in a document of length
+    static TextOperation fromSplice(int length, int position, int removed,
+                                    const QString &inserted);
+
+    // One edit doing what a followed by b does. Fails unless b applies to
+    // a's result.
+    static bool compose(const TextOperation &a, const TextOperation &b,
+                        TextOperation *composed);
+    // a and b were made against the same document. aPrime applies after
+    // b and bPrime after a, with the same result; on a tie a's insert
+    // goes first. Fails if they don't share a base length.
+    static bool transform(const TextOperation &a, const TextOperation &b,
+                          TextOperation *aPrime, TextOperation *bPrime);
+
+    QJsonArray toJson() const;
+    static bool fromJson(const QJsonArray &json, TextOperation *operation);
+
+private:
+    enum class Kind { Retain, Insert, Delete };
+
+    struct Component {
+        Kind kind;
+        int count;          // Retain and Delete
+        QString text;       // Insert
+    };
+
+    QVector<Component> m_components;
+    int m_baseLength = 0;
+    int m_targetLength = 0;
+};
+
+#endif // TEXTOPERATION_H
@@ -71,6 +71,10 @@ int main(int argc, char *argv[])
         "Open board file", "path");
     parser.addOption(fileOption);
     
+    QCommandLineOption trafficLogOption(QStringList() << "traffic-log",
+        "Append network traffic and latency stats to a JSON-lines file", "path");
+    parser.addOption(trafficLogOption);
+    
     parser.process(app);
 
     // Create main window
@@ -87,6 +91,10 @@ int main(int argc, char *argv[])
         window.loadBoard(parser.value(fileOption));
     }
     
+    if (parser.isSet(trafficLogOption)) {
+        window.setTrafficLog(parser.value(trafficLogOption));
+    }
+    
     window.show();
 
     return app.exec();
@@ -0,0 +1,209 @@
+#include "BlobCache.h"
+#include "BlobStore.h"
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QRegularExpression>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <algorithm>
+
+BlobCache::BlobCache(const QString &rootDir, qint64 capacityBytes)
+    : m_root(rootDir)
+    , m_capacity(capacityBytes)
+    , m_totalBytes(0)
+{
+    // One writer keeps the disk from seeking between files
+    m_writer.setMaxThreadCount(1);
+    
+    scan();
+    evict();
+}
+
+BlobCache::~BlobCache()
+{
+    m_writer.waitForDone();
+}
+
+QString BlobCache::defaultRoot()
+{
+    QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if (cacheDir.isEmpty()) return QString();
+    return QDir(cacheDir).filePath("blobs");
+}
+
+QString BlobCache::insert(const QByteArray &data)
+{
+    QString hash = BlobStore::hashOf(data);
+    insert(hash, data);
+    return hash;
+}
+
+bool BlobCache::insert(const QString &hash, const QByteArray &data)
+{
+    if (!isValidHash(hash) || data.isEmpty()) return false;
+    if (contains(hash)) {
+        touch(hash);
+        return true;
+    }
+    if (BlobStore::hashOf(data) != hash) return false;
+    
+    Entry entry;
+    entry.size = data.size();
+    entry.lastUsed = QDateTime::currentMSecsSinceEpoch();
+    m_entries.insert(hash, entry);
+    m_totalBytes += entry.size;
+    m_touched.insert(hash);
+    
+    {
+        QMutexLocker locker(&m_mutex);
+        m_pending.insert(hash, data);
+    }
+    
+    // Without a root everything stays in memory; if a write fails, at
+    // least this session still has the bytes
+    if (!m_root.isEmpty()) {
+        m_writer.start([this, hash, data]() {
+            if (!writeNow(hash, data)) return;
+            QMutexLocker locker(&m_mutex);
+            m_pending.remove(hash);
+        });
+    }
+    
+    evict();
+    return true;
+}
+
+QByteArray BlobCache::value(const QString &hash)
+{
+    if (!contains(hash)) return QByteArray();
+    touch(hash);
+    {
+        QMutexLocker locker(&m_mutex);
+        auto it = m_pending.constFind(hash);
+        if (it != m_pending.constEnd()) return it.value();
+    }
+    
+    QFile file(pathFor(hash));
+    if (!file.open(QIODevice::ReadOnly)) {
+        // Deleted behind our back (another instance evicting it)
+        m_totalBytes -= m_entries.take(hash).size;
+        return QByteArray();
+    }
+    return file.readAll();
+}
+
+QString BlobCache::filePath(const QString &hash)
+{
+    if (!contains(hash) || m_root.isEmpty()) return QString();
+    
+    QByteArray pending;
+    {
+        QMutexLocker locker(&m_mutex);
+        pending = m_pending.value(hash);
+    }
+    // The queued write may land a moment later; it writes the same bytes
+    if (!pending.isEmpty() && writeNow(hash, pending)) {
+        QMutexLocker locker(&m_mutex);
+        m_pending.remove(hash);
+    }
+    
+    touch(hash);
+    return pathFor(hash);
+}
+
+void BlobCache::setCapacity(qint64 bytes)
+{
+    m_capacity = bytes;
+    evict();
+}
+
+void BlobCache::scan()
+{
+    if (m_root.isEmpty()) return;
+    
+    QDirIterator it(m_root, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        QFileInfo info = it.fileInfo();
+        if (!isValidHash(info.fileName())) continue;
+        
+        Entry entry;
+        entry.size = info.size();
+        entry.lastUsed = info.lastModified().toMSecsSinceEpoch();
+        m_entries.insert(info.fileName(), entry);
+        m_totalBytes += entry.size;
+    }
+}
+
+void BlobCache::touch(const QString &hash)
+{
+    auto it = m_entries.find(hash);
+    if (it == m_entries.end()) return;
+    it->lastUsed = QDateTime::currentMSecsSinceEpoch();
+    
+    // Recency survives restarts as the file's mtime; once a session is enough
+    if (m_root.isEmpty() || m_touched.contains(hash)) return;
+    m_touched.insert(hash);
+    
+    QFile file(pathFor(hash));
+    if (file.open(QIODevice::ReadWrite)) {
+        file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+    }
+}
+
+void BlobCache::evict()
+{
+    if (m_root.isEmpty() || m_totalBytes <= m_capacity) return;
+    
+    QSet<QString> inUse = m_inUse ? m_inUse() : QSet<QString>();
+    {
+        QMutexLocker locker(&m_mutex);
+        for (auto it = m_pending.constBegin(); it != m_pending.constEnd(); ++it) {
+            inUse.insert(it.key());
+        }
+    }
+    
+    QList<QString> hashes = m_entries.keys();
+    std::sort(hashes.begin(), hashes.end(), [this](const QString &a, const QString &b) {
+        return m_entries.value(a).lastUsed < m_entries.value(b).lastUsed;
+    });
+    
+    // Down to a little under the cap, so the next insert doesn't evict again
+    qint64 target = m_capacity - m_capacity / 10;
+    for (const QString &hash : hashes) {
+        if (m_totalBytes <= target) break;
+        if (inUse.contains(hash)) continue;
+        
+        QFile::remove(pathFor(hash));
+        m_totalBytes -= m_entries.take(hash).size;
+        m_touched.remove(hash);
+    }
+}
+
+bool BlobCache::writeNow(const QString &hash, const QByteArray &data)
+{
+    QString path = pathFor(hash);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) return false;
+    
+    file.write(data);
+    return file.commit();
+}
+
+bool BlobCache::isValidHash(const QString &hash)
+{
+    // Hashes come from peers and become file names
+    static const QRegularExpression pattern("^[0-9a-f]{64}$");
+    return pattern.match(hash).hasMatch();
+}
+
+QString BlobCache::pathFor(const QString &hash) const
+{
+    return QString("%1/%2/%3").arg(m_root, hash.left(2), hash);
+}
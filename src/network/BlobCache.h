@@ -0,0 +1,76 @@
+#ifndef BLOBCACHE_H
+#define BLOBCACHE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+#include <QThreadPool>
+#include <functional>
+
+// The client's image bytes, kept across sessions in one file per blob
+// under <root>/ab/<hash>. Blobs are keyed by content hash like BlobStore,
+// so an image received again (a full sync, a reconnect, another board)
+// is neither stored nor written twice.
+//
+// Files are written atomically on a background thread and served from
+// memory until they land. Once the cache outgrows its capacity the least
+// recently used blobs are deleted, except those reported in use. Not
+// thread-safe apart from the writes it runs itself.
+class BlobCache
+{
+public:
+    explicit BlobCache(const QString &rootDir = defaultRoot(),
+                       qint64 capacityBytes = DEFAULT_CAPACITY);
+    ~BlobCache();
+
+    // <cache location>/blobs
+    static QString defaultRoot();
+
+    // Stores data under its own hash and returns the hash
+    QString insert(const QByteArray &data);
+    // Stores data received for an announced hash; rejects mismatches
+    bool insert(const QString &hash, const QByteArray &data);
+
+    bool contains(const QString &hash) const { return m_entries.contains(hash); }
+    QByteArray value(const QString &hash);
+    // The blob's file, for readers that want a path (animated GIFs);
+    // written out first if it's still pending. Empty if unknown.
+    QString filePath(const QString &hash);
+
+    // Hashes eviction must keep, asked for only when the cache is full
+    void setInUse(std::function<QSet<QString>()> inUse) { m_inUse = std::move(inUse); }
+    void setCapacity(qint64 bytes);
+
+    int count() const { return m_entries.size(); }
+    qint64 totalBytes() const { return m_totalBytes; }
+
+    static constexpr qint64 DEFAULT_CAPACITY = 1024LL * 1024 * 1024;
+
+private:
+    struct Entry {
+        qint64 size = 0;
+        qint64 lastUsed = 0;    // ms since epoch; file mtime across sessions
+    };
+
+    void scan();
+    void touch(const QString &hash);
+    void evict();
+    bool writeNow(const QString &hash, const QByteArray &data);
+    static bool isValidHash(const QString &hash);
+    QString pathFor(const QString &hash) const;
+
+    QString m_root;
+    qint64 m_capacity;
+    qint64 m_totalBytes;
+    QHash<QString, Entry> m_entries;
+    QSet<QString> m_touched;            // mtime already bumped this session
+    std::function<QSet<QString>()> m_inUse;
+
+    QThreadPool m_writer;
+    mutable QMutex m_mutex;
+    QHash<QString, QByteArray> m_pending;   // Not on disk (yet)
+};
+
+#endif // BLOBCACHE_H
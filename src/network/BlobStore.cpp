@@ -0,0 +1,45 @@
+#include "BlobStore.h"
+
+#include <QCryptographicHash>
+
+QString BlobStore::hashOf(const QByteArray &data)
+{
+    return QString::fromLatin1(
+        QCryptographicHash::hash(data, QCryptographicHash::Sha256).toHex());
+}
+
+QString BlobStore::insert(const QByteArray &data)
+{
+    QString hash = hashOf(data);
+    if (!m_blobs.contains(hash)) {
+        m_blobs.insert(hash, data);
+        m_totalBytes += data.size();
+    }
+    return hash;
+}
+
+bool BlobStore::insert(const QString &hash, const QByteArray &data)
+{
+    if (hash.isEmpty() || data.isEmpty()) return false;
+    if (m_blobs.contains(hash)) return true;
+    if (hashOf(data) != hash) return false;
+
+    m_blobs.insert(hash, data);
+    m_totalBytes += data.size();
+    return true;
+}
+
+void BlobStore::remove(const QString &hash)
+{
+    auto it = m_blobs.find(hash);
+    if (it != m_blobs.end()) {
+        m_totalBytes -= it.value().size();
+        m_blobs.erase(it);
+    }
+}
+
+void BlobStore::clear()
+{
+    m_blobs.clear();
+    m_totalBytes = 0;
+}
@@ -0,0 +1,36 @@
+#ifndef BLOBSTORE_H
+#define BLOBSTORE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+
+// Content-addressed storage for encoded image bytes. Blobs are keyed by
+// the hex SHA-256 of their contents, so identical images are stored and
+// transferred once no matter how many board items reference them.
+class BlobStore
+{
+public:
+    BlobStore() = default;
+
+    static QString hashOf(const QByteArray &data);
+
+    // Stores data under its own hash and returns the hash
+    QString insert(const QByteArray &data);
+    // Stores data received for an announced hash; rejects mismatches
+    bool insert(const QString &hash, const QByteArray &data);
+
+    bool contains(const QString &hash) const { return m_blobs.contains(hash); }
+    QByteArray value(const QString &hash) const { return m_blobs.value(hash); }
+    void remove(const QString &hash);
+    void clear();
+
+    int count() const { return m_blobs.size(); }
+    qint64 totalBytes() const { return m_totalBytes; }
+
+private:
+    QHash<QString, QByteArray> m_blobs;
+    qint64 m_totalBytes = 0;
+};
+
+#endif // BLOBSTORE_H
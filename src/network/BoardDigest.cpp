@@ -0,0 +1,61 @@
+#include "BoardDigest.h"
+#include <QCryptographicHash>
+
+BoardDigest::BoardDigest()
+    : m_buckets(BUCKET_COUNT)
+{
+}
+
+void BoardDigest::addImage(const QString &imageId, const QString &blobHash,
+                           const LamportStamp &stamp)
+{
+    add(imageId, "image\n" + blobHash.toUtf8(), stamp);
+}
+
+void BoardDigest::addText(const QString &textId, const QString &text, const LamportStamp &stamp)
+{
+    add(textId, "text\n" + text.toUtf8(), stamp);
+}
+
+void BoardDigest::add(const QString &itemId, const QByteArray &content, const LamportStamp &stamp)
+{
+    QCryptographicHash leaf(QCryptographicHash::Sha256);
+    leaf.addData(QByteArray::number(stamp.counter) + ':' + stamp.replica.toUtf8() + '\n');
+    leaf.addData(content);
+    m_buckets[bucketOf(itemId)].insert(itemId, leaf.result());
+}
+
+QString BoardDigest::root() const
+{
+    return QString::fromLatin1(QCryptographicHash::hash(
+        bucketHashes().join(',').toLatin1(), QCryptographicHash::Sha256).toHex());
+}
+
+QStringList BoardDigest::bucketHashes() const
+{
+    QStringList hashes;
+    hashes.reserve(BUCKET_COUNT);
+    
+    for (const QMap<QString, QByteArray> &bucket : m_buckets) {
+        if (bucket.isEmpty()) {
+            hashes.append(QString());
+            continue;
+        }
+        
+        // QMap iterates by id, so both sides hash in the same order
+        QCryptographicHash hash(QCryptographicHash::Sha256);
+        for (auto it = bucket.constBegin(); it != bucket.constEnd(); ++it) {
+            hash.addData(it.key().toUtf8());
+            hash.addData(QByteArray(1, '\0'));
+            hash.addData(it.value());
+        }
+        hashes.append(QString::fromLatin1(hash.result().toHex().left(BUCKET_HASH_CHARS)));
+    }
+    return hashes;
+}
+
+int BoardDigest::bucketOf(const QString &itemId)
+{
+    return static_cast<uchar>(QCryptographicHash::hash(
+        itemId.toUtf8(), QCryptographicHash::Sha256).at(0));
+}
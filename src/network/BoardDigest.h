@@ -0,0 +1,43 @@
+#ifndef BOARDDIGEST_H
+#define BOARDDIGEST_H
+
+#include <QByteArray>
+#include <QMap>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "data/LwwTable.h"
+
+// Two-level hash tree over a board, used to find what differs between a
+// client and the server without sending the board. Items are spread over
+// a fixed number of buckets by id; each bucket hashes its items' digests
+// (content and stamp) and the root hashes the buckets. Both sides build it the same
+// way, so equal roots mean nothing to exchange and unequal ones point at
+// the buckets to compare item by item.
+class BoardDigest
+{
+public:
+    BoardDigest();
+
+    // Images by blob, texts by their text, both with the newest stamp
+    // among their registers so moves and other edits tell too
+    void addImage(const QString &imageId, const QString &blobHash, const LamportStamp &stamp);
+    void addText(const QString &textId, const QString &text, const LamportStamp &stamp);
+
+    QString root() const;
+    // Short hex per bucket, empty for empty buckets
+    QStringList bucketHashes() const;
+
+    static int bucketOf(const QString &itemId);
+
+    static constexpr int BUCKET_COUNT = 256;
+
+private:
+    void add(const QString &itemId, const QByteArray &content, const LamportStamp &stamp);
+    
+    QVector<QMap<QString, QByteArray>> m_buckets;   // itemId -> leaf digest
+    
+    static constexpr int BUCKET_HASH_CHARS = 16;
+};
+
+#endif // BOARDDIGEST_H
@@ -0,0 +1,113 @@
+#include "ClientConnection.h"
+#include "TrafficStats.h"
+
+#include <QTimer>
+
+ClientConnection::ClientConnection(QWebSocket *socket, const QString &clientId, QObject *parent)
+    : QObject(parent)
+    , m_socket(socket)
+    , m_clientId(clientId)
+    , m_binaryFrames(false)
+    , m_overflowed(false)
+    , m_traffic(nullptr)
+    , m_queuedBytes(0)
+    , m_inFlight(0)
+{
+    m_socket->setParent(this);
+    
+    connect(m_socket, &QWebSocket::bytesWritten,
+            this, &ClientConnection::onBytesWritten);
+}
+
+void ClientConnection::enqueue(const QByteArray &frame, bool binary, const QString &type,
+                               const QString &supersedeKey)
+{
+    if (m_overflowed) return;
+    append({frame, binary ? QString() : QString::fromUtf8(frame), binary, type, supersedeKey});
+}
+
+void ClientConnection::enqueue(const QByteArray &frame, const QString &text, const QString &type,
+                               const QString &supersedeKey)
+{
+    if (m_overflowed) return;
+    append({frame, text, false, type, supersedeKey});
+}
+
+void ClientConnection::append(Pending pending)
+{
+    if (!pending.supersedeKey.isEmpty()) {
+        // Drop the stale copy; the fresh one goes to the back so it can't
+        // overtake anything that was queued after the stale one
+        for (int i = 0; i < m_queue.size(); ++i) {
+            if (m_queue[i].supersedeKey == pending.supersedeKey) {
+                m_queuedBytes -= m_queue[i].frame.size();
+                m_queue.removeAt(i);
+                break;
+            }
+        }
+    }
+    
+    // A single oversized frame (a big blob) is allowed through an empty queue
+    if (m_queuedBytes > 0 && m_queuedBytes + pending.frame.size() > MAX_QUEUED_BYTES) {
+        m_queue.clear();
+        m_queuedBytes = 0;
+        m_overflowed = true;
+        reportQueue();
+        
+        // Abort outside the caller's fan-out loop; it will catch up on rejoin
+        QWebSocket *socket = m_socket;
+        QTimer::singleShot(0, socket, [socket]() { socket->abort(); });
+        return;
+    }
+    
+    m_queuedBytes += pending.frame.size();
+    m_queue.append(std::move(pending));
+    pump();
+}
+
+void ClientConnection::onBytesWritten(qint64 bytes)
+{
+    m_inFlight = qMax<qint64>(0, m_inFlight - bytes);
+    pump();
+    
+    if (m_inFlight == 0 && m_queue.isEmpty()) {
+        emit flushed();
+    }
+}
+
+void ClientConnection::pump()
+{
+    bool sentAny = false;
+    while (!m_queue.isEmpty() && m_inFlight < MAX_IN_FLIGHT) {
+        if (m_socket->state() != QAbstractSocket::ConnectedState) {
+            m_queue.clear();
+            m_queuedBytes = 0;
+            return;
+        }
+        
+        Pending next = m_queue.takeFirst();
+        m_queuedBytes -= next.frame.size();
+        
+        qint64 sent = next.binary
+            ? m_socket->sendBinaryMessage(next.frame)
+            : m_socket->sendTextMessage(next.text);
+        m_inFlight += qMax<qint64>(sent, 0);
+        sentAny = true;
+        
+        if (m_traffic) {
+            m_traffic->record(TrafficStats::Outbound, next.type, m_clientId, next.frame.size());
+        }
+    }
+    
+    reportQueue();
+    if (sentAny && m_queue.isEmpty()) {
+        emit queueDrained();
+    }
+}
+
+void ClientConnection::reportQueue()
+{
+    if (m_traffic) {
+        m_traffic->setQueue(m_clientId, m_queue.size(), m_queuedBytes, m_inFlight);
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef CLIENTCONNECTION_H
+#define CLIENTCONNECTION_H
+
+#include <QObject>
+#include <QWebSocket>
+#include <QByteArray>
+#include <QList>
+
+class TrafficStats;
+
+// Server-side view of one connected client; owns its socket so the two
+// can be moved between server threads together. Outbound frames go through a
+// bounded queue that only feeds the socket as fast as it drains, so a slow
+// client can't grow QWebSocket's internal buffer without limit. Frames are
+// shared with every other recipient (QByteArray and QString are implicitly
+// shared).
+class ClientConnection : public QObject
+{
+    Q_OBJECT
+
+public:
+    ClientConnection(QWebSocket *socket, const QString &clientId, QObject *parent = nullptr);
+
+    QWebSocket *socket() const { return m_socket; }
+    QString clientId() const { return m_clientId; }
+    
+    // Clients that announce "binary" on join get every message as a binary frame
+    bool binaryFrames() const { return m_binaryFrames; }
+    void setBinaryFrames(bool enabled) { m_binaryFrames = enabled; }
+    
+    // Identifies the client's presence datagrams; empty without UDP
+    QString udpToken() const { return m_udpToken; }
+    void setUdpToken(const QString &token) { m_udpToken = token; }
+    
+    // Counts what actually goes out and reports the queue after each change
+    void setTraffic(TrafficStats *traffic) { m_traffic = traffic; }
+    
+    // Queues an encoded frame (UTF-8 JSON when !binary) of the given message
+    // type. A queued frame with the same non-empty supersede key is dropped
+    // in favour of this one.
+    void enqueue(const QByteArray &frame, bool binary, const QString &type,
+                 const QString &supersedeKey = QString());
+    // Same for a text frame already decoded for QWebSocket, which sends text
+    // as a QString: recipients of one message share a single conversion
+    void enqueue(const QByteArray &frame, const QString &text, const QString &type,
+                 const QString &supersedeKey = QString());
+    
+    int queuedFrames() const { return m_queue.size(); }
+    qint64 queuedBytes() const { return m_queuedBytes; }
+
+signals:
+    // Everything queued has been handed to the socket; a good moment to
+    // queue more bulk data
+    void queueDrained();
+    // ...and the socket has written it all out
+    void flushed();
+
+private slots:
+    void onBytesWritten(qint64 bytes);
+
+private:
+    struct Pending {
+        QByteArray frame;
+        QString text;       // Sent instead of frame for text frames
+        bool binary;
+        QString type;
+        QString supersedeKey;
+    };
+    
+    void append(Pending pending);
+    void pump();
+    void reportQueue();
+    
+    QWebSocket *m_socket;
+    QString m_clientId;
+    bool m_binaryFrames;
+    QString m_udpToken;
+    bool m_overflowed;
+    TrafficStats *m_traffic;
+    
+    QList<Pending> m_queue;
+    qint64 m_queuedBytes;
+    qint64 m_inFlight;      // Handed to the socket but not yet written out
+    
+    static constexpr qint64 MAX_IN_FLIGHT = 256 * 1024;
+    static constexpr qint64 MAX_QUEUED_BYTES = 64 * 1024 * 1024;
+};
+
+#endif // CLIENTCONNECTION_H
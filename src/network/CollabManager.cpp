@@ -3,17 +3,17 @@
 #include "data/Board.h"
 #include "canvas/CanvasScene.h"
 #include "canvas/ImageItem.h"
+#include "canvas/ImageDecoder.h"
 #include "canvas/TextItem.h"
+#include "TransferPriority.h"
+#include "BoardDigest.h"
 
 #include <QJsonObject>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QBuffer>
 #include <QRandomGenerator>
-#include <QFile>
-#include <QDir>
-#include <QStandardPaths>
-#include <QUuid>
+#include <algorithm>
 
 CollabManager::CollabManager(QObject *parent)
     : QObject(parent)
@@ -21,25 +21,52 @@ CollabManager::CollabManager(QObject *parent)
     , m_board(nullptr)
     , m_scene(nullptr)
     , m_localUserName("User")
+    , m_decoder(new ImageDecoder(this))
+    , m_viewportZoom(1.0)
     , m_cursorThrottle(new QTimer(this))
     , m_hasPendingCursor(false)
+    , m_transformTimer(new QTimer(this))
     , m_isSyncing(false)
-    , m_syncTimer(new QTimer(this))
+    , m_pushPending(false)
 {
     m_localColor = generateUserColor();
+    m_clock.setReplica(m_client->oderId());
+    
+    // Eviction must leave what the board shows and what we wait on
+    m_blobs.setInUse([this]() {
+        QSet<QString> hashes;
+        for (const ImageBlob &blob : m_imageBlobs) {
+            hashes.insert(blob.hash);
+            hashes.insert(blob.previewHash);
+        }
+        for (const QJsonObject &meta : m_pendingImages) {
+            hashes.insert(meta["previewHash"].toString());
+            const QJsonObject mips = meta["mips"].toObject();
+            for (auto it = mips.begin(); it != mips.end(); ++it) {
+                hashes.insert(it.value().toString());
+            }
+        }
+        return hashes;
+    });
     
     connect(m_client, &SyncClient::connected, this, &CollabManager::onConnected);
     connect(m_client, &SyncClient::disconnected, this, &CollabManager::onDisconnected);
+    connect(m_client, &SyncClient::synchronized, this, &CollabManager::onSynchronized);
     connect(m_client, &SyncClient::messageReceived, this, &CollabManager::onMessageReceived);
+    connect(m_client, &SyncClient::binaryMessageReceived,
+            this, &CollabManager::onBinaryMessageReceived);
     connect(m_client, &SyncClient::errorOccurred, this, &CollabManager::errorOccurred);
+    connect(m_client, &SyncClient::latencyUpdated, this, &CollabManager::latencyUpdated);
+    connect(m_decoder, &ImageDecoder::decoded, this, &CollabManager::onImageDecoded);
+    connect(m_decoder, &ImageDecoder::failed, this, &CollabManager::onImageDecodeFailed);
     
     m_cursorThrottle->setInterval(CURSOR_THROTTLE_MS);
     m_cursorThrottle->setSingleShot(true);
     connect(m_cursorThrottle, &QTimer::timeout, this, &CollabManager::sendCursorUpdate);
     
-    // Periodic sync timer - every 5 seconds while connected
-    m_syncTimer->setInterval(5000);
-    connect(m_syncTimer, &QTimer::timeout, this, &CollabManager::requestFullSync);
+    m_transformTimer->setSingleShot(true);
+    setTransformRate(TRANSFORM_RATE_HZ);
+    connect(m_transformTimer, &QTimer::timeout, this, &CollabManager::flushTransforms);
 }
 
 CollabManager::~CollabManager()
@@ -61,6 +88,8 @@ void CollabManager::setScene(CanvasScene *scene)
     if (m_scene) {
         QObject::disconnect(m_scene, nullptr, this, nullptr);
     }
+    // Their placeholders belong to the old scene
+    m_decoder->cancelAll();
     
     m_scene = scene;
     
@@ -79,34 +108,22 @@ void CollabManager::setScene(CanvasScene *scene)
                 this, &CollabManager::onTextChanged);
         connect(m_scene, &CanvasScene::textRemoved,
                 this, &CollabManager::onTextRemoved);
+        connect(m_scene, &CanvasScene::textEdited,
+                this, &CollabManager::onTextEdited);
+        connect(m_scene, &CanvasScene::interactionFinished,
+                this, &CollabManager::onInteractionFinished);
     }
 }
 
 void CollabManager::connectToServer(const QString &url, const QString &roomId)
 {
+    // The client joins (and rejoins after reconnects) once connected
+    m_client->joinRoom(roomId, m_localUserName);
     m_client->connectToServer(url);
-    
-    // Join room after connection established
-    QMetaObject::Connection *conn = new QMetaObject::Connection;
-    *conn = connect(m_client, &SyncClient::connected, this, [this, roomId, conn]() {
-        m_client->joinRoom(roomId, m_localUserName);
-        
-        // Push our local state to sync with server
-        // Use a longer delay to ensure we've received server state first
-        QTimer::singleShot(500, this, &CollabManager::pushLocalState);
-        
-        // Request full sync again after push to catch any updates from others
-        QTimer::singleShot(1500, this, &CollabManager::requestFullSync);
-        
-        QObject::disconnect(*conn);
-        delete conn;
-    });
 }
 
 void CollabManager::disconnect()
 {
-    m_syncTimer->stop();
-    
     // Remove all remote cursors
     for (const QString &oderId : m_collaborators.keys()) {
         if (m_scene) {
@@ -123,11 +140,26 @@ bool CollabManager::isConnected() const
     return m_client->isConnected();
 }
 
+bool CollabManager::isReconnecting() const
+{
+    return m_client->isReconnecting();
+}
+
 QString CollabManager::roomId() const
 {
     return m_client->roomId();
 }
 
+const LatencyStats &CollabManager::latency() const
+{
+    return m_client->latency();
+}
+
+const TrafficStats &CollabManager::traffic() const
+{
+    return m_client->traffic();
+}
+
 int CollabManager::userCount() const
 {
     return m_collaborators.size() + 1; // Include self
@@ -135,21 +167,51 @@ int CollabManager::userCount() const
 
 void CollabManager::onConnected()
 {
-    m_syncTimer->start();
+    m_pushPending = true;
     emit connectionStatusChanged(true);
 }
 
 void CollabManager::onDisconnected()
 {
-    m_syncTimer->stop();
+    m_pushPending = false;
+    m_requestedBlobs.clear();
     emit connectionStatusChanged(false);
 }
 
+void CollabManager::onSynchronized()
+{
+    // Merge anything we made offline now that we hold the server's state
+    if (m_pushPending) {
+        m_pushPending = false;
+        reconcile();
+    }
+    
+    // Text edits that never got their ack go out again; the catch-up
+    // already acked the ones that made it before the connection dropped
+    for (auto it = m_textSync.constBegin(); it != m_textSync.constEnd(); ++it) {
+        if (!it.value().unacked.isEmpty()) {
+            sendTextEdit(it.key());
+        }
+    }
+}
+
 void CollabManager::onMessageReceived(const QJsonObject &message)
 {
     QString type = message["type"].toString();
     
-    if (type == "join") {
+    // Our next edit must order after everything we've seen
+    if (message.contains("stamp")) {
+        m_clock.observe(LamportStamp::fromJson(message["stamp"]));
+    }
+    
+    if (type == "welcome") {
+        // Servers without sequencing may not send a snapshot to wait for
+        if (!m_client->serverSupports("seq")) {
+            onSynchronized();
+        }
+        // Before the snapshot, so its blobs are sent in viewport order
+        sendViewport();
+    } else if (type == "join") {
         handleJoin(message);
     } else if (type == "leave") {
         handleLeave(message);
@@ -169,10 +231,41 @@ void CollabManager::onMessageReceived(const QJsonObject &message)
         handleTextUpdate(message);
     } else if (type == "textRemove") {
         handleTextRemove(message);
+    } else if (type == "textEdit") {
+        handleTextEdit(message);
+    } else if (type == "textAck") {
+        handleTextAck(message);
+    } else if (type == "textResync") {
+        handleTextResync(message);
     } else if (type == "sync") {
         handleSync(message);
     } else if (type == "fullSync") {
         handleFullSync(message);
+    } else if (type == "blobRequest") {
+        handleBlobRequest(message);
+    } else if (type == "reconcileDiff") {
+        handleReconcileDiff(message);
+    } else if (type == "imageMips") {
+        handleImageMips(message);
+    }
+}
+
+void CollabManager::onBinaryMessageReceived(const QJsonObject &header, const QByteArray &payload)
+{
+    QString type = header["type"].toString();
+    
+    if (header.contains("stamp")) {
+        m_clock.observe(LamportStamp::fromJson(header["stamp"]));
+    }
+    
+    if (type == "blobData") {
+        handleBlobData(header, payload);
+    } else if (type == "imageAdd") {
+        handleImageAdd(header, payload);
+    } else if (type == "fullSync") {
+        handleFullSync(header, payload);
+    } else {
+        onMessageReceived(header);
     }
 }
 
@@ -196,13 +289,34 @@ void CollabManager::onImageAdded(ImageItem *item)
 
 void CollabManager::onImageChanged(ImageItem *item)
 {
-    if (!m_isSyncing && isConnected()) {
+    if (m_isSyncing) return;
+    
+    // Offline nothing goes out, but the edit is stamped so the reconcile
+    // after the reconnect finds it and it wins over older ones
+    if (!isConnected()) {
         sendImageUpdate(item);
+        return;
+    }
+    
+    // Mid-drag: keep only the latest transform until the next tick
+    if (m_scene && m_scene->mouseGrabberItem()) {
+        m_dirtyImages.insert(item->id());
+        m_liveImages.insert(item->id());
+        if (!m_transformTimer->isActive()) {
+            m_transformTimer->start();
+        }
+        return;
     }
+    
+    m_dirtyImages.remove(item->id());
+    sendImageUpdate(item);
 }
 
 void CollabManager::onImageRemoved(const QString &id)
 {
+    m_imageBlobs.remove(id);
+    m_decoder->cancel(id);
+    
     if (!m_isSyncing && isConnected()) {
         sendImageRemove(id);
     }
@@ -217,8 +331,43 @@ void CollabManager::onTextAdded(TextItem *item)
 
 void CollabManager::onTextChanged(TextItem *item)
 {
-    if (!m_isSyncing && isConnected()) {
+    if (m_isSyncing) return;
+    
+    if (!isConnected()) {
         sendTextUpdate(item);
+        return;
+    }
+    
+    if (m_scene && m_scene->mouseGrabberItem()) {
+        m_dirtyTexts.insert(item->id());
+        m_liveTexts.insert(item->id());
+        if (!m_transformTimer->isActive()) {
+            m_transformTimer->start();
+        }
+        return;
+    }
+    
+    m_dirtyTexts.remove(item->id());
+    sendTextUpdate(item);
+}
+
+void CollabManager::onTextEdited(TextItem *item, int position, int removed,
+                                 const QString &inserted)
+{
+    if (m_isSyncing || !isConnected() || !m_client->serverSupports("textEdit")) return;
+    
+    int length = item->text().size() - inserted.size() + removed;
+    TextOperation edit = TextOperation::fromSplice(length, position, removed, inserted);
+    
+    // One edit in flight, everything typed meanwhile folded into a second
+    TextSync &sync = m_textSync[item->id()];
+    if (sync.unacked.size() < 2) {
+        sync.unacked.append(edit);
+        if (sync.unacked.size() == 1) {
+            sendTextEdit(item->id());
+        }
+    } else if (!TextOperation::compose(sync.unacked.last(), edit, &sync.unacked.last())) {
+        requestFullSync();
     }
 }
 
@@ -229,6 +378,56 @@ void CollabManager::onTextRemoved(const QString &id)
     }
 }
 
+void CollabManager::onInteractionFinished()
+{
+    m_transformTimer->stop();
+    m_dirtyImages.clear();
+    m_dirtyTexts.clear();
+    
+    if (!m_scene || !isConnected()) {
+        m_liveImages.clear();
+        m_liveTexts.clear();
+        return;
+    }
+    
+    // Whatever the last tick sent, the released state is the one that counts
+    for (const QString &id : m_liveImages) {
+        if (ImageItem *item = m_scene->findImageItem(id)) {
+            sendImageUpdate(item);
+        }
+    }
+    for (const QString &id : m_liveTexts) {
+        if (TextItem *item = m_scene->findTextItem(id)) {
+            sendTextUpdate(item);
+        }
+    }
+    m_liveImages.clear();
+    m_liveTexts.clear();
+}
+
+void CollabManager::flushTransforms()
+{
+    if (!m_scene || !isConnected()) return;
+    
+    for (const QString &id : m_dirtyImages) {
+        if (ImageItem *item = m_scene->findImageItem(id)) {
+            sendImageUpdate(item, true);
+        }
+    }
+    for (const QString &id : m_dirtyTexts) {
+        if (TextItem *item = m_scene->findTextItem(id)) {
+            sendTextUpdate(item, true);
+        }
+    }
+    m_dirtyImages.clear();
+    m_dirtyTexts.clear();
+}
+
+void CollabManager::setTransformRate(int hz)
+{
+    m_transformTimer->setInterval(1000 / qBound(1, hz, 1000));
+}
+
 void CollabManager::sendCursorUpdate()
 {
     if (m_hasPendingCursor && isConnected()) {
@@ -239,7 +438,7 @@ void CollabManager::sendCursorUpdate()
         message["y"] = m_pendingCursorPos.y();
         message["color"] = m_localColor.name();
         
-        m_client->sendMessage(message);
+        m_client->sendPresence(message);
         m_hasPendingCursor = false;
     }
 }
@@ -247,13 +446,6 @@ void CollabManager::sendCursorUpdate()
 void CollabManager::handleJoin(const QJsonObject &message)
 {
     QString oderId = message["oderId"].toString();
-    
-    if (oderId == m_client->oderId()) {
-        // It's us joining - push our local state and get merged sync back
-        pushLocalState();
-        return;
-    }
-    
     QString userName = message["userName"].toString();
     
     Collaborator collab;
@@ -326,7 +518,7 @@ void CollabManager::handleCursor(const QJsonObject &message)
     }
 }
 
-void CollabManager::handleImageAdd(const QJsonObject &message)
+void CollabManager::handleImageAdd(const QJsonObject &message, const QByteArray &payload)
 {
     QString senderId = message["oderId"].toString();
     if (senderId == m_client->oderId()) return;
@@ -334,43 +526,37 @@ void CollabManager::handleImageAdd(const QJsonObject &message)
     QString imageId = message["imageId"].toString();
     
     // Check if we already have this image
-    if (m_scene && m_scene->findImageItem(imageId)) return;
+    if (!m_scene || m_scene->findImageItem(imageId)) return;
+    
+    // Removed here later than it was added
+    LamportStamp stamp = LamportStamp::fromJson(message["stamp"]);
+    if (m_lww.isRemoved(imageId, stamp)) return;
+    m_lww.merge(imageId, message, stamp);
+    noteSynced(imageId, message);
+    
+    // Hash-only announce: use the local blob or fetch it
+    if (message.contains("blobHash")) {
+        BlobFetch fetch;
+        m_isSyncing = true;
+        placeImage(message, &fetch);
+        m_isSyncing = false;
+        requestBlobs(fetch);
+        return;
+    }
     
-    // Decode image data
-    QByteArray imageData = QByteArray::fromBase64(message["imageData"].toString().toUtf8());
+    // Binary frames carry raw bytes, legacy text frames carry base64
+    QByteArray imageData = payload;
+    if (imageData.isEmpty()) {
+        imageData = QByteArray::fromBase64(message["imageData"].toString().toUtf8());
+    }
     
     QPointF pos(message["x"].toDouble(), message["y"].toDouble());
     qreal rotation = message["rotation"].toDouble();
     qreal scale = message["scale"].toDouble(1.0);
-    
-    m_isSyncing = true;
-    
-    // Check if this is a GIF
     bool isGif = message["isGif"].toBool(false);
     
-    if (isGif && m_scene) {
-        // Save GIF to temp file to enable animation
-        QString tempDir = QStandardPaths::writableLocation(QStandardPaths::TempLocation);
-        QString tempPath = tempDir + "/collabref_" + QUuid::createUuid().toString(QUuid::WithoutBraces) + ".gif";
-        
-        QFile tempFile(tempPath);
-        if (tempFile.open(QIODevice::WriteOnly)) {
-            tempFile.write(imageData);
-            tempFile.close();
-            
-            // Create ImageItem with file path to enable animation
-            m_scene->addImageItemFromFile(imageId, tempPath, pos, rotation, scale);
-        }
-    } else if (m_scene) {
-        // Regular image
-        QImage image;
-        image.loadFromData(imageData);
-        
-        if (!image.isNull()) {
-            m_scene->addImageItem(imageId, image, pos, rotation, scale);
-        }
-    }
-    
+    m_isSyncing = true;
+    addImageFromData(imageId, imageData, isGif, pos, rotation, scale);
     m_isSyncing = false;
 }
 
@@ -384,24 +570,51 @@ void CollabManager::handleImageUpdate(const QJsonObject &message)
     if (!m_scene) return;
     
     ImageItem *item = m_scene->findImageItem(imageId);
-    if (!item) return;
+    if (!item && !m_pendingImages.contains(imageId)) return;
+    
+    // Keep only the properties this edit wins; live drags aren't stamped
+    // and are overtaken by the final update anyway
+    QJsonObject fields = message;
+    if (!message["live"].toBool()) {
+        bool changed = false;
+        fields = m_lww.merge(imageId, message, LamportStamp::fromJson(message["stamp"]),
+                             &changed);
+        if (!changed) return;
+        noteSynced(imageId, fields);
+    }
     
-    m_isSyncing = true;
+    // Still waiting for the bytes: fold the update into the announce, and
+    // apply it to the preview if one is showing
+    if (m_pendingImages.contains(imageId)) {
+        QJsonObject &pending = m_pendingImages[imageId];
+        for (const QString &key : {"x", "y", "rotation", "scale", "zIndex"}) {
+            if (fields.contains(key)) {
+                pending[key] = fields[key];
+            }
+        }
+    }
     
-    if (message.contains("x") && message.contains("y")) {
-        item->setPos(QPointF(message["x"].toDouble(), message["y"].toDouble()));
+    if (item) {
+        m_isSyncing = true;
+        applyImageFields(item, fields);
+        m_isSyncing = false;
     }
-    if (message.contains("rotation")) {
-        item->setRotation(message["rotation"].toDouble());
+}
+
+void CollabManager::applyImageFields(ImageItem *item, const QJsonObject &fields)
+{
+    if (fields.contains("x") && fields.contains("y")) {
+        item->setPos(QPointF(fields["x"].toDouble(), fields["y"].toDouble()));
     }
-    if (message.contains("scale")) {
-        item->setScale(message["scale"].toDouble());
+    if (fields.contains("rotation")) {
+        item->setRotation(fields["rotation"].toDouble());
     }
-    if (message.contains("zIndex")) {
-        item->setZValue(message["zIndex"].toDouble());
+    if (fields.contains("scale")) {
+        item->setScale(fields["scale"].toDouble());
+    }
+    if (fields.contains("zIndex")) {
+        item->setZValue(fields["zIndex"].toDouble());
     }
-    
-    m_isSyncing = false;
 }
 
 void CollabManager::handleImageRemove(const QJsonObject &message)
@@ -410,6 +623,10 @@ void CollabManager::handleImageRemove(const QJsonObject &message)
     if (senderId == m_client->oderId()) return;
     
     QString imageId = message["imageId"].toString();
+    // A newer removal already took it
+    if (!m_lww.remove(imageId, LamportStamp::fromJson(message["stamp"]))) return;
+    m_syncedFields.remove(imageId);
+    m_pendingImages.remove(imageId);
     
     m_isSyncing = true;
     if (m_scene) {
@@ -424,7 +641,7 @@ void CollabManager::handleSync(const QJsonObject &message)
     handleImageUpdate(message);
 }
 
-void CollabManager::handleFullSync(const QJsonObject &message)
+void CollabManager::handleFullSync(const QJsonObject &message, const QByteArray &payload)
 {
     if (!m_scene) return;
     
@@ -433,8 +650,24 @@ void CollabManager::handleFullSync(const QJsonObject &message)
     int addedImages = 0;
     int addedTexts = 0;
     
+    // Removals we missed win over our copies
+    QJsonObject tombstones = message["tombstones"].toObject();
+    for (auto it = tombstones.constBegin(); it != tombstones.constEnd(); ++it) {
+        if (!m_lww.remove(it.key(), LamportStamp::fromJson(it.value()))) continue;
+        m_syncedFields.remove(it.key());
+        m_textSync.remove(it.key());
+        m_pendingImages.remove(it.key());
+        m_scene->removeImageItem(it.key());
+        m_scene->removeTextItem(it.key());
+    }
+    
+    // Register stamps per item; items we already have take whatever
+    // properties are newer on the server's side
+    QJsonObject stamps = message["stamps"].toObject();
+    
     // Sync images
     QJsonArray images = message["images"].toArray();
+    BlobFetch fetch;
     
     for (const QJsonValue &value : images) {
         QJsonObject imgObj = value.toObject();
@@ -442,42 +675,43 @@ void CollabManager::handleFullSync(const QJsonObject &message)
         QString imageId = imgObj["imageId"].toString();
         if (imageId.isEmpty()) continue;
         
-        // Skip if we already have this image
-        if (m_scene->findImageItem(imageId)) continue;
+        if (ImageItem *item = m_scene->findImageItem(imageId)) {
+            if (stamps.contains(imageId)) {
+                QJsonObject fields = m_lww.mergeSnapshot(imageId, imgObj,
+                                                         stamps[imageId].toObject());
+                noteSynced(imageId, fields);
+                applyImageFields(item, fields);
+            }
+            addMips(imageId, imgObj["mips"].toObject(), &fetch);
+            continue;
+        }
         
-        QString imageDataStr = imgObj["imageData"].toString();
-        if (imageDataStr.isEmpty()) continue;
+        m_lww.loadStamps(imageId, stamps[imageId].toObject());
+        noteSynced(imageId, imgObj);
         
-        QByteArray imageData = QByteArray::fromBase64(imageDataStr.toUtf8());
+        if (imgObj.contains("blobHash")) {
+            if (placeImage(imgObj, &fetch)) {
+                addedImages++;
+            }
+            continue;
+        }
+        
+        // Binary syncs point into the payload, legacy syncs embed base64
+        QByteArray imageData;
+        if (imgObj.contains("dataOffset")) {
+            imageData = payload.mid(imgObj["dataOffset"].toInt(), imgObj["dataSize"].toInt());
+        } else {
+            imageData = QByteArray::fromBase64(imgObj["imageData"].toString().toUtf8());
+        }
         if (imageData.isEmpty()) continue;
         
         QPointF pos(imgObj["x"].toDouble(), imgObj["y"].toDouble());
         qreal rotation = imgObj["rotation"].toDouble();
         qreal scale = imgObj["scale"].toDouble(1.0);
-        
-        // Check if this is a GIF
         bool isGif = imgObj["isGif"].toBool(false);
         
-        if (isGif) {
-            // Save GIF to temp file to enable animation
-            QString tempDir = QStandardPaths::writableLocation(QStandardPaths::TempLocation);
-            QString tempPath = tempDir + "/collabref_" + QUuid::createUuid().toString(QUuid::WithoutBraces) + ".gif";
-            
-            QFile tempFile(tempPath);
-            if (tempFile.open(QIODevice::WriteOnly)) {
-                tempFile.write(imageData);
-                tempFile.close();
-                m_scene->addImageItemFromFile(imageId, tempPath, pos, rotation, scale);
-                addedImages++;
-            }
-        } else {
-            QImage image;
-            image.loadFromData(imageData);
-            
-            if (!image.isNull()) {
-                m_scene->addImageItem(imageId, image, pos, rotation, scale);
-                addedImages++;
-            }
+        if (addImageFromData(imageId, imageData, isGif, pos, rotation, scale)) {
+            addedImages++;
         }
     }
     
@@ -490,8 +724,26 @@ void CollabManager::handleFullSync(const QJsonObject &message)
         QString textId = txtObj["textId"].toString();
         if (textId.isEmpty()) continue;
         
-        // Skip if we already have this text
-        if (m_scene->findTextItem(textId)) continue;
+        if (TextItem *item = m_scene->findTextItem(textId)) {
+            // Edited character-wise: the server's text and revision are
+            // the base from here on, whatever we had in flight
+            if (m_client->serverSupports("textEdit")) {
+                resetText(item, txtObj["text"].toString(),
+                          txtObj["rev"].toVariant().toLongLong());
+                txtObj.remove("text");
+            }
+            if (stamps.contains(textId)) {
+                QJsonObject fields = m_lww.mergeSnapshot(textId, txtObj,
+                                                         stamps[textId].toObject());
+                noteSynced(textId, fields);
+                applyTextFields(item, fields);
+            }
+            continue;
+        }
+        
+        m_lww.loadStamps(textId, stamps[textId].toObject());
+        noteSynced(textId, txtObj);
+        m_textSync.insert(textId, TextSync{txtObj["rev"].toVariant().toLongLong(), {}});
         
         QString text = txtObj["text"].toString();
         QPointF pos(txtObj["x"].toDouble(), txtObj["y"].toDouble());
@@ -503,6 +755,13 @@ void CollabManager::handleFullSync(const QJsonObject &message)
     
     m_isSyncing = false;
     
+    LamportStamp latest;
+    latest.counter = m_lww.maxCounter();
+    m_clock.observe(latest);
+    
+    // Fetch everything we didn't already hold in one request, previews first
+    requestBlobs(fetch);
+    
     // Emit what was synced for debugging
     emit syncReceived(addedImages, addedTexts);
     emit boardSynced();
@@ -519,17 +778,91 @@ void CollabManager::requestFullSync()
 
 void CollabManager::pushLocalState()
 {
-    if (!m_scene || !isConnected()) {
+    if (!m_scene) return;
+    pushItems(m_scene->imageItems(), m_scene->textItems());
+}
+
+void CollabManager::reconcile()
+{
+    if (!m_scene || !isConnected()) return;
+    
+    if (!m_client->serverSupports("reconcile")) {
+        pushLocalState();
         return;
     }
     
+    // Hashes of the board instead of the board; the server answers with
+    // its items in the buckets that differ
+    QJsonObject message;
+    message["type"] = "reconcile";
+    message["oderId"] = m_client->oderId();
+    BoardDigest digest = localDigest();
+    message["root"] = digest.root();
+    message["buckets"] = QJsonArray::fromStringList(digest.bucketHashes());
+    
+    m_client->sendMessage(message);
+}
+
+BoardDigest CollabManager::localDigest()
+{
+    BoardDigest digest;
+    for (ImageItem *item : m_scene->imageItems()) {
+        digest.addImage(item->id(), blobForItem(item).hash, m_lww.latest(item->id()));
+    }
+    for (TextItem *item : m_scene->textItems()) {
+        digest.addText(item->id(), item->text(), m_lww.latest(item->id()));
+    }
+    return digest;
+}
+
+void CollabManager::handleReconcileDiff(const QJsonObject &message)
+{
+    if (!m_scene) return;
+    
+    QSet<int> buckets;
+    for (const QJsonValue &value : message["buckets"].toArray()) {
+        buckets.insert(value.toInt());
+    }
+    if (buckets.isEmpty()) return;   // Already in step
+    
+    // Both sides of each differing bucket cross over with their register
+    // stamps, and each side keeps whichever registers are newer: items only
+    // one side has, and edits either made while the other wasn't looking
+    QList<ImageItem*> localImages;
+    for (ImageItem *item : m_scene->imageItems()) {
+        if (buckets.contains(BoardDigest::bucketOf(item->id()))) {
+            localImages.append(item);
+        }
+    }
+    QList<TextItem*> localTexts;
+    for (TextItem *item : m_scene->textItems()) {
+        if (buckets.contains(BoardDigest::bucketOf(item->id()))) {
+            localTexts.append(item);
+        }
+    }
+    
+    if (!localImages.isEmpty() || !localTexts.isEmpty()) {
+        pushItems(localImages, localTexts);
+    }
+    handleFullSync(message);
+}
+
+void CollabManager::pushItems(const QList<ImageItem*> &imageItems,
+                              const QList<TextItem*> &textItems)
+{
+    if (!isConnected()) return;
+    
     QJsonObject message;
     message["type"] = "pushSync";
     message["oderId"] = m_client->oderId();
     
     // Gather local images
+    bool blobs = m_client->serverSupports("blobs");
     QJsonArray images;
-    for (ImageItem *item : m_scene->imageItems()) {
+    for (ImageItem *item : imageItems) {
+        // Still downloading here: we couldn't answer the server's request
+        if (blobs && !holdsImage(item)) continue;
+        
         QJsonObject imgObj;
         imgObj["imageId"] = item->id();
         imgObj["x"] = item->pos().x();
@@ -537,24 +870,21 @@ void CollabManager::pushLocalState()
         imgObj["rotation"] = item->rotation();
         imgObj["scale"] = item->scale();
         imgObj["zIndex"] = item->zValue();
+        // As of our last edit, so anything removed since stays removed;
+        // per register for items the server already has
+        LamportStamp stamp = m_lww.latest(item->id());
+        if (!stamp.isNull()) {
+            imgObj["stamp"] = stamp.toJson();
+            imgObj["stamps"] = m_lww.stampsJson(item->id());
+        }
         
-        // Check if it's an animated GIF
-        QString sourcePath = item->sourcePath();
-        if (!sourcePath.isEmpty() && sourcePath.toLower().endsWith(".gif")) {
-            QFile file(sourcePath);
-            if (file.open(QIODevice::ReadOnly)) {
-                QByteArray gifData = file.readAll();
-                file.close();
-                imgObj["imageData"] = QString::fromUtf8(gifData.toBase64());
-                imgObj["isGif"] = true;
-            }
+        // Hashes only; the server asks for any blob it doesn't have
+        if (blobs) {
+            announceBlob(imgObj, blobForItem(item));
         } else {
-            QByteArray imageData;
-            QBuffer buffer(&imageData);
-            buffer.open(QIODevice::WriteOnly);
-            item->image().save(&buffer, "PNG");
-            imgObj["imageData"] = QString::fromUtf8(imageData.toBase64());
-            imgObj["isGif"] = false;
+            bool isGif = false;
+            imgObj["imageData"] = QString::fromLatin1(encodeImage(item, &isGif).toBase64());
+            imgObj["isGif"] = isGif;
         }
         
         images.append(imgObj);
@@ -563,13 +893,18 @@ void CollabManager::pushLocalState()
     
     // Gather local texts
     QJsonArray texts;
-    for (TextItem *item : m_scene->textItems()) {
+    for (TextItem *item : textItems) {
         QJsonObject txtObj;
         txtObj["textId"] = item->id();
         txtObj["text"] = item->text();
         txtObj["x"] = item->pos().x();
         txtObj["y"] = item->pos().y();
         txtObj["rotation"] = item->rotation();
+        LamportStamp stamp = m_lww.latest(item->id());
+        if (!stamp.isNull()) {
+            txtObj["stamp"] = stamp.toJson();
+            txtObj["stamps"] = m_lww.stampsJson(item->id());
+        }
         texts.append(txtObj);
     }
     message["texts"] = texts;
@@ -577,6 +912,44 @@ void CollabManager::pushLocalState()
     m_client->sendMessage(message);
 }
 
+void CollabManager::stampOutgoing(QJsonObject &message, const QString &itemId)
+{
+    LamportStamp stamp = m_clock.tick();
+    message["stamp"] = stamp.toJson();
+    m_lww.merge(itemId, message, stamp);
+    noteSynced(itemId, message);
+}
+
+QJsonObject CollabManager::changedFields(const QString &itemId, const QJsonObject &fields) const
+{
+    const QJsonObject synced = m_syncedFields.value(itemId);
+    QSet<QString> changed;
+    for (auto it = fields.constBegin(); it != fields.constEnd(); ++it) {
+        if (synced.value(it.key()) != it.value()) {
+            changed.insert(LwwTable::registerOf(it.key()));
+        }
+    }
+    
+    // Whole registers: x and y always travel together
+    QJsonObject result;
+    for (auto it = fields.constBegin(); it != fields.constEnd(); ++it) {
+        if (changed.contains(LwwTable::registerOf(it.key()))) {
+            result.insert(it.key(), it.value());
+        }
+    }
+    return result;
+}
+
+void CollabManager::noteSynced(const QString &itemId, const QJsonObject &fields)
+{
+    QJsonObject &synced = m_syncedFields[itemId];
+    for (auto it = fields.constBegin(); it != fields.constEnd(); ++it) {
+        if (!LwwTable::registerOf(it.key()).isEmpty()) {
+            synced.insert(it.key(), it.value());
+        }
+    }
+}
+
 void CollabManager::sendImageAdd(ImageItem *item)
 {
     if (!item) return;
@@ -590,54 +963,484 @@ void CollabManager::sendImageAdd(ImageItem *item)
     message["rotation"] = item->rotation();
     message["scale"] = item->scale();
     message["zIndex"] = item->zValue();
+    stampOutgoing(message, item->id());
     
-    // Check if it's an animated GIF
-    QString sourcePath = item->sourcePath();
-    if (!sourcePath.isEmpty() && sourcePath.toLower().endsWith(".gif")) {
-        // Send raw GIF file data to preserve animation
-        QFile file(sourcePath);
-        if (file.open(QIODevice::ReadOnly)) {
-            QByteArray gifData = file.readAll();
-            file.close();
-            message["imageData"] = QString::fromUtf8(gifData.toBase64());
-            message["isGif"] = true;
-        } else {
-            // Fallback to static image
-            QByteArray imageData;
-            QBuffer buffer(&imageData);
-            buffer.open(QIODevice::WriteOnly);
-            item->image().save(&buffer, "PNG");
-            message["imageData"] = QString::fromUtf8(imageData.toBase64());
-            message["isGif"] = false;
-        }
+    // Announce by hash; the bytes only travel if the server asks for them
+    if (m_client->serverSupports("blobs")) {
+        announceBlob(message, blobForItem(item));
     } else {
-        // Regular image - encode as PNG
-        QByteArray imageData;
-        QBuffer buffer(&imageData);
-        buffer.open(QIODevice::WriteOnly);
-        item->image().save(&buffer, "PNG");
-        message["imageData"] = QString::fromUtf8(imageData.toBase64());
-        message["isGif"] = false;
+        bool isGif = false;
+        message["imageData"] = QString::fromLatin1(encodeImage(item, &isGif).toBase64());
+        message["isGif"] = isGif;
     }
     
     m_client->sendMessage(message);
 }
 
-void CollabManager::sendImageUpdate(ImageItem *item)
+QByteArray CollabManager::encodeImage(ImageItem *item, bool *isGif)
 {
-    if (!item) return;
+    // Still downloading or decoding: the bytes we got are the image
+    auto blob = m_imageBlobs.constFind(item->id());
+    if (item->isPlaceholder() && blob != m_imageBlobs.constEnd() &&
+        m_blobs.contains(blob->hash)) {
+        *isGif = blob->isGif;
+        return m_blobs.value(blob->hash);
+    }
+    
+    // The imported file as is (GIFs keep their animation); pasted pixels
+    // are encoded once and cached by the item
+    EncodedImage encoded = item->encoded();
+    *isGif = encoded.isGif();
+    return encoded.data;
+}
+
+QByteArray CollabManager::encodePreview(const QImage &image) const
+{
+    const int previewSize = TransferPriority::PREVIEW_SIZE;
+    if (image.isNull() || qMax(image.width(), image.height()) <= previewSize) {
+        return QByteArray();
+    }
+    
+    // JPEG is far smaller, but would turn transparency black
+    QImage scaled = image.scaled(previewSize, previewSize, Qt::KeepAspectRatio,
+                                 Qt::SmoothTransformation);
+    QByteArray previewData;
+    QBuffer buffer(&previewData);
+    buffer.open(QIODevice::WriteOnly);
+    if (scaled.hasAlphaChannel()) {
+        scaled.save(&buffer, "PNG");
+    } else {
+        scaled.save(&buffer, "JPG", 80);
+    }
+    return previewData;
+}
+
+bool CollabManager::holdsImage(ImageItem *item) const
+{
+    auto blob = m_imageBlobs.constFind(item->id());
+    return !item->isPlaceholder() || blob == m_imageBlobs.constEnd() ||
+           m_blobs.contains(blob->hash);
+}
+
+const ImageBlob &CollabManager::blobForItem(ImageItem *item)
+{
+    auto it = m_imageBlobs.constFind(item->id());
+    if (it != m_imageBlobs.constEnd()) {
+        return it.value();
+    }
+    
+    ImageBlob blob;
+    blob.hash = m_blobs.insert(encodeImage(item, &blob.isGif));
+    blob.size = item->image().size();
+    QByteArray preview = encodePreview(item->image());
+    if (!preview.isEmpty()) {
+        blob.previewHash = m_blobs.insert(preview);
+    }
+    return m_imageBlobs.insert(item->id(), blob).value();
+}
+
+void CollabManager::announceBlob(QJsonObject &meta, const ImageBlob &blob)
+{
+    meta["blobHash"] = blob.hash;
+    meta["isGif"] = blob.isGif;
+    if (!blob.previewHash.isEmpty()) {
+        meta["previewHash"] = blob.previewHash;
+        meta["width"] = blob.size.width();
+        meta["height"] = blob.size.height();
+    }
+}
+
+bool CollabManager::placeImage(const QJsonObject &meta, BlobFetch *fetch)
+{
+    QString imageId = meta["imageId"].toString();
+    
+    ImageBlob blob;
+    blob.hash = meta["blobHash"].toString();
+    blob.isGif = meta["isGif"].toBool(false);
+    blob.previewHash = meta["previewHash"].toString();
+    blob.size = QSize(meta["width"].toInt(), meta["height"].toInt());
+    
+    if (!m_blobs.contains(blob.hash)) {
+        // Park the announce until the blob arrives
+        m_pendingImages.insert(imageId, meta);
+        QStringList &waiters = m_blobWaiters[blob.hash];
+        if (!waiters.contains(imageId)) {
+            waiters.append(imageId);
+        }
+        
+        // The original always comes, so the item can be copied, saved and
+        // passed on; while a mip looks sharp at this zoom it is sent after
+        // everything that doesn't
+        if (!m_requestedBlobs.contains(blob.hash)) {
+            m_requestedBlobs.insert(blob.hash);
+            fetch->images.append(blob.hash);
+        }
+        QString standIn = mipFor(meta);
+        if (standIn.isEmpty()) {
+            standIn = blob.previewHash;
+        }
+        
+        // Show the preview meanwhile, fetching it ahead of the full image
+        if (standIn.isEmpty()) return false;
+        if (m_blobs.contains(standIn)) return placePreview(meta, standIn);
+        
+        QStringList &previewWaiters = m_previewWaiters[standIn];
+        if (!previewWaiters.contains(imageId)) {
+            previewWaiters.append(imageId);
+        }
+        if (!m_requestedBlobs.contains(standIn)) {
+            m_requestedBlobs.insert(standIn);
+            fetch->previews.append(standIn);
+        }
+        return false;
+    }
+    
+    // A preview is already up: swap the image in place
+    if (ImageItem *placeholder = m_scene->findImageItem(imageId)) {
+        return upgradeImage(placeholder, m_blobs.value(blob.hash), blob.isGif);
+    }
+    
+    QPointF pos(meta["x"].toDouble(), meta["y"].toDouble());
+    if (!addImageFromData(imageId, m_blobs.value(blob.hash), blob.isGif, pos,
+                          meta["rotation"].toDouble(), meta["scale"].toDouble(1.0))) {
+        return false;
+    }
+    
+    m_imageBlobs.insert(imageId, blob);
+    return true;
+}
+
+bool CollabManager::placePreview(const QJsonObject &meta, const QString &hash)
+{
+    QString imageId = meta["imageId"].toString();
+    ImageItem *existing = m_scene->findImageItem(imageId);
+    if (existing && !existing->isPlaceholder()) return false;
+    
+    QImage preview;
+    preview.loadFromData(m_blobs.value(hash));
+    if (preview.isNull()) return false;
+    
+    // A sharper mip for the zoom the view is at now
+    if (existing) {
+        if (preview.width() > existing->image().width()) {
+            existing->setPreviewImage(preview);
+        }
+        return false;
+    }
+    
+    QPointF pos(meta["x"].toDouble(), meta["y"].toDouble());
+    ImageItem *item = m_scene->addImageItem(imageId, preview, pos,
+                                            meta["rotation"].toDouble(),
+                                            meta["scale"].toDouble(1.0));
+    item->setPlaceholderSize(QSize(meta["width"].toInt(), meta["height"].toInt()));
+    
+    // Re-announces of this item must point at the real image, not the preview
+    ImageBlob blob;
+    blob.hash = meta["blobHash"].toString();
+    blob.isGif = meta["isGif"].toBool(false);
+    blob.previewHash = meta["previewHash"].toString();
+    blob.size = QSize(meta["width"].toInt(), meta["height"].toInt());
+    m_imageBlobs.insert(imageId, blob);
+    return true;
+}
+
+bool CollabManager::upgradeImage(ImageItem *item, const QByteArray &imageData, bool isGif)
+{
+    if (isGif) {
+        QString path = gifPath(imageData);
+        if (path.isEmpty()) return false;
+        item->setSourcePath(path);
+        return true;
+    }
+    
+    // The preview stays up until the pixels are in
+    m_decoder->decode(item->id(), imageData);
+    return true;
+}
+
+void CollabManager::requestBlobs(BlobFetch fetch)
+{
+    // Nearest to the viewport first; the server keeps reordering what's
+    // left as the view moves, this covers servers that don't
+    if (m_viewport.isValid()) {
+        QHash<QString, qreal> priorities;
+        for (const QJsonObject &meta : m_pendingImages) {
+            QSizeF size(meta["width"].toDouble(), meta["height"].toDouble());
+            QRectF rect = TransferPriority::itemRect(meta["x"].toDouble(), meta["y"].toDouble(),
+                                                     size, meta["scale"].toDouble(1.0));
+            const QJsonObject mips = meta["mips"].toObject();
+            bool hasPreview = meta.contains("previewHash") || !mips.isEmpty();
+            priorities.insert(meta["blobHash"].toString(),
+                              TransferPriority::score(rect, false, hasPreview,
+                                                      m_viewport, m_viewportZoom,
+                                                      TransferPriority::standInSize(mips)));
+            qreal previewScore = TransferPriority::score(rect, true, true,
+                                                         m_viewport, m_viewportZoom);
+            if (meta.contains("previewHash")) {
+                priorities.insert(meta["previewHash"].toString(), previewScore);
+            }
+            for (auto it = mips.begin(); it != mips.end(); ++it) {
+                priorities.insert(it.value().toString(), previewScore);
+            }
+        }
+        auto sooner = [&priorities](const QString &a, const QString &b) {
+            return priorities.value(a) < priorities.value(b);
+        };
+        std::stable_sort(fetch.previews.begin(), fetch.previews.end(), sooner);
+        std::stable_sort(fetch.images.begin(), fetch.images.end(), sooner);
+    }
+    
+    // The server answers in order, so previews arrive first
+    QStringList hashes = fetch.previews + fetch.images;
+    if (hashes.isEmpty()) return;
     
     QJsonObject message;
-    message["type"] = "imageUpdate";
+    message["type"] = "blobRequest";
     message["oderId"] = m_client->oderId();
-    message["imageId"] = item->id();
+    message["hashes"] = QJsonArray::fromStringList(hashes);
+    
+    m_client->sendMessage(message);
+}
+
+QString CollabManager::mipFor(const QJsonObject &meta) const
+{
+    // The smallest level at least as large as the image is on screen
+    qreal longEdge = qMax(meta["width"].toDouble(), meta["height"].toDouble());
+    if (longEdge <= 0) return QString();
+    qreal onScreen = longEdge * meta["scale"].toDouble(1.0) * m_viewportZoom;
+    
+    const QJsonObject mips = meta["mips"].toObject();
+    int best = 0;
+    QString hash;
+    for (auto it = mips.begin(); it != mips.end(); ++it) {
+        int level = it.key().toInt();
+        if (level >= onScreen && (best == 0 || level < best)) {
+            best = level;
+            hash = it.value().toString();
+        }
+    }
+    return hash;
+}
+
+void CollabManager::addMips(const QString &imageId, const QJsonObject &mips, BlobFetch *fetch)
+{
+    // Only of use while the full image is missing
+    auto pending = m_pendingImages.constFind(imageId);
+    if (mips.isEmpty() || pending == m_pendingImages.constEnd()) return;
+    
+    QJsonObject meta = pending.value();
+    meta["mips"] = mips;
+    placeImage(meta, fetch);
+}
+
+void CollabManager::handleImageMips(const QJsonObject &message)
+{
+    if (!m_scene) return;
+    
+    BlobFetch fetch;
+    m_isSyncing = true;
+    addMips(message["imageId"].toString(), message["mips"].toObject(), &fetch);
+    m_isSyncing = false;
+    requestBlobs(fetch);
+}
+
+void CollabManager::fetchForZoom()
+{
+    if (!m_scene || !isConnected()) return;
+    
+    // Images shown from a mip may want a sharper one
+    BlobFetch fetch;
+    m_isSyncing = true;
+    const QList<QJsonObject> pending = m_pendingImages.values();
+    for (const QJsonObject &meta : pending) {
+        if (meta.contains("mips")) {
+            placeImage(meta, &fetch);
+        }
+    }
+    m_isSyncing = false;
+    requestBlobs(fetch);
+}
+
+void CollabManager::setViewport(const QRectF &rect, qreal zoom)
+{
+    bool zoomed = !qFuzzyCompare(zoom, m_viewportZoom);
+    m_viewport = rect;
+    m_viewportZoom = zoom;
+    sendViewport();
+    
+    if (zoomed) {
+        fetchForZoom();
+    }
+}
+
+void CollabManager::sendViewport()
+{
+    if (!m_viewport.isValid() || !isConnected() || !m_client->serverSupports("viewport")) {
+        return;
+    }
+    
+    QJsonObject message;
+    message["type"] = "viewport";
+    message["oderId"] = m_client->oderId();
+    message["x"] = m_viewport.x();
+    message["y"] = m_viewport.y();
+    message["width"] = m_viewport.width();
+    message["height"] = m_viewport.height();
+    message["zoom"] = m_viewportZoom;
+    
+    m_client->sendMessage(message);
+}
+
+void CollabManager::handleBlobRequest(const QJsonObject &message)
+{
+    for (const QJsonValue &value : message["hashes"].toArray()) {
+        QString hash = value.toString();
+        if (!m_blobs.contains(hash)) continue;
+        
+        QJsonObject header;
+        header["type"] = "blobData";
+        header["hash"] = hash;
+        m_client->sendBinaryMessage(header, m_blobs.value(hash));
+    }
+}
+
+void CollabManager::handleBlobData(const QJsonObject &header, const QByteArray &payload)
+{
+    QString hash = header["hash"].toString();
+    m_requestedBlobs.remove(hash);
+    
+    if (!m_blobs.insert(hash, payload)) return;
+    if (!m_scene) return;
+    
+    int added = 0;
+    m_isSyncing = true;
+    
+    // Previews only matter while the full image is still missing
+    for (const QString &imageId : m_previewWaiters.take(hash)) {
+        auto pending = m_pendingImages.constFind(imageId);
+        if (pending == m_pendingImages.constEnd()) continue;
+        
+        if (placePreview(pending.value(), hash)) {
+            added++;
+        }
+    }
+    
+    for (const QString &imageId : m_blobWaiters.take(hash)) {
+        QJsonObject meta = m_pendingImages.take(imageId);
+        if (meta.isEmpty()) continue;
+        
+        ImageItem *existing = m_scene->findImageItem(imageId);
+        if (existing && !existing->isPlaceholder()) continue;
+        
+        if (placeImage(meta, nullptr) && !existing) {
+            added++;
+        }
+    }
+    m_isSyncing = false;
+    
+    if (added > 0) {
+        emit boardSynced();
+    }
+}
+
+bool CollabManager::addImageFromData(const QString &imageId, const QByteArray &imageData,
+                                     bool isGif, const QPointF &pos, qreal rotation, qreal scale)
+{
+    if (imageData.isEmpty()) return false;
+    
+    if (isGif) {
+        // QMovie animates from a file; the blob cache has one per GIF
+        QString path = gifPath(imageData);
+        if (path.isEmpty()) return false;
+        
+        m_scene->addImageItemFromFile(imageId, path, pos, rotation, scale);
+        return true;
+    }
+    
+    // Formats that only tell their size by decoding are decoded here
+    QSize size = ImageDecoder::peekSize(imageData);
+    if (!size.isValid()) {
+        QImage image;
+        image.loadFromData(imageData);
+        if (image.isNull()) return false;
+        
+        m_scene->addImageItem(imageId, image, pos, rotation, scale,
+                              EncodedImage::fromData(imageData));
+        return true;
+    }
+    
+    // Laid out at full size right away; the pixels follow off-thread
+    ImageItem *item = m_scene->addImageItem(imageId, QImage(), pos, rotation, scale);
+    item->setPlaceholderSize(size);
+    m_decoder->decode(imageId, imageData);
+    
+    // Re-announces meanwhile send these bytes rather than the empty item
+    if (!m_imageBlobs.contains(imageId)) {
+        ImageBlob blob;
+        blob.hash = m_blobs.insert(imageData);
+        blob.size = size;
+        m_imageBlobs.insert(imageId, blob);
+    }
+    return true;
+}
+
+void CollabManager::onImageDecoded(const QString &imageId, const QImage &image)
+{
+    if (!m_scene) return;
+    
+    ImageItem *item = m_scene->findImageItem(imageId);
+    if (!item) return;
+    
+    // Keep what was received, so passing it on doesn't re-encode
+    EncodedImage encoded;
+    auto blob = m_imageBlobs.constFind(imageId);
+    if (blob != m_imageBlobs.constEnd()) {
+        encoded = EncodedImage::fromData(m_blobs.value(blob->hash));
+    }
+    item->replaceImage(image, encoded);
+}
+
+void CollabManager::onImageDecodeFailed(const QString &imageId)
+{
+    if (!m_scene) return;
+    
+    // A preview stays up; an empty placeholder goes as if never received
+    ImageItem *item = m_scene->findImageItem(imageId);
+    if (!item || !item->image().isNull()) return;
+    
+    m_isSyncing = true;
+    m_scene->removeImageItem(imageId);
+    m_isSyncing = false;
+}
+
+QString CollabManager::gifPath(const QByteArray &imageData)
+{
+    // Received again, it's the same file rather than another temp copy
+    return m_blobs.filePath(m_blobs.insert(imageData));
+}
+
+void CollabManager::sendImageUpdate(ImageItem *item, bool live)
+{
+    if (!item) return;
+    
+    QJsonObject message;
     message["x"] = item->pos().x();
     message["y"] = item->pos().y();
     message["rotation"] = item->rotation();
     message["scale"] = item->scale();
     message["zIndex"] = item->zValue();
     
-    m_client->sendMessage(message);
+    // Sequenced updates claim only what changed, so a concurrent edit of
+    // another property isn't overwritten with our stale value
+    if (!live) {
+        message = changedFields(item->id(), message);
+        if (message.isEmpty()) return;
+    }
+    
+    message["type"] = "imageUpdate";
+    message["oderId"] = m_client->oderId();
+    message["imageId"] = item->id();
+    sendUpdate(message, item->id(), live);
 }
 
 void CollabManager::sendImageRemove(const QString &id)
@@ -647,6 +1450,11 @@ void CollabManager::sendImageRemove(const QString &id)
     message["oderId"] = m_client->oderId();
     message["imageId"] = id;
     
+    LamportStamp stamp = m_clock.tick();
+    message["stamp"] = stamp.toJson();
+    m_lww.remove(id, stamp);
+    m_syncedFields.remove(id);
+    
     m_client->sendMessage(message);
 }
 
@@ -663,21 +1471,49 @@ void CollabManager::sendTextAdd(TextItem *item)
     message["fontFamily"] = item->textFont().family();
     message["fontSize"] = item->textFont().pointSize();
     message["textColor"] = item->textColor().name();
+    stampOutgoing(message, item->id());
+    m_textSync.insert(item->id(), TextSync());
     
     m_client->sendMessage(message);
 }
 
-void CollabManager::sendTextUpdate(TextItem *item)
+void CollabManager::sendTextUpdate(TextItem *item, bool live)
 {
     QJsonObject message;
-    message["type"] = "textUpdate";
-    message["oderId"] = m_client->oderId();
-    message["textId"] = item->id();
-    message["text"] = item->text();
+    // Servers that take character edits get the text through those
+    if (!m_client->serverSupports("textEdit")) {
+        message["text"] = item->text();
+    }
     message["x"] = item->pos().x();
     message["y"] = item->pos().y();
     message["rotation"] = item->rotation();
     
+    if (!live) {
+        message = changedFields(item->id(), message);
+        if (message.isEmpty()) return;
+    }
+    
+    message["type"] = "textUpdate";
+    message["oderId"] = m_client->oderId();
+    message["textId"] = item->id();
+    sendUpdate(message, item->id(), live);
+}
+
+void CollabManager::sendUpdate(QJsonObject &message, const QString &itemId, bool live)
+{
+    // Live drags are presence and may take the datagram channel; the final
+    // update is an op, and marks every live one before it as stale
+    if (live) {
+        message["live"] = true;
+        m_client->sendPresence(message);
+        return;
+    }
+    
+    stampOutgoing(message, itemId);
+    if (!isConnected()) return;     // Kept for the next reconcile
+    if (m_client->presenceSeq() > 0) {
+        message["pseq"] = m_client->presenceSeq();
+    }
     m_client->sendMessage(message);
 }
 
@@ -688,9 +1524,43 @@ void CollabManager::sendTextRemove(const QString &id)
     message["oderId"] = m_client->oderId();
     message["textId"] = id;
     
+    LamportStamp stamp = m_clock.tick();
+    message["stamp"] = stamp.toJson();
+    m_lww.remove(id, stamp);
+    m_syncedFields.remove(id);
+    m_textSync.remove(id);
+    
     m_client->sendMessage(message);
 }
 
+void CollabManager::sendTextEdit(const QString &textId)
+{
+    const TextSync sync = m_textSync.value(textId);
+    if (sync.unacked.isEmpty()) return;
+    
+    // Only the changed span travels: retain counts around what was typed
+    QJsonObject message;
+    message["type"] = "textEdit";
+    message["oderId"] = m_client->oderId();
+    message["textId"] = textId;
+    message["rev"] = sync.rev;
+    message["op"] = sync.unacked.first().toJson();
+    
+    m_client->sendMessage(message);
+}
+
+void CollabManager::resetText(TextItem *item, const QString &text, qint64 rev)
+{
+    if (item->text() != text) {
+        item->setText(text);
+    }
+    m_textSync.insert(item->id(), TextSync{rev, {}});
+    
+    QJsonObject fields;
+    fields["text"] = text;
+    noteSynced(item->id(), fields);
+}
+
 void CollabManager::handleTextAdd(const QJsonObject &message)
 {
     if (!m_scene) return;
@@ -707,6 +1577,12 @@ void CollabManager::handleTextAdd(const QJsonObject &message)
     // Check if text already exists
     if (m_scene->findTextItem(textId)) return;
     
+    LamportStamp stamp = LamportStamp::fromJson(message["stamp"]);
+    if (m_lww.isRemoved(textId, stamp)) return;
+    m_lww.merge(textId, message, stamp);
+    noteSynced(textId, message);
+    m_textSync.insert(textId, TextSync{message["rev"].toVariant().toLongLong(), {}});
+    
     m_isSyncing = true;
     m_scene->addTextItem(textId, text, QPointF(x, y), rotation);
     m_isSyncing = false;
@@ -723,19 +1599,36 @@ void CollabManager::handleTextUpdate(const QJsonObject &message)
     TextItem *item = m_scene->findTextItem(textId);
     if (!item) return;
     
-    m_isSyncing = true;
+    QJsonObject fields = message;
+    if (!message["live"].toBool()) {
+        bool changed = false;
+        fields = m_lww.merge(textId, message, LamportStamp::fromJson(message["stamp"]),
+                             &changed);
+        if (!changed) return;
+        noteSynced(textId, fields);
+    }
     
-    if (message.contains("text")) {
-        item->setText(message["text"].toString());
+    m_isSyncing = true;
+    if (fields.contains("text") && fields.contains("rev")) {
+        // A whole new text from an older client; edits restart from it
+        resetText(item, fields["text"].toString(), fields["rev"].toVariant().toLongLong());
+        fields.remove("text");
     }
-    if (message.contains("x") && message.contains("y")) {
-        item->setPos(message["x"].toDouble(), message["y"].toDouble());
+    applyTextFields(item, fields);
+    m_isSyncing = false;
+}
+
+void CollabManager::applyTextFields(TextItem *item, const QJsonObject &fields)
+{
+    if (fields.contains("text")) {
+        item->setText(fields["text"].toString());
     }
-    if (message.contains("rotation")) {
-        item->setRotation(message["rotation"].toDouble());
+    if (fields.contains("x") && fields.contains("y")) {
+        item->setPos(fields["x"].toDouble(), fields["y"].toDouble());
+    }
+    if (fields.contains("rotation")) {
+        item->setRotation(fields["rotation"].toDouble());
     }
-    
-    m_isSyncing = false;
 }
 
 void CollabManager::handleTextRemove(const QJsonObject &message)
@@ -746,12 +1639,81 @@ void CollabManager::handleTextRemove(const QJsonObject &message)
     if (senderId == m_client->oderId()) return;
     
     QString textId = message["textId"].toString();
+    if (!m_lww.remove(textId, LamportStamp::fromJson(message["stamp"]))) return;
+    m_syncedFields.remove(textId);
+    m_textSync.remove(textId);
     
     m_isSyncing = true;
     m_scene->removeTextItem(textId);
     m_isSyncing = false;
 }
 
+void CollabManager::handleTextEdit(const QJsonObject &message)
+{
+    if (!m_scene) return;
+    
+    // Our own edit, replayed by a catch-up after a reconnect: it made it
+    if (message["oderId"].toString() == m_client->oderId()) {
+        handleTextAck(message);
+        return;
+    }
+    
+    QString textId = message["textId"].toString();
+    TextItem *item = m_scene->findTextItem(textId);
+    if (!item) return;
+    
+    TextOperation edit;
+    if (!TextOperation::fromJson(message["op"].toArray(), &edit)) return;
+    
+    // The server put it before our unacked edits; move it past them, and
+    // them past it, so both sides end up with the same text
+    TextSync &sync = m_textSync[textId];
+    for (TextOperation &pending : sync.unacked) {
+        TextOperation pendingPrime;
+        TextOperation editPrime;
+        if (!TextOperation::transform(pending, edit, &pendingPrime, &editPrime)) {
+            requestFullSync();
+            return;
+        }
+        pending = pendingPrime;
+        edit = editPrime;
+    }
+    sync.rev = message["rev"].toVariant().toLongLong();
+    
+    m_isSyncing = true;
+    for (const TextOperation::Splice &splice : edit.splices()) {
+        item->applyEdit(splice.position, splice.removed, splice.inserted);
+    }
+    m_isSyncing = false;
+}
+
+void CollabManager::handleTextAck(const QJsonObject &message)
+{
+    QString textId = message["textId"].toString();
+    if (!m_textSync.contains(textId)) return;
+    
+    TextSync &sync = m_textSync[textId];
+    sync.rev = message["rev"].toVariant().toLongLong();
+    if (!sync.unacked.isEmpty()) {
+        sync.unacked.removeFirst();
+    }
+    sendTextEdit(textId);
+}
+
+void CollabManager::handleTextResync(const QJsonObject &message)
+{
+    if (!m_scene) return;
+    
+    QString textId = message["textId"].toString();
+    TextItem *item = m_scene->findTextItem(textId);
+    if (!item) return;
+    
+    // Our edit couldn't be placed; the server's text wins
+    m_isSyncing = true;
+    resetText(item, message["text"].toString(), message["rev"].toVariant().toLongLong());
+    m_isSyncing = false;
+}
+
 QColor CollabManager::generateUserColor() const
 {
     static const QList<QColor> colors = {
@@ -6,11 +6,24 @@
 #include <QColor>
 #include <QTimer>
 #include <QPointF>
+#include <QSize>
+#include <QRectF>
+#include <QSet>
+#include <QStringList>
+#include <QJsonObject>
+#include "BlobCache.h"
+#include "BoardDigest.h"
+#include "data/LwwTable.h"
+#include "data/TextOperation.h"
 
+class QImage;
 class SyncClient;
+class LatencyStats;
+class TrafficStats;
 class Board;
 class CanvasScene;
 class ImageItem;
+class ImageDecoder;
 class TextItem;
 
 struct Collaborator {
@@ -21,6 +34,30 @@ struct Collaborator {
     bool isActive;
 };
 
+// Content hash of the encoded bytes behind an image item, plus a small
+// preview shown while the full image is still downloading
+struct ImageBlob {
+    QString hash;
+    bool isGif = false;
+    QString previewHash;    // Empty for images already smaller than a preview
+    QSize size;             // Full size in pixels
+};
+
+// Blobs to fetch after a batch of announces. Previews are requested ahead
+// of everything else so the whole board shows up before any full image.
+struct BlobFetch {
+    QStringList previews;
+    QStringList images;
+};
+
+// Where a text stands with the server: the last revision we know of and
+// local edits it hasn't acknowledged. Only the first of those is in
+// flight; the rest wait for its ack and are rebased as remote edits come.
+struct TextSync {
+    qint64 rev = 0;
+    QList<TextOperation> unacked;
+};
+
 class CollabManager : public QObject
 {
     Q_OBJECT
@@ -36,15 +73,29 @@ public:
     void disconnect();
     
     bool isConnected() const;
+    // The client is retrying on its own; see SyncClient::isReconnecting()
+    bool isReconnecting() const;
     QString roomId() const;
     int userCount() const;
+    // How the link to the server is doing; see SyncClient::latency()
+    const LatencyStats &latency() const;
+    const TrafficStats &traffic() const;
     
     QString localUserName() const { return m_localUserName; }
     void setLocalUserName(const QString &name) { m_localUserName = name; }
     
+    // Max transform updates per second per item while dragging
+    void setTransformRate(int hz);
+    
+    // Scene rect the local view shows; images there are fetched first
+    void setViewport(const QRectF &rect, qreal zoom);
+    
     // Manual sync controls
-    void requestFullSync();
-    void pushLocalState();
+    void requestFullSync();     // Full snapshot, regardless of lastSeq
+    void pushLocalState();      // Uploads every local item
+    // Brings both sides in step, sending only what differs if the server
+    // can compare hash trees
+    void reconcile();
 
 signals:
     void connectionStatusChanged(bool connected);
@@ -52,12 +103,15 @@ signals:
     void userLeft(const QString &oderId);
     void boardSynced();
     void syncReceived(int imagesAdded, int textsAdded);
+    void latencyUpdated();
     void errorOccurred(const QString &error);
 
 private slots:
     void onConnected();
     void onDisconnected();
+    void onSynchronized();
     void onMessageReceived(const QJsonObject &message);
+    void onBinaryMessageReceived(const QJsonObject &header, const QByteArray &payload);
     void onLocalCursorMoved(const QPointF &pos);
     void onImageAdded(ImageItem *item);
     void onImageChanged(ImageItem *item);
@@ -65,28 +119,67 @@ private slots:
     void onTextAdded(TextItem *item);
     void onTextChanged(TextItem *item);
     void onTextRemoved(const QString &id);
+    void onTextEdited(TextItem *item, int position, int removed, const QString &inserted);
+    void onInteractionFinished();
     void sendCursorUpdate();
+    void flushTransforms();
+    void onImageDecoded(const QString &imageId, const QImage &image);
+    void onImageDecodeFailed(const QString &imageId);
 
 private:
     void handleJoin(const QJsonObject &message);
     void handleLeave(const QJsonObject &message);
     void handleUserList(const QJsonObject &message);
     void handleCursor(const QJsonObject &message);
-    void handleImageAdd(const QJsonObject &message);
+    void handleImageAdd(const QJsonObject &message, const QByteArray &payload = QByteArray());
     void handleImageUpdate(const QJsonObject &message);
     void handleImageRemove(const QJsonObject &message);
     void handleTextAdd(const QJsonObject &message);
     void handleTextUpdate(const QJsonObject &message);
     void handleTextRemove(const QJsonObject &message);
+    void handleTextEdit(const QJsonObject &message);
+    void handleTextAck(const QJsonObject &message);
+    void handleTextResync(const QJsonObject &message);
     void handleSync(const QJsonObject &message);
-    void handleFullSync(const QJsonObject &message);
+    void handleFullSync(const QJsonObject &message, const QByteArray &payload = QByteArray());
+    void handleBlobRequest(const QJsonObject &message);
+    void handleBlobData(const QJsonObject &header, const QByteArray &payload);
+    void handleReconcileDiff(const QJsonObject &message);
+    void handleImageMips(const QJsonObject &message);
     
     void sendImageAdd(ImageItem *item);
-    void sendImageUpdate(ImageItem *item);
+    void sendImageUpdate(ImageItem *item, bool live = false);
     void sendImageRemove(const QString &id);
     void sendTextAdd(TextItem *item);
-    void sendTextUpdate(TextItem *item);
+    void sendTextUpdate(TextItem *item, bool live = false);
+    void sendUpdate(QJsonObject &message, const QString &itemId, bool live);
     void sendTextRemove(const QString &id);
+    void sendTextEdit(const QString &textId);
+    void resetText(TextItem *item, const QString &text, qint64 rev);
+    void pushItems(const QList<ImageItem*> &imageItems, const QList<TextItem*> &textItems);
+    void stampOutgoing(QJsonObject &message, const QString &itemId);
+    QJsonObject changedFields(const QString &itemId, const QJsonObject &fields) const;
+    void noteSynced(const QString &itemId, const QJsonObject &fields);
+    void applyImageFields(ImageItem *item, const QJsonObject &fields);
+    void applyTextFields(TextItem *item, const QJsonObject &fields);
+    BoardDigest localDigest();
+    
+    QByteArray encodeImage(ImageItem *item, bool *isGif);
+    QByteArray encodePreview(const QImage &image) const;
+    bool holdsImage(ImageItem *item) const;
+    const ImageBlob &blobForItem(ImageItem *item);
+    static void announceBlob(QJsonObject &meta, const ImageBlob &blob);
+    bool placeImage(const QJsonObject &meta, BlobFetch *fetch);
+    bool placePreview(const QJsonObject &meta, const QString &hash);
+    QString mipFor(const QJsonObject &meta) const;
+    void addMips(const QString &imageId, const QJsonObject &mips, BlobFetch *fetch);
+    void fetchForZoom();
+    bool upgradeImage(ImageItem *item, const QByteArray &imageData, bool isGif);
+    void requestBlobs(BlobFetch fetch);
+    void sendViewport();
+    bool addImageFromData(const QString &imageId, const QByteArray &imageData, bool isGif,
+                          const QPointF &pos, qreal rotation, qreal scale);
+    QString gifPath(const QByteArray &imageData);
     
     QColor generateUserColor() const;
     
@@ -98,14 +191,50 @@ private:
     QColor m_localColor;
     QHash<QString, Collaborator> m_collaborators;
     
+    // Image bytes by content hash (cached on disk across sessions), and
+    // which hash each item uses
+    BlobCache m_blobs;
+    QHash<QString, ImageBlob> m_imageBlobs;
+    // Announced images waiting for their blob to arrive
+    QHash<QString, QJsonObject> m_pendingImages;   // imageId -> announce
+    QHash<QString, QStringList> m_blobWaiters;     // blobHash -> imageIds
+    QHash<QString, QStringList> m_previewWaiters;  // previewHash or mip -> imageIds
+    QSet<QString> m_requestedBlobs;
+    // Received images decode off the GUI thread behind a placeholder
+    ImageDecoder *m_decoder;
+    
+    // Every property is a last-writer-wins register; edits carry Lamport
+    // stamps and only ever overwrite older ones, so all peers settle on
+    // the same board whatever order the ops reach them in
+    LamportClock m_clock;
+    LwwTable m_lww;
+    // Property values as last sent or received, so updates carry only
+    // the registers that actually changed
+    QHash<QString, QJsonObject> m_syncedFields;
+    
+    // Texts travel as character edits once the server can order them
+    QHash<QString, TextSync> m_textSync;
+    
+    QRectF m_viewport;
+    qreal m_viewportZoom;
+    
     QTimer *m_cursorThrottle;
-    QTimer *m_syncTimer;
     QPointF m_pendingCursorPos;
     bool m_hasPendingCursor;
     
+    // Transforms during a drag go out at most once per tick as droppable
+    // live updates; the final state is sent sequenced on release
+    QTimer *m_transformTimer;
+    QSet<QString> m_dirtyImages;    // Changed since the last tick
+    QSet<QString> m_dirtyTexts;
+    QSet<QString> m_liveImages;     // Touched during the current interaction
+    QSet<QString> m_liveTexts;
+    
     bool m_isSyncing;
+    bool m_pushPending;     // Push local state once the join has synced
     
     static constexpr int CURSOR_THROTTLE_MS = 50;
+    static constexpr int TRANSFORM_RATE_HZ = 60;
 };
 
 #endif // COLLABMANAGER_H
@@ -0,0 +1,512 @@
+#include "ConnectionAcceptor.h"
+#include "ClientConnection.h"
+#include "FrameCodec.h"
+#include "Room.h"
+#include "JournalWriter.h"
+#include "DiskBlobStore.h"
+#include "PresenceRelay.h"
+#ifdef COLLABREF_SERVER_IMAGING
+#include "MipGenerator.h"
+#endif
+#include "TrafficStats.h"
+#include <QWebSocket>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QUuid>
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QRegularExpression>
+#include <QDebug>
+
+ConnectionAcceptor::ConnectionAcceptor(const ServerConfig &config, QObject *parent)
+    : QObject(parent)
+    , m_server(nullptr)
+    , m_config(config)
+    , m_admitTimer(new QTimer(this))
+    , m_joinTokens(qMax(1, config.joinsPerSecond))
+    , m_joinTokensAt(QDateTime::currentMSecsSinceEpoch())
+    , m_journalThread(nullptr)
+    , m_journal(nullptr)
+    , m_blobs(nullptr)
+    , m_presence(nullptr)
+    , m_mips(nullptr)
+    , m_udpPort(0)
+    , m_saveTimer(new QTimer(this))
+    , m_idleTimer(new QTimer(this))
+    , m_clientCount(0)
+{
+    connect(m_saveTimer, &QTimer::timeout, this, &ConnectionAcceptor::saveAll);
+    connect(m_idleTimer, &QTimer::timeout, this, &ConnectionAcceptor::unloadIdleRooms);
+    m_admitTimer->setSingleShot(true);
+    connect(m_admitTimer, &QTimer::timeout, this, &ConnectionAcceptor::admitJoins);
+    
+    // Without persistence nothing touches the disk, blobs included
+    if (m_config.persistence == ServerConfig::Persistence::None) {
+        m_config.saveFilePath.clear();
+    }
+}
+
+ConnectionAcceptor::~ConnectionAcceptor()
+{
+    shutdown();
+}
+
+bool ConnectionAcceptor::listen(quint16 port, QString *error)
+{
+    m_server = new QWebSocketServer("CollabRef Server",
+                                     QWebSocketServer::NonSecureMode, this);
+    
+    if (!m_server->listen(QHostAddress::Any, port)) {
+        if (error) {
+            *error = m_server->errorString();
+        }
+        delete m_server;
+        m_server = nullptr;
+        return false;
+    }
+    
+    connect(m_server, &QWebSocketServer::newConnection,
+            this, &ConnectionAcceptor::onNewConnection);
+    
+    // Optional: without it presence simply stays on the WebSockets
+    if (m_config.udpPort >= 0) {
+        m_presence = new PresenceRelay(&m_traffic, this);
+        QString udpError;
+        quint16 udpPort = m_config.udpPort > 0 ? quint16(m_config.udpPort) : m_server->serverPort();
+        if (m_presence->bind(udpPort, &udpError)) {
+            m_udpPort = m_presence->port();
+            connect(m_presence, &PresenceRelay::fallback,
+                    this, &ConnectionAcceptor::relayFallback);
+        } else {
+            qWarning() << "No UDP presence channel on port" << udpPort << udpError;
+            delete m_presence;
+            m_presence = nullptr;
+        }
+    }
+    
+    // Rooms persist through the journal, so it has to be up first
+    m_journalThread = new QThread(this);
+    m_journalThread->setObjectName("CollabRef journal");
+    m_journal = new JournalWriter;
+    m_journal->moveToThread(m_journalThread);
+    m_journalThread->start();
+    
+    // Image bytes go next to the save files, shared by all rooms
+    QString blobRoot;
+    if (!m_config.saveFilePath.isEmpty()) {
+        blobRoot = QFileInfo(m_config.saveFilePath).dir().filePath("blobs");
+    }
+    m_blobs = new DiskBlobStore(blobRoot, m_journal);
+    
+#ifdef COLLABREF_SERVER_IMAGING
+    if (m_config.mipThreads >= 0) {
+        m_mips = new MipGenerator(m_blobs, m_config.mipThreads, this);
+        connect(m_mips, &MipGenerator::generated, this, &ConnectionAcceptor::mipsGenerated);
+    }
+#endif
+    
+    // Drop blobs of images deleted in earlier runs, off the accept thread
+    DiskBlobStore *blobs = m_blobs;
+    QStringList files = stateFiles();
+    QMetaObject::invokeMethod(m_journal, [blobs, files]() {
+        blobs->collectGarbage(files, BLOB_GC_MIN_AGE_MS);
+    }, Qt::QueuedConnection);
+    
+    // Leave a core for the host's own UI unless told otherwise
+    int workerCount = m_config.workers > 0
+        ? m_config.workers
+        : qBound(1, QThread::idealThreadCount() - 1, MAX_WORKERS);
+    for (int i = 0; i < workerCount; ++i) {
+        QThread *worker = new QThread(this);
+        worker->setObjectName(QString("CollabRef room worker %1").arg(i));
+        worker->start();
+        m_workers.append(worker);
+    }
+    
+    // Rooms load their state from disk when first joined
+    if (!m_config.saveFilePath.isEmpty()) {
+        m_saveTimer->start(qMax(1000, m_config.saveIntervalMs));
+    }
+    m_idleTimer->start(qMin(60000, qMax(1000, m_config.roomIdleMs)));
+    return true;
+}
+
+void ConnectionAcceptor::shutdown()
+{
+    if (!m_server) return;
+    
+    m_saveTimer->stop();
+    m_idleTimer->stop();
+    m_admitTimer->stop();
+    m_admitQueue.clear();
+    
+    for (ClientConnection *client : m_pending) {
+        QObject::disconnect(client->socket(), nullptr, this, nullptr);
+        client->socket()->abort();
+        delete client;
+    }
+    m_pending.clear();
+    m_joining.clear();
+    
+    // Each room saves and closes its clients on its own thread
+    for (Room *r : m_rooms) {
+        QMetaObject::invokeMethod(r, [r]() {
+            r->shutdown();
+            delete r;
+        }, Qt::BlockingQueuedConnection);
+    }
+    m_rooms.clear();
+    
+    for (QThread *worker : m_workers) {
+        worker->quit();
+        worker->wait();
+        delete worker;
+    }
+    m_workers.clear();
+    
+    // Rooms queued their final snapshots; wait for them to hit the disk
+#ifdef COLLABREF_SERVER_IMAGING
+    // Its jobs write into the blob store
+    delete m_mips;
+#endif
+    m_mips = nullptr;
+    
+    m_journal->sync();
+    m_journalThread->quit();
+    m_journalThread->wait();
+    delete m_journal;
+    delete m_journalThread;
+    delete m_blobs;
+    delete m_presence;
+    m_journal = nullptr;
+    m_journalThread = nullptr;
+    m_blobs = nullptr;
+    m_presence = nullptr;
+    m_udpPort = 0;
+    m_clientCount = 0;
+    
+    m_server->close();
+    delete m_server;
+    m_server = nullptr;
+}
+
+quint16 ConnectionAcceptor::port() const
+{
+    return m_server ? m_server->serverPort() : 0;
+}
+
+void ConnectionAcceptor::onNewConnection()
+{
+    QWebSocket *socket = m_server->nextPendingConnection();
+    if (!socket) return;
+    
+    QString clientId = QUuid::createUuid().toString(QUuid::WithoutBraces).left(8);
+    ClientConnection *client = new ClientConnection(socket, clientId);
+    client->setTraffic(&m_traffic);
+    m_pending.append(client);
+    m_clientCount++;
+    
+    connect(socket, &QWebSocket::textMessageReceived, this, [this, client](const QString &message) {
+        QByteArray utf8 = message.toUtf8();
+        QJsonDocument doc = QJsonDocument::fromJson(utf8);
+        if (doc.isObject()) {
+            m_traffic.record(TrafficStats::Inbound, doc.object()["type"].toString(),
+                             client->clientId(), utf8.size());
+            handlePreJoin(client, doc.object(), QByteArray());
+        }
+    });
+    connect(socket, &QWebSocket::binaryMessageReceived, this, [this, client](const QByteArray &message) {
+        QJsonObject header;
+        QByteArray payload;
+        if (FrameCodec::decode(message, &header, &payload)) {
+            m_traffic.record(TrafficStats::Inbound, header["type"].toString(),
+                             client->clientId(), message.size());
+            handlePreJoin(client, header, payload);
+        }
+    });
+    connect(socket, &QWebSocket::disconnected, this, [this, client]() {
+        m_pending.removeAll(client);
+        m_joining.remove(client);
+        m_admitQueue.removeAll(client);
+        clientLeft(client->clientId());
+        client->deleteLater();
+    });
+    
+    emit clientConnected(clientId);
+}
+
+void ConnectionAcceptor::handlePreJoin(ClientConnection *client, const QJsonObject &msg,
+                                       const QByteArray &payload)
+{
+    // Joined already; keep what follows for the room
+    auto joining = m_joining.find(client);
+    if (joining != m_joining.end()) {
+        joining->messages.append(msg);
+        joining->payloads.append(payload);
+        return;
+    }
+    
+    if (msg["type"].toString() == "ping") {
+        QJsonObject pong = Room::pong(msg);
+        client->enqueue(QJsonDocument(pong).toJson(QJsonDocument::Compact), false, "pong");
+        return;
+    }
+    
+    if (msg["type"].toString() != "join") {
+        // Client must join a room first
+        QJsonObject error;
+        error["type"] = "error";
+        error["message"] = "Must join a room first";
+        client->enqueue(QJsonDocument(error).toJson(QJsonDocument::Compact), false, "error");
+        return;
+    }
+    
+    // Messages sent while it waits its turn are kept for the room as well
+    m_joining.insert(client, {msg, {}, {}});
+    m_admitQueue.append(client);
+    admitJoins();
+}
+
+void ConnectionAcceptor::admitJoins()
+{
+    int rate = m_config.joinsPerSecond;
+    if (rate > 0) {
+        // Refill for the time since the last admission, a second's worth at most
+        qint64 now = QDateTime::currentMSecsSinceEpoch();
+        m_joinTokens = qMin<double>(rate, m_joinTokens + (now - m_joinTokensAt) * rate / 1000.0);
+        m_joinTokensAt = now;
+    }
+    
+    while (!m_admitQueue.isEmpty() && (rate <= 0 || m_joinTokens >= 1)) {
+        ClientConnection *client = m_admitQueue.takeFirst();
+        if (rate > 0) {
+            m_joinTokens -= 1;
+        }
+        // The socket may be mid-emit; move it once control is back in the event loop
+        QMetaObject::invokeMethod(this, [this, client]() {
+            finishJoin(client);
+        }, Qt::QueuedConnection);
+    }
+    
+    // Come back when the next token is due
+    if (!m_admitQueue.isEmpty() && !m_admitTimer->isActive()) {
+        m_admitTimer->start(qMax(1, int((1 - m_joinTokens) * 1000 / rate) + 1));
+    }
+}
+
+void ConnectionAcceptor::finishJoin(ClientConnection *client)
+{
+    auto joining = m_joining.find(client);
+    if (joining == m_joining.end()) return;   // Disconnected in the meantime
+    
+    PendingJoin pending = joining.value();
+    m_joining.erase(joining);
+    m_pending.removeAll(client);
+    QObject::disconnect(client->socket(), nullptr, this, nullptr);
+    
+    Room *target = assignRoom(client, pending.joinMsg);
+    if (!target) return;
+    
+    QMetaObject::invokeMethod(target, [target, client, pending]() {
+        for (int i = 0; i < pending.messages.size(); ++i) {
+            target->handleMessage(client, pending.messages[i], pending.payloads[i]);
+        }
+    }, Qt::QueuedConnection);
+}
+
+void ConnectionAcceptor::routeJoin(ClientConnection *client, const QJsonObject &msg)
+{
+    assignRoom(client, msg);
+}
+
+Room *ConnectionAcceptor::assignRoom(ClientConnection *client, const QJsonObject &msg)
+{
+    client->setBinaryFrames(msg["features"].toArray().contains("binary"));
+    
+    QString roomId = msg["roomId"].toString();
+    if (roomId.isEmpty()) {
+        roomId = DEFAULT_ROOM;
+    }
+    
+    // Limits are checked on the way in; clients already inside stay
+    Room *target = m_rooms.value(roomId);
+    if (!target && m_config.maxRooms > 0 && m_rooms.size() >= m_config.maxRooms) {
+        reject(client, "Server is hosting the maximum number of rooms");
+        return nullptr;
+    }
+    if (target && m_config.maxClientsPerRoom > 0 &&
+        target->memberCount() >= m_config.maxClientsPerRoom) {
+        reject(client, "Room is full");
+        return nullptr;
+    }
+    
+    target = room(roomId);
+    target->reserve();
+    if (m_presence) {
+        client->setUdpToken(m_presence->addClient(client->clientId(), roomId));
+    }
+    
+    // From here on the client's socket is serviced by the room's worker
+    client->moveToThread(target->thread());
+    QMetaObject::invokeMethod(target, [target, client, msg]() {
+        target->attach(client, msg);
+    }, Qt::QueuedConnection);
+    return target;
+}
+
+void ConnectionAcceptor::reject(ClientConnection *client, const QString &reason)
+{
+    QJsonObject error;
+    error["type"] = "error";
+    error["message"] = reason;
+    client->enqueue(QJsonDocument(error).toJson(QJsonDocument::Compact), false, "error");
+    
+    QWebSocket *socket = client->socket();
+    if (socket->state() != QAbstractSocket::ConnectedState) {
+        clientLeft(client->clientId());
+        client->deleteLater();
+        return;
+    }
+    // Pending again, so a shutdown before the close completes cleans it up
+    m_pending.append(client);
+    connect(socket, &QWebSocket::disconnected, this, [this, client]() {
+        m_pending.removeAll(client);
+        clientLeft(client->clientId());
+        client->deleteLater();
+    });
+    socket->close(QWebSocketProtocol::CloseCodePolicyViolated, reason);
+}
+
+void ConnectionAcceptor::clientLeft(const QString &clientId)
+{
+    if (m_presence) {
+        m_presence->removeClient(clientId);
+    }
+    m_clientCount--;
+    m_traffic.forgetPeer(clientId);
+    emit clientDisconnected(clientId);
+}
+
+void ConnectionAcceptor::setUdpReceiving(const QString &clientId, bool receiving)
+{
+    if (m_presence) {
+        m_presence->setReceiving(clientId, receiving);
+    }
+}
+
+void ConnectionAcceptor::generateMips(const QString &hash)
+{
+#ifdef COLLABREF_SERVER_IMAGING
+    if (m_mips) {
+        m_mips->generate(hash);
+    }
+#else
+    Q_UNUSED(hash)
+#endif
+}
+
+void ConnectionAcceptor::relayFallback(const QString &roomId, const QJsonObject &message,
+                                       const QSet<QString> &reached)
+{
+    Room *target = m_rooms.value(roomId);
+    if (!target || reached.size() >= target->memberCount()) return;
+    
+    QMetaObject::invokeMethod(target, [target, message, reached]() {
+        target->relayPresence(message, reached);
+    }, Qt::QueuedConnection);
+}
+
+Room *ConnectionAcceptor::room(const QString &roomId)
+{
+    Room *existing = m_rooms.value(roomId);
+    if (existing) return existing;
+    
+    Room *created = new Room(roomId, saveFileForRoom(roomId), this);
+    created->moveToThread(leastLoadedWorker());
+    QMetaObject::invokeMethod(created, [created]() {
+        created->loadState();
+    }, Qt::QueuedConnection);
+    
+    m_rooms.insert(roomId, created);
+    return created;
+}
+
+QThread *ConnectionAcceptor::leastLoadedWorker() const
+{
+    QHash<QThread*, int> load;
+    for (Room *r : m_rooms) {
+        load[r->thread()]++;
+    }
+    
+    QThread *best = m_workers.first();
+    for (QThread *worker : m_workers) {
+        if (load.value(worker) < load.value(best)) {
+            best = worker;
+        }
+    }
+    return best;
+}
+
+void ConnectionAcceptor::unloadIdleRooms()
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    
+    for (auto it = m_rooms.begin(); it != m_rooms.end(); ) {
+        Room *idle = it.value();
+        if (idle->isIdle(now, m_config.roomIdleMs)) {
+            // Blocking, so its final snapshot is queued before the room
+            // could be loaded again
+            QMetaObject::invokeMethod(idle, [idle]() {
+                idle->shutdown();
+                delete idle;
+            }, Qt::BlockingQueuedConnection);
+            it = m_rooms.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void ConnectionAcceptor::saveAll()
+{
+    for (Room *r : m_rooms) {
+        QMetaObject::invokeMethod(r, [r]() { r->saveState(); }, Qt::QueuedConnection);
+    }
+}
+
+QString ConnectionAcceptor::saveFileForRoom(const QString &roomId) const
+{
+    if (m_config.saveFilePath.isEmpty()) return QString();
+    if (roomId == DEFAULT_ROOM) return m_config.saveFilePath;
+    
+    // shared_board.json -> shared_board.<room>.json in the same folder;
+    // ids that aren't filename-safe get a hash suffix to stay unique
+    QString safeId = roomId;
+    safeId.replace(QRegularExpression("[^A-Za-z0-9_-]"), "_");
+    safeId.truncate(64);
+    if (safeId != roomId) {
+        safeId += "-" + QString::fromLatin1(QCryptographicHash::hash(
+            roomId.toUtf8(), QCryptographicHash::Sha1).toHex().left(8));
+    }
+    
+    QFileInfo info(m_config.saveFilePath);
+    return info.dir().filePath(QString("%1.%2.%3")
+        .arg(info.completeBaseName(), safeId, info.suffix()));
+}
+
+QStringList ConnectionAcceptor::stateFiles() const
+{
+    if (m_config.saveFilePath.isEmpty()) return QStringList();
+    
+    // Every room's snapshot and log: shared_board.json, shared_board.*.json(.wal)
+    QFileInfo info(m_config.saveFilePath);
+    QDir dir = info.dir();
+    QStringList files;
+    const QStringList names = dir.entryList({info.completeBaseName() + ".*"}, QDir::Files);
+    for (const QString &name : names) {
+        files.append(dir.filePath(name));
+    }
+    return files;
+}
@@ -0,0 +1,125 @@
+#ifndef CONNECTIONACCEPTOR_H
+#define CONNECTIONACCEPTOR_H
+
+#include <QObject>
+#include <QWebSocketServer>
+#include <QList>
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+#include <QJsonObject>
+#include <QTimer>
+#include <QThread>
+#include <atomic>
+#include "ServerConfig.h"
+#include "TrafficStats.h"
+
+class ClientConnection;
+class Room;
+class JournalWriter;
+class DiskBlobStore;
+class PresenceRelay;
+class MipGenerator;
+
+// Runs on SyncServer's accept thread. Owns the listening socket, holds new
+// connections until they join, and hands each joined client (socket and
+// all) over to its room, which lives on one of a pool of worker threads.
+// Everything here except clientCount() must be called on the accept thread.
+class ConnectionAcceptor : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ConnectionAcceptor(const ServerConfig &config, QObject *parent = nullptr);
+    ~ConnectionAcceptor();
+
+    bool listen(quint16 port, QString *error);
+    void shutdown();
+    quint16 port() const;
+    
+    // Safe to call from any thread
+    int clientCount() const { return m_clientCount.load(); }
+    TrafficStats *traffic() { return &m_traffic; }
+    const ServerConfig &config() const { return m_config; }
+    
+    void saveAll();
+    // Shared by all rooms; lives on its own thread
+    JournalWriter *journal() const { return m_journal; }
+    DiskBlobStore *blobs() const { return m_blobs; }
+    QString saveFileForRoom(const QString &roomId) const;
+    // Where clients send presence datagrams; 0 without UDP. Set by listen().
+    quint16 udpPort() const { return m_udpPort; }
+    // Whether generateMips() does anything; set by listen()
+    bool generatesMips() const { return m_mips != nullptr; }
+    
+    // Invoked (queued) by rooms
+    void routeJoin(ClientConnection *client, const QJsonObject &msg);
+    void clientLeft(const QString &clientId);
+    // What the client says about the presence datagrams reaching it
+    void setUdpReceiving(const QString &clientId, bool receiving);
+    // Smaller copies of an image blob; mipsGenerated() follows
+    void generateMips(const QString &hash);
+
+signals:
+    void clientConnected(const QString &clientId);
+    void clientDisconnected(const QString &clientId);
+    // mips maps each level to the hash of its bytes, see MipGenerator
+    void mipsGenerated(const QString &hash, const QJsonObject &mips);
+
+private slots:
+    void onNewConnection();
+    void unloadIdleRooms();
+    void admitJoins();
+    void relayFallback(const QString &roomId, const QJsonObject &message,
+                       const QSet<QString> &reached);
+
+private:
+    // Messages that arrive between a join and the hand-off to the room
+    struct PendingJoin {
+        QJsonObject joinMsg;
+        QList<QJsonObject> messages;
+        QList<QByteArray> payloads;
+    };
+    
+    void handlePreJoin(ClientConnection *client, const QJsonObject &msg, const QByteArray &payload);
+    void finishJoin(ClientConnection *client);
+    Room *assignRoom(ClientConnection *client, const QJsonObject &msg);
+    // Sends the reason and closes; the client is forgotten once it's gone
+    void reject(ClientConnection *client, const QString &reason);
+    Room *room(const QString &roomId);
+    QThread *leastLoadedWorker() const;
+    QStringList stateFiles() const;
+
+    QWebSocketServer *m_server;
+    ServerConfig m_config;
+    
+    QList<ClientConnection*> m_pending;             // Connected, not in a room yet
+    QHash<ClientConnection*, PendingJoin> m_joining;
+    
+    // Joins are let through a token bucket, so a crowd reconnecting after
+    // a restart gets its snapshots in turn instead of all at once
+    QList<ClientConnection*> m_admitQueue;          // Joined, waiting for a token
+    QTimer *m_admitTimer;
+    double m_joinTokens;
+    qint64 m_joinTokensAt;
+    
+    QHash<QString, Room*> m_rooms;
+    QList<QThread*> m_workers;
+    QThread *m_journalThread;
+    JournalWriter *m_journal;
+    DiskBlobStore *m_blobs;
+    PresenceRelay *m_presence;
+    MipGenerator *m_mips;       // Null in builds without QtGui, or when turned off
+    quint16 m_udpPort;
+    
+    QTimer *m_saveTimer;
+    QTimer *m_idleTimer;
+    std::atomic<int> m_clientCount;
+    TrafficStats m_traffic;
+    
+    static constexpr const char *DEFAULT_ROOM = "main";
+    static constexpr int MAX_WORKERS = 8;
+    static constexpr qint64 BLOB_GC_MIN_AGE_MS = 60 * 60 * 1000;
+};
+
+#endif // CONNECTIONACCEPTOR_H
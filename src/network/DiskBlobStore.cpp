@@ -0,0 +1,113 @@
+#include "DiskBlobStore.h"
+#include "BlobStore.h"
+#include "JournalWriter.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QSet>
+#include <QMutexLocker>
+#include <QRegularExpression>
+
+DiskBlobStore::DiskBlobStore(const QString &rootDir, JournalWriter *writer)
+    : m_root(rootDir)
+    , m_writer(writer)
+{
+}
+
+QString DiskBlobStore::insert(const QByteArray &data)
+{
+    QString hash = BlobStore::hashOf(data);
+    insert(hash, data);
+    return hash;
+}
+
+bool DiskBlobStore::insert(const QString &hash, const QByteArray &data)
+{
+    if (!isValidHash(hash) || data.isEmpty()) return false;
+    if (contains(hash)) return true;
+    if (BlobStore::hashOf(data) != hash) return false;
+    
+    {
+        QMutexLocker locker(&m_mutex);
+        m_pending.insert(hash, data);
+    }
+    if (m_root.isEmpty()) return true;
+    
+    // Stays in memory if the write fails, so at least this run can serve it
+    m_writer->writeFile(pathFor(hash), data, [this, hash](bool written) {
+        if (!written) return;
+        QMutexLocker locker(&m_mutex);
+        m_pending.remove(hash);
+    });
+    return true;
+}
+
+bool DiskBlobStore::contains(const QString &hash) const
+{
+    if (!isValidHash(hash)) return false;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_pending.contains(hash)) return true;
+    }
+    return !m_root.isEmpty() && QFileInfo::exists(pathFor(hash));
+}
+
+QByteArray DiskBlobStore::value(const QString &hash) const
+{
+    if (!isValidHash(hash)) return QByteArray();
+    {
+        QMutexLocker locker(&m_mutex);
+        auto it = m_pending.constFind(hash);
+        if (it != m_pending.constEnd()) return it.value();
+    }
+    if (m_root.isEmpty()) return QByteArray();
+    
+    QFile file(pathFor(hash));
+    if (!file.open(QIODevice::ReadOnly)) return QByteArray();
+    return file.readAll();
+}
+
+void DiskBlobStore::collectGarbage(const QStringList &stateFiles, qint64 minAgeMs)
+{
+    if (m_root.isEmpty()) return;
+    
+    // Hashes are only ever stored as "blobHash" values or log blob records;
+    // a textual scan finds them without parsing whole boards
+    static const QRegularExpression hashPattern("[0-9a-f]{64}");
+    QSet<QString> live;
+    for (const QString &path : stateFiles) {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) continue;
+        
+        QString text = QString::fromUtf8(file.readAll());
+        QRegularExpressionMatchIterator matches = hashPattern.globalMatch(text);
+        while (matches.hasNext()) {
+            live.insert(matches.next().captured(0));
+        }
+    }
+    
+    QDateTime cutoff = QDateTime::currentDateTime().addMSecs(-minAgeMs);
+    QDirIterator it(m_root, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        QString path = it.next();
+        QFileInfo info = it.fileInfo();
+        if (!isValidHash(info.fileName()) || live.contains(info.fileName())) continue;
+        if (info.lastModified() > cutoff) continue;
+        
+        QFile::remove(path);
+    }
+}
+
+bool DiskBlobStore::isValidHash(const QString &hash)
+{
+    // Hashes come from clients and become file names
+    static const QRegularExpression pattern("^[0-9a-f]{64}$");
+    return pattern.match(hash).hasMatch();
+}
+
+QString DiskBlobStore::pathFor(const QString &hash) const
+{
+    return QString("%1/%2/%3").arg(m_root, hash.left(2), hash);
+}
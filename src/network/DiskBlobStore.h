@@ -0,0 +1,48 @@
+#ifndef DISKBLOBSTORE_H
+#define DISKBLOBSTORE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QMutex>
+
+class JournalWriter;
+
+// The server's image bytes, one file per blob under <root>/ab/<hash>, shared
+// by every room. Rooms only keep hashes; bytes are read back from disk (or
+// the page cache) when a client asks for them, so memory use doesn't grow
+// with the size of the boards. New blobs are written by the journal thread
+// and served from memory until they are on disk. An empty root keeps
+// everything in memory.
+//
+// Thread-safe.
+class DiskBlobStore
+{
+public:
+    DiskBlobStore(const QString &rootDir, JournalWriter *writer);
+
+    // Stores data under its own hash and returns the hash
+    QString insert(const QByteArray &data);
+    // Stores data received for an announced hash; rejects mismatches
+    bool insert(const QString &hash, const QByteArray &data);
+
+    bool contains(const QString &hash) const;
+    QByteArray value(const QString &hash) const;
+    
+    // Deletes blob files no state file mentions. Files younger than minAgeMs
+    // are kept, their ops may not be logged yet. Runs on the journal thread.
+    void collectGarbage(const QStringList &stateFiles, qint64 minAgeMs);
+
+private:
+    static bool isValidHash(const QString &hash);
+    QString pathFor(const QString &hash) const;
+    
+    QString m_root;
+    JournalWriter *m_writer;
+    
+    mutable QMutex m_mutex;
+    QHash<QString, QByteArray> m_pending;     // Not on disk (yet)
+};
+
+#endif // DISKBLOBSTORE_H
@@ -0,0 +1,43 @@
+#include "FrameCodec.h"
+
+#include <QJsonDocument>
+#include <QtEndian>
+
+QByteArray FrameCodec::encode(const QJsonObject &header, const QByteArray &payload)
+{
+    QByteArray headerData = QJsonDocument(header).toJson(QJsonDocument::Compact);
+
+    QByteArray frame;
+    frame.reserve(PREFIX_SIZE + headerData.size() + payload.size());
+
+    uchar prefix[PREFIX_SIZE];
+    qToBigEndian<quint32>(static_cast<quint32>(headerData.size()), prefix);
+    frame.append(reinterpret_cast<const char*>(prefix), PREFIX_SIZE);
+    frame.append(headerData);
+    frame.append(payload);
+
+    return frame;
+}
+
+bool FrameCodec::decode(const QByteArray &frame, QJsonObject *header, QByteArray *payload)
+{
+    if (frame.size() < PREFIX_SIZE) return false;
+
+    quint32 headerSize = qFromBigEndian<quint32>(
+        reinterpret_cast<const uchar*>(frame.constData()));
+    if (headerSize > MAX_HEADER_SIZE ||
+        static_cast<qint64>(headerSize) > frame.size() - PREFIX_SIZE) {
+        return false;
+    }
+
+    QJsonDocument doc = QJsonDocument::fromJson(frame.mid(PREFIX_SIZE, headerSize));
+    if (!doc.isObject()) return false;
+
+    if (header) {
+        *header = doc.object();
+    }
+    if (payload) {
+        *payload = frame.mid(PREFIX_SIZE + headerSize);
+    }
+    return true;
+}
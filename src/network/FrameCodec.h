@@ -0,0 +1,26 @@
+#ifndef FRAMECODEC_H
+#define FRAMECODEC_H
+
+#include <QByteArray>
+#include <QJsonObject>
+
+// Binary WebSocket frame layout:
+//   quint32 (big endian)  length of the JSON header
+//   header                compact UTF-8 JSON object, always carries "type"
+//   payload               raw bytes (image data), may be empty
+class FrameCodec
+{
+public:
+    static QByteArray encode(const QJsonObject &header,
+                             const QByteArray &payload = QByteArray());
+    static bool decode(const QByteArray &frame, QJsonObject *header,
+                       QByteArray *payload);
+
+private:
+    FrameCodec() = default;
+
+    static constexpr int PREFIX_SIZE = 4;
+    static constexpr quint32 MAX_HEADER_SIZE = 64 * 1024 * 1024;
+};
+
+#endif // FRAMECODEC_H
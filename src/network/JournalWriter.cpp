@@ -0,0 +1,162 @@
+#include "JournalWriter.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QSaveFile>
+#include <QHash>
+#include <QThread>
+#include <QMutexLocker>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+// QFile::flush() only reaches the OS; make the log survive a power loss
+void syncToDisk(QFile &file)
+{
+#ifdef Q_OS_WIN
+    _commit(file.handle());
+#else
+    fsync(file.handle());
+#endif
+}
+
+QByteArray readAll(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return QByteArray();
+    return file.readAll();
+}
+
+} // namespace
+
+JournalWriter::JournalWriter(QObject *parent)
+    : QObject(parent)
+    , m_drainScheduled(false)
+{
+}
+
+void JournalWriter::append(const QString &walPath, const QByteArray &record)
+{
+    enqueue({JobKind::Append, walPath, record, QString(), nullptr, nullptr});
+}
+
+void JournalWriter::compact(const QString &snapshotPath, const QString &walPath,
+                            const QByteArray &walHeader,
+                            std::function<QByteArray()> buildSnapshot)
+{
+    enqueue({JobKind::Compact, walPath, walHeader, snapshotPath,
+             std::move(buildSnapshot), nullptr});
+}
+
+void JournalWriter::writeFile(const QString &path, const QByteArray &data,
+                              std::function<void(bool)> done)
+{
+    enqueue({JobKind::WriteFile, path, data, QString(), nullptr, std::move(done)});
+}
+
+void JournalWriter::load(const QString &snapshotPath, const QString &walPath,
+                         QByteArray *snapshot, QByteArray *wal)
+{
+    sync();
+    *snapshot = readAll(snapshotPath);
+    *wal = readAll(walPath);
+}
+
+void JournalWriter::sync()
+{
+    if (QThread::currentThread() == thread()) {
+        drain();
+        return;
+    }
+    QMetaObject::invokeMethod(this, [this]() { drain(); }, Qt::BlockingQueuedConnection);
+}
+
+void JournalWriter::enqueue(Job job)
+{
+    QMutexLocker locker(&m_mutex);
+    m_jobs.append(std::move(job));
+    
+    // Whatever else arrives before the writer gets to it joins the batch
+    if (!m_drainScheduled) {
+        m_drainScheduled = true;
+        QMetaObject::invokeMethod(this, [this]() { drain(); }, Qt::QueuedConnection);
+    }
+}
+
+void JournalWriter::drain()
+{
+    QList<Job> jobs;
+    {
+        QMutexLocker locker(&m_mutex);
+        jobs.swap(m_jobs);
+        m_drainScheduled = false;
+    }
+    if (jobs.isEmpty()) return;
+    
+    QHash<QString, QByteArray> batches;
+    QList<QString> order;
+    
+    // Files land before the log batch, so a logged op never refers to a
+    // file that isn't on disk yet
+    for (const Job &job : jobs) {
+        switch (job.kind) {
+        case JobKind::Append:
+            if (!batches.contains(job.path)) {
+                order.append(job.path);
+            }
+            batches[job.path].append(job.data);
+            break;
+            
+        case JobKind::Compact:
+            // Snapshot first: if it fails the old log still holds everything
+            if (!writeAtomically(job.snapshotPath, job.buildSnapshot())) break;
+            
+            // Snapshot-only rooms have no log to restart
+            if (job.path.isEmpty()) break;
+            
+            batches.remove(job.path);
+            order.removeAll(job.path);
+            writeLog(job.path, job.data, true);
+            break;
+            
+        case JobKind::WriteFile: {
+            QDir().mkpath(QFileInfo(job.path).absolutePath());
+            bool written = writeAtomically(job.path, job.data);
+            if (job.done) {
+                job.done(written);
+            }
+            break;
+        }
+        }
+    }
+    
+    for (const QString &walPath : order) {
+        writeLog(walPath, batches.value(walPath), false);
+    }
+}
+
+bool JournalWriter::writeAtomically(const QString &path, const QByteArray &data)
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) return false;
+    
+    file.write(data);
+    return file.commit();
+}
+
+bool JournalWriter::writeLog(const QString &walPath, const QByteArray &data, bool truncate)
+{
+    QFile file(walPath);
+    QIODevice::OpenMode mode = QIODevice::WriteOnly |
+        (truncate ? QIODevice::Truncate : QIODevice::Append);
+    if (!file.open(mode)) return false;
+    
+    bool ok = file.write(data) == data.size() && file.flush();
+    syncToDisk(file);
+    return ok;
+}
@@ -0,0 +1,65 @@
+#ifndef JOURNALWRITER_H
+#define JOURNALWRITER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QString>
+#include <QList>
+#include <QMutex>
+#include <functional>
+
+// Persistence for room state, run on its own thread so disk I/O never
+// stalls a room. Every room mutation is appended to the room's write-ahead
+// log; records queued while a write is in progress are written and synced
+// together (group commit). A compaction writes a fresh snapshot and starts
+// the log over, so a write costs what changed, not the board size.
+//
+// append(), compact() and writeFile() may be called from any thread and
+// are applied in call order.
+class JournalWriter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit JournalWriter(QObject *parent = nullptr);
+
+    // record must be one complete line, newline included
+    void append(const QString &walPath, const QByteArray &record);
+    // Replaces snapshotPath with what buildSnapshot() returns (run on the
+    // writer thread) and restarts walPath with walHeader. Records appended
+    // before this call are covered by the snapshot and dropped.
+    void compact(const QString &snapshotPath, const QString &walPath,
+                 const QByteArray &walHeader, std::function<QByteArray()> buildSnapshot);
+    // Atomically writes a standalone file, creating its folder; done() runs
+    // on the writer thread with whether the file made it to disk
+    void writeFile(const QString &path, const QByteArray &data, std::function<void(bool)> done);
+    
+    // Blocks until everything queued so far is on disk, then reads both files
+    void load(const QString &snapshotPath, const QString &walPath,
+              QByteArray *snapshot, QByteArray *wal);
+    // Blocks until everything queued so far is on disk
+    void sync();
+
+private:
+    enum class JobKind { Append, Compact, WriteFile };
+    
+    struct Job {
+        JobKind kind;
+        QString path;           // Log, or the standalone file
+        QByteArray data;        // Log record, new log header or file contents
+        QString snapshotPath;
+        std::function<QByteArray()> buildSnapshot;
+        std::function<void(bool)> done;
+    };
+    
+    void enqueue(Job job);
+    void drain();
+    static bool writeAtomically(const QString &path, const QByteArray &data);
+    static bool writeLog(const QString &walPath, const QByteArray &data, bool truncate);
+    
+    QMutex m_mutex;
+    QList<Job> m_jobs;
+    bool m_drainScheduled;
+};
+
+#endif // JOURNALWRITER_H
@@ -0,0 +1,167 @@
+#include "LatencyStats.h"
+
+#include <QJsonArray>
+#include <algorithm>
+#include <cmath>
+
+LatencyHistogram::LatencyHistogram()
+    : m_buckets(bounds().size() + 1, 0)
+{
+}
+
+const QVector<qint64> &LatencyHistogram::bounds()
+{
+    static const QVector<qint64> bounds = {
+        5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000
+    };
+    return bounds;
+}
+
+void LatencyHistogram::record(qint64 ms)
+{
+    // Slightly off clocks can put a fast op before its send
+    ms = qMax<qint64>(ms, 0);
+    
+    const QVector<qint64> &limits = bounds();
+    int bucket = std::lower_bound(limits.begin(), limits.end(), ms) - limits.begin();
+    m_buckets[bucket]++;
+    m_count++;
+    m_sum += ms;
+    m_max = qMax(m_max, ms);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other)
+{
+    for (int i = 0; i < m_buckets.size(); ++i) {
+        m_buckets[i] += other.m_buckets[i];
+    }
+    m_count += other.m_count;
+    m_sum += other.m_sum;
+    m_max = qMax(m_max, other.m_max);
+}
+
+double LatencyHistogram::mean() const
+{
+    return m_count > 0 ? double(m_sum) / m_count : 0.0;
+}
+
+qint64 LatencyHistogram::percentile(double p) const
+{
+    if (m_count == 0) return 0;
+    
+    qint64 rank = qMax<qint64>(1, qint64(std::ceil(p * m_count)));
+    qint64 seen = 0;
+    const QVector<qint64> &limits = bounds();
+    for (int i = 0; i < limits.size(); ++i) {
+        seen += m_buckets[i];
+        if (seen >= rank) return qMin(limits[i], m_max);
+    }
+    return m_max;
+}
+
+QJsonObject LatencyHistogram::toJson() const
+{
+    QJsonArray buckets;
+    for (qint64 count : m_buckets) {
+        buckets.append(count);
+    }
+    
+    QJsonObject json;
+    json["count"] = m_count;
+    json["mean"] = mean();
+    json["p50"] = percentile(0.5);
+    json["p95"] = percentile(0.95);
+    json["max"] = m_max;
+    json["buckets"] = buckets;
+    return json;
+}
+
+void LatencyStats::addPong(qint64 sentAt, qint64 serverTime, qint64 receivedAt)
+{
+    qint64 rtt = qMax<qint64>(receivedAt - sentAt, 0);
+    // The server answered halfway through the round trip, give or take
+    qint64 offset = serverTime - (sentAt + rtt / 2);
+    
+    if (m_recent.isEmpty()) {
+        m_rtt = rtt;
+        m_rttVariation = rtt / 2.0;
+    } else {
+        m_rttVariation += VARIATION_GAIN * (std::abs(m_rtt - rtt) - m_rttVariation);
+        m_rtt += RTT_GAIN * (rtt - m_rtt);
+    }
+    
+    m_recent.append(Sample{rtt, offset});
+    if (m_recent.size() > OFFSET_WINDOW) {
+        m_recent.removeFirst();
+    }
+}
+
+qint64 LatencyStats::clockOffset() const
+{
+    if (m_recent.isEmpty()) return 0;
+    
+    auto fastest = std::min_element(m_recent.begin(), m_recent.end(),
+                                    [](const Sample &a, const Sample &b) {
+        return a.rtt < b.rtt;
+    });
+    return fastest->offset;
+}
+
+void LatencyStats::recordDelivery(const QString &type, qint64 latencyMs)
+{
+    m_histograms[type].record(latencyMs);
+}
+
+QStringList LatencyStats::types() const
+{
+    QStringList types = m_histograms.keys();
+    types.sort();
+    return types;
+}
+
+QString LatencyStats::summary() const
+{
+    if (!hasEstimate()) return QString("No round trip measured yet");
+    
+    QStringList lines;
+    lines << QString("Round trip: %1 ms (±%2)")
+                 .arg(qRound(m_rtt)).arg(qRound(m_rttVariation));
+    lines << QString("Clock offset to server: %1%2 ms")
+                 .arg(clockOffset() >= 0 ? "+" : "").arg(clockOffset());
+    
+    if (!m_histograms.isEmpty()) {
+        lines << QString() << QString("Send to apply (p50 / p95, count):");
+        for (const QString &type : types()) {
+            const LatencyHistogram histogram = m_histograms.value(type);
+            lines << QString("  %1: %2 / %3 ms (%4)")
+                         .arg(type)
+                         .arg(histogram.percentile(0.5))
+                         .arg(histogram.percentile(0.95))
+                         .arg(histogram.count());
+        }
+    }
+    return lines.join('\n');
+}
+
+QJsonObject LatencyStats::toJson() const
+{
+    QJsonObject delivery;
+    for (auto it = m_histograms.constBegin(); it != m_histograms.constEnd(); ++it) {
+        delivery[it.key()] = it.value().toJson();
+    }
+    
+    QJsonObject json;
+    json["rtt"] = m_rtt;
+    json["rttVariation"] = m_rttVariation;
+    json["clockOffset"] = clockOffset();
+    json["delivery"] = delivery;
+    return json;
+}
+
+void LatencyStats::reset()
+{
+    m_recent.clear();
+    m_rtt = 0;
+    m_rttVariation = 0;
+    m_histograms.clear();
+}
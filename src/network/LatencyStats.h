@@ -0,0 +1,86 @@
+#ifndef LATENCYSTATS_H
+#define LATENCYSTATS_H
+
+#include <QHash>
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Latencies counted into fixed millisecond buckets, roughly doubling in
+// width, so percentiles stay cheap no matter how many were recorded
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void record(qint64 ms);
+    // Adds in another histogram's samples, e.g. to sum up many clients
+    void merge(const LatencyHistogram &other);
+    qint64 count() const { return m_count; }
+    qint64 max() const { return m_max; }
+    double mean() const;
+    // Upper bound of the bucket holding the p-th fraction (0..1) of the
+    // samples; the largest sample once it's past the last bound
+    qint64 percentile(double p) const;
+    QJsonObject toJson() const;
+
+    // Upper bucket bounds in ms; one more bucket holds everything above
+    static const QVector<qint64> &bounds();
+
+private:
+    QVector<qint64> m_buckets;
+    qint64 m_count = 0;
+    qint64 m_sum = 0;
+    qint64 m_max = 0;
+};
+
+// How the link to the server behaves, as seen from one client: a smoothed
+// round trip and its jitter (the way TCP estimates them), the offset of
+// the server's clock against ours, and per message type how long ops take
+// from a peer's send to being applied here. Senders stamp ops in server
+// time, so the last needs no clock agreement between the peers themselves.
+class LatencyStats
+{
+public:
+    LatencyStats() = default;
+
+    // A ping sent at sentAt (local ms since epoch) that the server answered
+    // at serverTime (its clock) and that came back at receivedAt
+    void addPong(qint64 sentAt, qint64 serverTime, qint64 receivedAt);
+    bool hasEstimate() const { return !m_recent.isEmpty(); }
+    double rtt() const { return m_rtt; }
+    double rttVariation() const { return m_rttVariation; }
+    // Server clock minus ours
+    qint64 clockOffset() const;
+    qint64 toServerTime(qint64 localMs) const { return localMs + clockOffset(); }
+
+    void recordDelivery(const QString &type, qint64 latencyMs);
+    QStringList types() const;
+    LatencyHistogram histogram(const QString &type) const { return m_histograms.value(type); }
+
+    // Human-readable report, one line per figure
+    QString summary() const;
+    QJsonObject toJson() const;
+    void reset();
+
+private:
+    struct Sample {
+        qint64 rtt;
+        qint64 offset;
+    };
+
+    // Offsets come from the fastest of the last few pings: the less time
+    // a ping spent in flight, the less asymmetry can skew its offset
+    QList<Sample> m_recent;
+    double m_rtt = 0;
+    double m_rttVariation = 0;
+    QHash<QString, LatencyHistogram> m_histograms;
+
+    static constexpr double RTT_GAIN = 0.125;
+    static constexpr double VARIATION_GAIN = 0.25;
+    static constexpr int OFFSET_WINDOW = 8;
+};
+
+#endif // LATENCYSTATS_H
@@ -0,0 +1,110 @@
+#include "MipGenerator.h"
+#include "DiskBlobStore.h"
+#include <QBuffer>
+#include <QImage>
+#include <QImageReader>
+#include <QList>
+#include <QThread>
+
+MipGenerator::MipGenerator(DiskBlobStore *blobs, int threads, QObject *parent)
+    : QObject(parent)
+    , m_blobs(blobs)
+{
+    // Decoding shares the cores with the rooms
+    m_pool.setMaxThreadCount(threads > 0 ? threads : qMax(1, QThread::idealThreadCount() / 2));
+}
+
+MipGenerator::~MipGenerator()
+{
+    // Queued results die with this object; running jobs only have to end
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+void MipGenerator::generate(const QString &hash)
+{
+    auto done = m_done.constFind(hash);
+    if (done != m_done.constEnd()) {
+        emit generated(hash, done.value());
+        return;
+    }
+    if (m_running.contains(hash) || !m_blobs->contains(hash)) return;
+    m_running.insert(hash);
+    
+    DiskBlobStore *blobs = m_blobs;
+    m_pool.start([this, blobs, hash]() {
+        QJsonObject mips;
+        bool read = build(blobs, hash, &mips);
+        QMetaObject::invokeMethod(this, [this, hash, mips, read]() {
+            finish(hash, mips, read);
+        }, Qt::QueuedConnection);
+    });
+}
+
+bool MipGenerator::build(DiskBlobStore *blobs, const QString &hash, QJsonObject *mips)
+{
+    QByteArray data = blobs->value(hash);
+    if (data.isEmpty()) return false;
+    
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+    
+    QImageReader reader(&buffer);
+    reader.setAutoTransform(true);
+    // Animations are shown from the full file; formats that can't tell
+    // their size without decoding are rare enough to leave alone
+    if (reader.supportsAnimation() && reader.imageCount() > 1) return true;
+    QSize size = reader.size();
+    if (!size.isValid()) return true;
+    
+    QList<int> levels;
+    for (int level : LEVELS) {
+        if (level < qMax(size.width(), size.height())) {
+            levels.append(level);
+        }
+    }
+    if (levels.isEmpty()) return true;
+    
+    // JPEG decodes at a fraction of its size for the asking; the rest
+    // are scaled down by the reader. Rotation keeps the long edge.
+    int largest = levels.last();
+    reader.setScaledSize(size.scaled(largest, largest, Qt::KeepAspectRatio));
+    QImage image = reader.read();
+    if (image.isNull()) return true;
+    
+    // Each level from the one above it, largest first
+    for (int i = levels.size() - 1; i >= 0; --i) {
+        int level = levels[i];
+        if (qMax(image.width(), image.height()) > level) {
+            image = image.scaled(level, level, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        }
+        
+        // JPEG is far smaller, but would turn transparency black
+        QByteArray encoded;
+        QBuffer out(&encoded);
+        out.open(QIODevice::WriteOnly);
+        if (image.hasAlphaChannel()) {
+            image.save(&out, "PNG");
+        } else {
+            image.save(&out, "JPG", JPEG_QUALITY);
+        }
+        
+        // No smaller than the original: clients may as well fetch that
+        if (encoded.isEmpty() || encoded.size() >= data.size()) continue;
+        mips->insert(QString::number(level), blobs->insert(encoded));
+    }
+    return true;
+}
+
+void MipGenerator::finish(const QString &hash, const QJsonObject &mips, bool read)
+{
+    m_running.remove(hash);
+    // Unreadable right now is not the same as no mips; a later request retries
+    if (!read) return;
+    
+    if (m_done.size() >= DONE_LIMIT) {
+        m_done.clear();
+    }
+    m_done.insert(hash, mips);
+    emit generated(hash, mips);
+}
@@ -0,0 +1,53 @@
+#ifndef MIPGENERATOR_H
+#define MIPGENERATOR_H
+
+#include <QObject>
+#include <QHash>
+#include <QJsonObject>
+#include <QSet>
+#include <QString>
+#include <QThreadPool>
+
+class DiskBlobStore;
+
+// Smaller copies of the images in the blob store, for clients that show
+// an image at a fraction of its size: one per level below the image's own
+// long edge, stored as blobs of their own. Each blob is decoded once, on a
+// thread pool and straight at the largest level where the format allows,
+// and what came of it is remembered so rooms sharing the blob don't decode
+// it again. Lives on the accept thread.
+class MipGenerator : public QObject
+{
+    Q_OBJECT
+
+public:
+    MipGenerator(DiskBlobStore *blobs, int threads, QObject *parent = nullptr);
+    ~MipGenerator();
+
+    // Queues the blob unless it is done or under way; generated() follows
+    void generate(const QString &hash);
+
+    static constexpr int LEVELS[] = { 128, 512, 2048 };    // Long edges, in pixels
+
+signals:
+    // mips maps each level (as a string) to the hash of its bytes; empty
+    // for images too small for any level, animations and undecodable data,
+    // which is an answer too: there is nothing to make for them
+    void generated(const QString &hash, const QJsonObject &mips);
+
+private:
+    // False when the blob's bytes couldn't be read at all
+    static bool build(DiskBlobStore *blobs, const QString &hash, QJsonObject *mips);
+    void finish(const QString &hash, const QJsonObject &mips, bool read);
+
+    DiskBlobStore *m_blobs;
+    QThreadPool m_pool;
+    QSet<QString> m_running;
+    // Forgotten wholesale past DONE_LIMIT; rooms keep theirs in their state
+    QHash<QString, QJsonObject> m_done;
+
+    static constexpr int DONE_LIMIT = 20000;
+    static constexpr int JPEG_QUALITY = 85;
+};
+
+#endif // MIPGENERATOR_H
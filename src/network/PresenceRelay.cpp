@@ -0,0 +1,145 @@
+#include "PresenceRelay.h"
+#include "TrafficStats.h"
+#include <QUdpSocket>
+#include <QNetworkDatagram>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QUuid>
+
+PresenceRelay::PresenceRelay(TrafficStats *traffic, QObject *parent)
+    : QObject(parent)
+    , m_socket(new QUdpSocket(this))
+    , m_traffic(traffic)
+{
+    connect(m_socket, &QUdpSocket::readyRead, this, &PresenceRelay::onReadyRead);
+}
+
+bool PresenceRelay::bind(quint16 port, QString *error)
+{
+    if (!m_socket->bind(QHostAddress::Any, port)) {
+        if (error) {
+            *error = m_socket->errorString();
+        }
+        return false;
+    }
+    return true;
+}
+
+quint16 PresenceRelay::port() const
+{
+    return m_socket->state() == QAbstractSocket::BoundState ? m_socket->localPort() : 0;
+}
+
+QString PresenceRelay::addClient(const QString &clientId, const QString &roomId)
+{
+    QString token = m_tokens.value(clientId);
+    if (token.isEmpty()) {
+        token = QUuid::createUuid().toString(QUuid::WithoutBraces);
+        m_tokens.insert(clientId, token);
+    }
+    
+    Peer &peer = m_peers[token];
+    if (!peer.roomId.isEmpty()) {
+        m_rooms[peer.roomId].remove(token);
+    }
+    peer.clientId = clientId;
+    peer.roomId = roomId;
+    peer.confirmedAt = 0;       // Its welcome restarts the handshake
+    m_rooms[roomId].insert(token);
+    return token;
+}
+
+void PresenceRelay::removeClient(const QString &clientId)
+{
+    QString token = m_tokens.take(clientId);
+    if (token.isEmpty()) return;
+    
+    Peer peer = m_peers.take(token);
+    auto room = m_rooms.find(peer.roomId);
+    if (room != m_rooms.end()) {
+        room->remove(token);
+        if (room->isEmpty()) {
+            m_rooms.erase(room);
+        }
+    }
+}
+
+void PresenceRelay::setReceiving(const QString &clientId, bool receiving)
+{
+    auto it = m_peers.find(m_tokens.value(clientId));
+    if (it == m_peers.end()) return;
+    it->confirmedAt = receiving ? QDateTime::currentMSecsSinceEpoch() : 0;
+}
+
+bool PresenceRelay::isReachable(const Peer &peer, qint64 now)
+{
+    return !peer.address.isNull() && peer.confirmedAt > 0 &&
+           now - peer.confirmedAt <= CONFIRM_TIMEOUT_MS;
+}
+
+void PresenceRelay::onReadyRead()
+{
+    while (m_socket->hasPendingDatagrams()) {
+        QNetworkDatagram datagram = m_socket->receiveDatagram(MAX_DATAGRAM);
+        if (datagram.isValid()) {
+            handleDatagram(datagram.data(), datagram.senderAddress(),
+                           quint16(datagram.senderPort()));
+        }
+    }
+}
+
+void PresenceRelay::handleDatagram(const QByteArray &data, const QHostAddress &address,
+                                   quint16 port)
+{
+    QJsonDocument doc = QJsonDocument::fromJson(data);
+    if (!doc.isObject()) return;
+    QJsonObject msg = doc.object();
+    
+    auto it = m_peers.find(msg["token"].toString());
+    if (it == m_peers.end()) return;
+    Peer &sender = it.value();
+    QString type = msg["type"].toString();
+    m_traffic->record(TrafficStats::Inbound, type, sender.clientId, data.size());
+    
+    // Replies go wherever its datagrams come from, NAT mappings included
+    sender.address = address;
+    sender.port = port;
+    
+    if (type == "udpHello") {
+        QJsonObject ready;
+        ready["type"] = "udpReady";
+        send(ready, sender);
+        return;
+    }
+    bool live = msg["live"].toBool() && (type == "imageUpdate" || type == "textUpdate");
+    if (type != "cursor" && !live) return;
+    
+    // Overtaken in transit by a newer one
+    qint64 pseq = msg["pseq"].toVariant().toLongLong();
+    if (pseq <= sender.lastPseq) return;
+    sender.lastPseq = pseq;
+    
+    msg.remove("token");
+    msg["userId"] = sender.clientId;
+    
+    QSet<QString> reached;
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    const QSet<QString> tokens = m_rooms.value(sender.roomId);
+    for (const QString &token : tokens) {
+        const Peer &peer = m_peers[token];
+        if (peer.clientId == sender.clientId || !isReachable(peer, now)) continue;
+        send(msg, peer);
+        reached.insert(peer.clientId);
+    }
+    reached.insert(sender.clientId);
+    
+    emit fallback(sender.roomId, msg, reached);
+}
+
+void PresenceRelay::send(const QJsonObject &message, const Peer &peer)
+{
+    QByteArray data = QJsonDocument(message).toJson(QJsonDocument::Compact);
+    m_socket->writeDatagram(data, peer.address, peer.port);
+    m_traffic->record(TrafficStats::Outbound, message["type"].toString(), peer.clientId,
+                      data.size());
+}
@@ -0,0 +1,75 @@
+#ifndef PRESENCERELAY_H
+#define PRESENCERELAY_H
+
+#include <QObject>
+#include <QHash>
+#include <QHostAddress>
+#include <QJsonObject>
+#include <QSet>
+#include <QString>
+
+class QUdpSocket;
+class TrafficStats;
+
+// Cursor and live drag traffic over UDP, next to the WebSocket stream, so
+// presence keeps moving while a big image or snapshot holds up the socket.
+// Each joined client gets a token with its welcome; datagrams carrying it
+// are relayed to the other clients of its room that have confirmed, over
+// their WebSocket, that our datagrams reach them. Sending is no proof of
+// that: a firewall may pass a client's hellos and drop our replies. A
+// datagram older (by its sender's pseq) than one already relayed is
+// dropped rather than delivered late.
+//
+// Clients the datagrams can't reach are reported through fallback() for
+// the room to relay over their WebSocket. Lives on the accept thread.
+class PresenceRelay : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PresenceRelay(TrafficStats *traffic, QObject *parent = nullptr);
+
+    bool bind(quint16 port, QString *error);
+    quint16 port() const;
+
+    // Registers a client for its room (again, after a room switch) and
+    // returns its token
+    QString addClient(const QString &clientId, const QString &roomId);
+    void removeClient(const QString &clientId);
+    // The client's own report; expires unless renewed within CONFIRM_TIMEOUT_MS
+    void setReceiving(const QString &clientId, bool receiving);
+
+    static constexpr int MAX_DATAGRAM = 1200;   // Stays under common path MTUs
+    static constexpr qint64 CONFIRM_TIMEOUT_MS = 15000;    // Three of the clients' pings
+
+signals:
+    // message went out over UDP to the clients in reached; the rest of the
+    // room still needs it
+    void fallback(const QString &roomId, const QJsonObject &message,
+                  const QSet<QString> &reached);
+
+private slots:
+    void onReadyRead();
+
+private:
+    struct Peer {
+        QString clientId;
+        QString roomId;
+        QHostAddress address;   // Null until its first datagram
+        quint16 port = 0;
+        qint64 lastPseq = 0;
+        qint64 confirmedAt = 0;     // Last report of our datagrams arriving; 0 for none
+    };
+
+    void handleDatagram(const QByteArray &data, const QHostAddress &address, quint16 port);
+    void send(const QJsonObject &message, const Peer &peer);
+    static bool isReachable(const Peer &peer, qint64 now);
+
+    QUdpSocket *m_socket;
+    TrafficStats *m_traffic;
+    QHash<QString, Peer> m_peers;           // token -> peer
+    QHash<QString, QString> m_tokens;       // clientId -> token
+    QHash<QString, QSet<QString>> m_rooms;  // roomId -> tokens
+};
+
+#endif // PRESENCERELAY_H
@@ -0,0 +1,26 @@
+#include "ReconnectBackoff.h"
+#include <QRandomGenerator>
+#include <QtGlobal>
+
+ReconnectBackoff::ReconnectBackoff(int baseMs, int maxMs)
+    : m_baseMs(qMax(1, baseMs))
+    , m_maxMs(qMax(baseMs, maxMs))
+    , m_attempts(0)
+{
+}
+
+int ReconnectBackoff::nextDelay()
+{
+    // Doubling stops at the cap, so many attempts can't overflow it
+    qint64 ceiling = m_baseMs;
+    for (int i = 0; i < m_attempts && ceiling < m_maxMs; ++i) {
+        ceiling *= 2;
+    }
+    ceiling = qMin<qint64>(ceiling, m_maxMs);
+    m_attempts++;
+    
+    // Half is kept so attempts still spread out; the other half is jitter
+    int upper = int(ceiling);
+    int floor = upper / 2;
+    return floor + QRandomGenerator::global()->bounded(upper - floor + 1);
+}
@@ -0,0 +1,24 @@
+#ifndef RECONNECTBACKOFF_H
+#define RECONNECTBACKOFF_H
+
+// Delays between reconnect attempts: doubling from baseMs up to maxMs,
+// each picked at random from the upper half of its range. A server that
+// restarts then sees its clients come back spread out over time instead
+// of all at once on the same tick.
+class ReconnectBackoff
+{
+public:
+    explicit ReconnectBackoff(int baseMs = 1000, int maxMs = 60000);
+
+    // Delay before the next attempt; counts it
+    int nextDelay();
+    void reset() { m_attempts = 0; }
+    int attempts() const { return m_attempts; }
+
+private:
+    int m_baseMs;
+    int m_maxMs;
+    int m_attempts;
+};
+
+#endif // RECONNECTBACKOFF_H
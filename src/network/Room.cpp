@@ -0,0 +1,1252 @@
+#include "Room.h"
+#include "ClientConnection.h"
+#include "ConnectionAcceptor.h"
+#include "FrameCodec.h"
+#include "JournalWriter.h"
+#include "DiskBlobStore.h"
+#include "TransferPriority.h"
+#include "BoardDigest.h"
+#include "TrafficStats.h"
+#include <QUuid>
+#include <QJsonDocument>
+#include <QDateTime>
+#include <QTimer>
+#include <limits>
+
+Room::Room(const QString &roomId, const QString &saveFilePath, ConnectionAcceptor *hub)
+    : QObject(nullptr)
+    , m_roomId(roomId)
+    , m_saveFilePath(saveFilePath)
+    , m_hub(hub)
+    , m_journal(hub->journal())
+    , m_members(0)
+    , m_emptySince(QDateTime::currentMSecsSinceEpoch())
+    , m_blobs(hub->blobs())
+    , m_traffic(hub->traffic())
+    , m_clock(QStringLiteral("server"))
+    , m_seq(0)
+    , m_epoch(QUuid::createUuid().toString(QUuid::WithoutBraces))
+    , m_walRecords(0)
+    , m_walBytes(0)
+{
+    if (!m_saveFilePath.isEmpty() &&
+        hub->config().persistence == ServerConfig::Persistence::Journal) {
+        m_walPath = m_saveFilePath + ".wal";
+    }
+    
+    connect(hub, &ConnectionAcceptor::mipsGenerated, this, &Room::addMips);
+}
+
+bool Room::isIdle(qint64 now, qint64 idleMs) const
+{
+    qint64 since = m_emptySince.load();
+    return m_members.load() == 0 && since > 0 && now - since > idleMs;
+}
+
+void Room::attach(ClientConnection *client, const QJsonObject &joinMsg)
+{
+    QWebSocket *socket = client->socket();
+    
+    // Dropped while being handed over
+    if (socket->state() != QAbstractSocket::ConnectedState) {
+        onClientDisconnected(client);
+        return;
+    }
+    
+    connect(socket, &QWebSocket::textMessageReceived, this, [this, client](const QString &message) {
+        QByteArray utf8 = message.toUtf8();
+        QJsonDocument doc = QJsonDocument::fromJson(utf8);
+        if (doc.isObject()) {
+            m_traffic->record(TrafficStats::Inbound, doc.object()["type"].toString(),
+                              client->clientId(), utf8.size());
+            handleMessage(client, doc.object(), QByteArray());
+        }
+    });
+    connect(socket, &QWebSocket::binaryMessageReceived, this, [this, client](const QByteArray &message) {
+        QJsonObject header;
+        QByteArray payload;
+        if (FrameCodec::decode(message, &header, &payload)) {
+            m_traffic->record(TrafficStats::Inbound, header["type"].toString(),
+                              client->clientId(), message.size());
+            handleMessage(client, header, payload);
+        }
+    });
+    connect(socket, &QWebSocket::disconnected, this, [this, client]() {
+        onClientDisconnected(client);
+    });
+    // Queued: the signal can fire from inside enqueue()
+    connect(client, &ClientConnection::queueDrained, this, [this, client]() {
+        pumpBlobs(client->clientId());
+    }, Qt::QueuedConnection);
+    connect(client, &ClientConnection::flushed, this, [this, client]() {
+        if (m_syncsSending.remove(client->clientId())) {
+            pumpFullSyncs();
+        }
+    }, Qt::QueuedConnection);
+    
+    addClient(client, joinMsg);
+}
+
+void Room::onClientDisconnected(ClientConnection *client)
+{
+    QString clientId = client->clientId();
+    bool attached = m_clientsById.contains(clientId);
+    m_leaving.remove(client);
+    
+    if (attached) {
+        removeClient(clientId);
+    } else if (--m_members == 0) {
+        m_emptySince = QDateTime::currentMSecsSinceEpoch();
+    }
+    client->deleteLater();
+    
+    ConnectionAcceptor *hub = m_hub;
+    QMetaObject::invokeMethod(hub, [hub, clientId]() {
+        hub->clientLeft(clientId);
+    }, Qt::QueuedConnection);
+}
+
+void Room::handOff(ClientConnection *client, const QJsonObject &joinMsg)
+{
+    if (!m_leaving.remove(client)) return;  // Disconnected meanwhile
+    
+    removeClient(client->clientId());
+    QObject::disconnect(client->socket(), nullptr, this, nullptr);
+    QObject::disconnect(client, nullptr, this, nullptr);
+    
+    // Back to the accept thread, which routes it like a fresh join
+    ConnectionAcceptor *hub = m_hub;
+    client->moveToThread(hub->thread());
+    QMetaObject::invokeMethod(hub, [hub, client, joinMsg]() {
+        hub->routeJoin(client, joinMsg);
+    }, Qt::QueuedConnection);
+}
+
+void Room::shutdown()
+{
+    saveState();
+    
+    for (ClientConnection *client : m_clients) {
+        QObject::disconnect(client->socket(), nullptr, this, nullptr);
+        client->socket()->abort();
+        delete client;
+    }
+    m_clients.clear();
+    m_clientsById.clear();
+    m_users.clear();
+    m_leaving.clear();
+    m_members = 0;
+}
+
+void Room::addClient(ClientConnection *client, QJsonObject joinMsg)
+{
+    QString clientId = client->clientId();
+    
+    m_clients.append(client);
+    m_clientsById.insert(clientId, client);
+    m_emptySince = 0;
+    
+    QJsonObject user;
+    user["userId"] = clientId;
+    user["oderId"] = joinMsg["oderId"].toString();
+    user["userName"] = joinMsg["userName"].toString();
+    
+    // Tell the client what this server speaks
+    QJsonObject welcomeMsg;
+    welcomeMsg["type"] = "welcome";
+    welcomeMsg["clientId"] = clientId;
+    welcomeMsg["roomId"] = m_roomId;
+    QJsonArray features{ "binary", "blobs", "seq", "viewport", "reconcile", "textEdit" };
+    if (!client->udpToken().isEmpty()) {
+        features.append("udp");
+        welcomeMsg["udpPort"] = m_hub->udpPort();
+        welcomeMsg["udpToken"] = client->udpToken();
+    }
+    if (m_hub->generatesMips()) {
+        features.append("mips");
+    }
+    welcomeMsg["features"] = features;
+    sendToClient(clientId, welcomeMsg);
+    
+    // Only what the client missed since its last session, or a snapshot
+    sendCatchUp(clientId, joinMsg);
+    
+    // Broadcast join to others
+    joinMsg["userId"] = clientId;
+    broadcast(joinMsg, clientId);
+    
+    // Send user list to the joining client
+    QJsonObject userListMsg;
+    userListMsg["type"] = "userList";
+    QJsonArray users;
+    for (const QJsonObject &other : m_users) {
+        users.append(other);
+    }
+    userListMsg["users"] = users;
+    sendToClient(clientId, userListMsg);
+    
+    m_users.insert(clientId, user);
+}
+
+void Room::removeClient(const QString &clientId)
+{
+    ClientConnection *client = m_clientsById.take(clientId);
+    if (!client) return;
+    
+    m_clients.removeAll(client);
+    QJsonObject user = m_users.take(clientId);
+    m_blobQueues.remove(clientId);
+    for (QStringList &waiters : m_blobWaiters) {
+        waiters.removeAll(clientId);
+    }
+    m_syncQueue.removeAll(clientId);
+    if (m_syncsSending.remove(clientId)) {
+        pumpFullSyncs();
+    }
+    
+    if (--m_members == 0) {
+        m_emptySince = QDateTime::currentMSecsSinceEpoch();
+    }
+    
+    // Notify other clients
+    QJsonObject leaveMsg;
+    leaveMsg["type"] = "leave";
+    leaveMsg["userId"] = clientId;
+    leaveMsg["oderId"] = user["oderId"].toString();
+    broadcast(leaveMsg, clientId);
+}
+
+void Room::handleMessage(ClientConnection *client, QJsonObject msg, const QByteArray &payload)
+{
+    QString clientId = client->clientId();
+    QString type = msg["type"].toString();
+    
+    if (m_leaving.contains(client)) return;
+    
+    if (type == "join") {
+        // Rejoin (possibly another room): the socket is mid-emit, so move
+        // it once control is back in the event loop
+        m_leaving.insert(client);
+        QMetaObject::invokeMethod(this, [this, client, msg]() {
+            handOff(client, msg);
+        }, Qt::QueuedConnection);
+    }
+    else if (type == "ping") {
+        sendToClient(clientId, pong(msg));
+        if (msg.contains("udp")) {
+            reportUdp(clientId, msg["udp"].toBool());
+        }
+    }
+    else if (type == "udpStatus") {
+        reportUdp(clientId, msg["receiving"].toBool());
+    }
+    else if (type == "cursor") {
+        // Forward cursor updates to others
+        msg["userId"] = clientId;
+        broadcast(msg, clientId);
+    }
+    else if (type == "imageAdd") {
+        QByteArray imageData = payload;
+        if (imageData.isEmpty() && msg.contains("imageData")) {
+            // Older clients embed the image as base64
+            imageData = QByteArray::fromBase64(msg["imageData"].toString().toUtf8());
+        }
+        
+        // Peers only ever see the hash and fetch the bytes if they miss them
+        if (!storeImage(msg, imageData, clientId)) return;
+        // Ignored if the image already exists (from another client's sync)
+        stampOp(msg);
+        if (applyOp(msg)) {
+            commitOp(clientId, msg);
+            requestMips(msg["imageId"].toString());
+        }
+    }
+    else if ((type == "imageUpdate" || type == "textUpdate") && msg["live"].toBool()) {
+        // Mid-drag transforms are relayed only; the final update is sequenced
+        msg["userId"] = clientId;
+        broadcast(msg, clientId);
+    }
+    else if (type == "imageUpdate" || type == "imageRemove" ||
+             type == "textAdd" || type == "textUpdate" || type == "textRemove") {
+        // Apply to stored state and broadcast; unknown ids and edits that
+        // lose to newer ones are dropped
+        msg.remove("mips");
+        stampOp(msg);
+        if (applyOp(msg)) {
+            commitOp(clientId, msg);
+        }
+    }
+    else if (type == "textEdit") {
+        // Rebased onto the current text, then sequenced like any other op
+        QString textId = msg["textId"].toString();
+        if (!transformTextEdit(msg) || !applyOp(msg)) {
+            sendTextResync(clientId, textId);
+            return;
+        }
+        qint64 rev = msg["rev"].toVariant().toLongLong();
+        commitOp(clientId, msg);
+        
+        QJsonObject ack;
+        ack["type"] = "textAck";
+        ack["textId"] = textId;
+        ack["rev"] = rev;
+        sendToClient(clientId, ack);
+    }
+    else if (type == "requestSync") {
+        // Ops after sinceSeq if we still have them, otherwise a snapshot
+        sendCatchUp(clientId, msg);
+    }
+    else if (type == "pushSync") {
+        // Client is pushing their local state (after reconnect)
+        // Merge with existing state; anything new becomes a regular add op,
+        // newer edits to what we have become updates
+        QJsonArray clientImages = msg["images"].toArray();
+        QJsonArray clientTexts = msg["texts"].toArray();
+        QString oderId = msg["oderId"].toString();
+        
+        // Merge images
+        for (const QJsonValue &val : clientImages) {
+            QJsonObject img = val.toObject();
+            QJsonObject stamps = img.take("stamps").toObject();
+            
+            // Deleted here while the client was away: don't bring it back
+            QString imageId = img["imageId"].toString();
+            if (m_lww.isRemoved(imageId, LamportStamp::fromJson(img["stamp"]))) {
+                QJsonObject removal;
+                removal["type"] = "imageRemove";
+                removal["imageId"] = imageId;
+                removal["stamp"] = m_lww.tombstone(imageId).toJson();
+                sendToClient(clientId, removal);
+                continue;
+            }
+            
+            // Current clients send hashes only; older ones still inline the bytes
+            QByteArray imageData;
+            if (img.contains("dataOffset")) {
+                imageData = payload.mid(img["dataOffset"].toInt(), img["dataSize"].toInt());
+            } else if (img.contains("imageData")) {
+                imageData = QByteArray::fromBase64(img["imageData"].toString().toUtf8());
+            }
+            
+            // Also re-requests blobs we lost track of for images we already have
+            if (!storeImage(img, imageData, clientId)) continue;
+            if (m_state.hasImage(imageId)) {
+                img["oderId"] = oderId;
+                mergePushed(clientId, img, stamps, "imageId", "imageUpdate");
+                continue;
+            }
+            
+            img["type"] = "imageAdd";
+            img["oderId"] = oderId;
+            stampOp(img);
+            if (applyOp(img)) {
+                commitOp(clientId, img);
+                requestMips(imageId);
+            }
+        }
+        
+        // Merge texts
+        for (const QJsonValue &val : clientTexts) {
+            QJsonObject txt = val.toObject();
+            QJsonObject stamps = txt.take("stamps").toObject();
+            
+            QString textId = txt["textId"].toString();
+            if (m_lww.isRemoved(textId, LamportStamp::fromJson(txt["stamp"]))) {
+                QJsonObject removal;
+                removal["type"] = "textRemove";
+                removal["textId"] = textId;
+                removal["stamp"] = m_lww.tombstone(textId).toJson();
+                sendToClient(clientId, removal);
+                continue;
+            }
+            
+            if (m_state.hasText(textId)) {
+                txt["oderId"] = oderId;
+                mergePushed(clientId, txt, stamps, "textId", "textUpdate");
+                continue;
+            }
+            
+            txt["type"] = "textAdd";
+            txt["oderId"] = oderId;
+            stampOp(txt);
+            if (applyOp(txt)) {
+                commitOp(clientId, txt);
+            }
+        }
+    }
+    else if (type == "reconcile") {
+        // Compare hash trees; only buckets that differ are sent back
+        sendReconcileDiff(clientId, msg);
+    }
+    else if (type == "blobRequest") {
+        // Serve what we hold, park the rest until the owner uploads it
+        for (const QJsonValue &val : msg["hashes"].toArray()) {
+            QString hash = val.toString();
+            if (m_blobs->contains(hash)) {
+                queueBlob(clientId, hash);
+            } else if (!m_blobWaiters.value(hash).contains(clientId)) {
+                m_blobWaiters[hash].append(clientId);
+            }
+        }
+        pumpBlobs(clientId);
+    }
+    else if (type == "viewport") {
+        // What the client is looking at decides which blobs it gets first
+        ClientBlobs &blobs = m_blobQueues[clientId];
+        blobs.viewport = QRectF(msg["x"].toDouble(), msg["y"].toDouble(),
+                                msg["width"].toDouble(), msg["height"].toDouble());
+        blobs.zoom = msg["zoom"].toDouble(1.0);
+    }
+    else if (type == "blobData") {
+        handleBlobData(msg, payload);
+    }
+    else {
+        // Forward other messages
+        msg["userId"] = clientId;
+        broadcast(msg, clientId);
+    }
+}
+
+void Room::broadcast(const QJsonObject &message, const QString &excludeClientId)
+{
+    // Encode once per wire format; all recipients share the same buffer
+    QByteArray binaryFrame;
+    QByteArray textFrame;
+    QString text;
+    QString key = supersedeKey(message);
+    QString type = message["type"].toString();
+    
+    // Copy: a queue overflow may end up removing a client
+    const QList<ClientConnection*> clients = m_clients;
+    for (ClientConnection *client : clients) {
+        if (client->clientId() == excludeClientId) continue;
+        
+        if (client->binaryFrames()) {
+            if (binaryFrame.isNull()) {
+                binaryFrame = FrameCodec::encode(message);
+            }
+            client->enqueue(binaryFrame, true, type, key);
+        } else {
+            if (textFrame.isNull()) {
+                textFrame = QJsonDocument(message).toJson(QJsonDocument::Compact);
+                text = QString::fromUtf8(textFrame);
+            }
+            client->enqueue(textFrame, text, type, key);
+        }
+    }
+}
+
+QJsonObject Room::pong(const QJsonObject &ping)
+{
+    QJsonObject pong;
+    pong["type"] = "pong";
+    pong["t"] = ping["t"];
+    pong["serverTime"] = QDateTime::currentMSecsSinceEpoch();
+    return pong;
+}
+
+void Room::reportUdp(const QString &clientId, bool receiving)
+{
+    ConnectionAcceptor *hub = m_hub;
+    QMetaObject::invokeMethod(hub, [hub, clientId, receiving]() {
+        hub->setUdpReceiving(clientId, receiving);
+    }, Qt::QueuedConnection);
+}
+
+void Room::relayPresence(const QJsonObject &message, const QSet<QString> &reached)
+{
+    for (ClientConnection *client : m_clients) {
+        if (!reached.contains(client->clientId())) {
+            sendToClient(client->clientId(), message);
+        }
+    }
+}
+
+void Room::sendToClient(const QString &clientId, const QJsonObject &message)
+{
+    ClientConnection *client = m_clientsById.value(clientId);
+    if (!client) return;
+    
+    QString type = message["type"].toString();
+    if (client->binaryFrames()) {
+        client->enqueue(FrameCodec::encode(message), true, type, supersedeKey(message));
+    } else {
+        client->enqueue(QJsonDocument(message).toJson(QJsonDocument::Compact), false, type,
+                        supersedeKey(message));
+    }
+}
+
+QString Room::supersedeKey(const QJsonObject &message)
+{
+    // Only ephemeral state may be dropped for a lagging client; a newer
+    // message with the same key makes the queued one pointless
+    QString type = message["type"].toString();
+    if (type == "cursor") {
+        return "cursor:" + message["userId"].toString();
+    }
+    if (message["live"].toBool()) {
+        if (type == "imageUpdate") return "xf:image:" + message["imageId"].toString();
+        if (type == "textUpdate") return "xf:text:" + message["textId"].toString();
+    }
+    return QString();
+}
+
+bool Room::storeImage(QJsonObject &image, const QByteArray &data,
+                            const QString &clientId)
+{
+    image.remove("imageData");
+    image.remove("dataOffset");
+    image.remove("dataSize");
+    image.remove("userId");
+    image.remove("mips");       // Only the server makes those
+    
+    if (image["imageId"].toString().isEmpty()) return false;
+    
+    if (!data.isEmpty()) {
+        QString hash = m_blobs->insert(data);
+        image["blobHash"] = hash;
+        
+        // Someone may have been waiting for exactly these bytes
+        for (const QString &waiter : m_blobWaiters.take(hash)) {
+            queueBlob(waiter, hash);
+            pumpBlobs(waiter);
+        }
+        return true;
+    }
+    
+    QString hash = image["blobHash"].toString();
+    if (hash.isEmpty()) return false;
+    
+    // Hash-only announce for blobs we don't hold: fetch them from the
+    // announcer, preview first so others can show it sooner
+    QJsonArray missing;
+    for (const QString &wanted : {image["previewHash"].toString(), hash}) {
+        if (!wanted.isEmpty() && !m_blobs->contains(wanted)) {
+            missing.append(wanted);
+        }
+    }
+    if (!missing.isEmpty() && !clientId.isEmpty()) {
+        QJsonObject request;
+        request["type"] = "blobRequest";
+        request["hashes"] = missing;
+        sendToClient(clientId, request);
+    }
+    return true;
+}
+
+void Room::releaseImage(const QString &hash)
+{
+    // The file stays: other rooms may share it, and an undo may bring the
+    // image back. Unreferenced files are collected when the server starts.
+    auto it = m_blobRefs.find(hash);
+    if (it != m_blobRefs.end() && --it.value() <= 0) {
+        m_blobRefs.erase(it);
+    }
+}
+
+void Room::handleBlobData(const QJsonObject &msg, const QByteArray &payload)
+{
+    QString hash = msg["hash"].toString();
+    
+    // Ignore bytes nobody references or asked for
+    if (!m_blobRefs.contains(hash) && !m_blobWaiters.contains(hash)) return;
+    if (!m_blobs->insert(hash, payload)) return;
+    
+    for (const QString &waiter : m_blobWaiters.take(hash)) {
+        queueBlob(waiter, hash);
+        pumpBlobs(waiter);
+    }
+    
+    for (const ImageRecord &image : m_state.images()) {
+        if (image.blobHash == hash) {
+            requestMips(image.imageId);
+        }
+    }
+}
+
+void Room::requestMips(const QString &imageId)
+{
+    // Once per image, after its bytes are in; GIFs animate from the full file
+    auto it = m_state.images().constFind(imageId);
+    if (!m_hub->generatesMips() || it == m_state.images().constEnd() || it->isGif ||
+        it->extra.contains("mips") || !m_blobs->contains(it->blobHash)) {
+        return;
+    }
+    
+    ConnectionAcceptor *hub = m_hub;
+    QString hash = it->blobHash;
+    QMetaObject::invokeMethod(hub, [hub, hash]() {
+        hub->generateMips(hash);
+    }, Qt::QueuedConnection);
+}
+
+void Room::addMips(const QString &hash, const QJsonObject &mips)
+{
+    // Empty mips are recorded too, so images too small for any level
+    // aren't decoded again on every load
+    if (!m_blobRefs.contains(hash)) return;
+    
+    QStringList imageIds;
+    for (const ImageRecord &image : m_state.images()) {
+        if (image.blobHash == hash && !image.extra.contains("mips")) {
+            imageIds.append(image.imageId);
+        }
+    }
+    
+    // Sequenced like an edit, so snapshots, catch-up and the log carry it
+    for (const QString &imageId : imageIds) {
+        QJsonObject op;
+        op["type"] = "imageMips";
+        op["imageId"] = imageId;
+        op["mips"] = mips;
+        if (applyOp(op)) {
+            commitOp(QString(), op);
+        }
+    }
+}
+
+void Room::queueBlob(const QString &clientId, const QString &hash)
+{
+    QStringList &pending = m_blobQueues[clientId].pending;
+    if (!pending.contains(hash)) {
+        pending.append(hash);
+    }
+}
+
+void Room::pumpBlobs(const QString &clientId)
+{
+    ClientConnection *client = m_clientsById.value(clientId);
+    auto blobs = m_blobQueues.find(clientId);
+    if (!client || blobs == m_blobQueues.end()) return;
+    
+    // Only a small window is handed to the connection, so a viewport
+    // change reorders everything still waiting here
+    QHash<QString, qreal> priorities;
+    bool prioritized = false;
+    QStringList &pending = blobs->pending;
+    
+    while (!pending.isEmpty() && client->queuedBytes() < BLOB_WINDOW_BYTES) {
+        int next = 0;
+        if (blobs->viewport.isValid()) {
+            if (!prioritized) {
+                priorities = blobPriorities(blobs.value());
+                prioritized = true;
+            }
+            qreal best = std::numeric_limits<qreal>::max();
+            for (int i = 0; i < pending.size(); ++i) {
+                qreal score = priorities.value(pending[i], std::numeric_limits<qreal>::max());
+                if (score < best) {
+                    best = score;
+                    next = i;
+                }
+            }
+        }
+        sendBlob(clientId, pending.takeAt(next));
+    }
+}
+
+QHash<QString, qreal> Room::blobPriorities(const ClientBlobs &blobs) const
+{
+    QHash<QString, qreal> priorities;
+    auto consider = [&priorities](const QString &hash, qreal score) {
+        auto it = priorities.find(hash);
+        if (it == priorities.end()) {
+            priorities.insert(hash, score);
+        } else if (score < it.value()) {
+            it.value() = score;
+        }
+    };
+    
+    for (const ImageRecord &image : m_state.images()) {
+        QSizeF size(image.extra["width"].toDouble(), image.extra["height"].toDouble());
+        QRectF rect = TransferPriority::itemRect(image.x, image.y, size, image.scale);
+        const QJsonObject mips = image.extra["mips"].toObject();
+        bool hasPreview = !image.previewHash.isEmpty() || !mips.isEmpty();
+        
+        consider(image.blobHash, TransferPriority::score(rect, false, hasPreview,
+                                                         blobs.viewport, blobs.zoom,
+                                                         TransferPriority::standInSize(mips)));
+        if (!image.previewHash.isEmpty()) {
+            consider(image.previewHash, TransferPriority::score(rect, true, true,
+                                                                blobs.viewport, blobs.zoom));
+        }
+        // Mips stand in for the image like its preview does
+        for (auto it = mips.begin(); it != mips.end(); ++it) {
+            consider(it.value().toString(), TransferPriority::score(rect, true, true,
+                                                                    blobs.viewport, blobs.zoom));
+        }
+    }
+    return priorities;
+}
+
+void Room::sendBlob(const QString &clientId, const QString &hash)
+{
+    QJsonObject header;
+    header["type"] = "blobData";
+    header["hash"] = hash;
+    if (ClientConnection *client = m_clientsById.value(clientId)) {
+        client->enqueue(FrameCodec::encode(header, m_blobs->value(hash)), true, "blobData");
+    }
+}
+
+void Room::mergePushed(const QString &clientId, const QJsonObject &item,
+                       const QJsonObject &stamps, const QString &idKey,
+                       const QString &updateType)
+{
+    // One update per register, each with the stamp the client holds for
+    // it, so only what the client changed after we last did wins
+    QHash<QString, QJsonObject> byRegister;
+    for (auto it = item.constBegin(); it != item.constEnd(); ++it) {
+        QString reg = LwwTable::registerOf(it.key());
+        if (!reg.isEmpty() && stamps.contains(reg)) {
+            byRegister[reg].insert(it.key(), it.value());
+        }
+    }
+    
+    for (auto it = byRegister.begin(); it != byRegister.end(); ++it) {
+        QJsonObject op = it.value();
+        op["type"] = updateType;
+        op["oderId"] = item["oderId"];
+        op[idKey] = item[idKey];
+        op["stamp"] = stamps[it.key()];
+        if (LamportStamp::fromJson(op["stamp"]).isNull()) continue;
+        
+        stampOp(op);
+        if (applyOp(op)) {
+            commitOp(clientId, op);
+        }
+    }
+}
+
+void Room::stampOp(QJsonObject &op)
+{
+    LamportStamp stamp = LamportStamp::fromJson(op["stamp"]);
+    if (stamp.isNull()) {
+        // Older clients don't stamp; order their edits by arrival
+        op["stamp"] = m_clock.tick().toJson();
+    } else {
+        m_clock.observe(stamp);
+    }
+}
+
+bool Room::applyOp(QJsonObject &op)
+{
+    QString type = op["type"].toString();
+    LamportStamp stamp = LamportStamp::fromJson(op["stamp"]);
+    
+    // Updates keep only the properties they win, which is also what
+    // gets logged and broadcast
+    if (type == "imageAdd") {
+        QString imageId = op["imageId"].toString();
+        if (m_state.hasImage(imageId) || m_lww.isRemoved(imageId, stamp)) return false;
+        if (!m_state.addImage(op)) return false;
+        m_lww.merge(imageId, op, stamp);
+        m_blobRefs[op["blobHash"].toString()]++;
+        if (op.contains("previewHash")) {
+            m_blobRefs[op["previewHash"].toString()]++;
+        }
+        return true;
+    }
+    if (type == "imageUpdate") {
+        QString imageId = op["imageId"].toString();
+        if (!m_state.hasImage(imageId)) return false;
+        bool changed = false;
+        op = m_lww.merge(imageId, op, stamp, &changed);
+        return changed && m_state.updateImage(op);
+    }
+    if (type == "imageRemove") {
+        QString imageId = op["imageId"].toString();
+        ImageRecord removed;
+        if (!m_state.removeImage(imageId, &removed)) return false;
+        m_lww.remove(imageId, stamp);
+        releaseImage(removed.blobHash);
+        if (!removed.previewHash.isEmpty()) {
+            releaseImage(removed.previewHash);
+        }
+        return true;
+    }
+    if (type == "imageMips") {
+        // Derived from the image's bytes, not edited: nothing to stamp
+        QJsonObject update;
+        update["imageId"] = op["imageId"];
+        update["mips"] = op["mips"];
+        return m_state.hasImage(op["imageId"].toString()) && m_state.updateImage(update);
+    }
+    if (type == "textAdd") {
+        QString textId = op["textId"].toString();
+        if (m_state.hasText(textId) || m_lww.isRemoved(textId, stamp)) return false;
+        if (!m_state.addText(op)) return false;
+        m_lww.merge(textId, op, stamp);
+        return true;
+    }
+    if (type == "textUpdate") {
+        QString textId = op["textId"].toString();
+        if (!m_state.hasText(textId)) return false;
+        bool changed = false;
+        op = m_lww.merge(textId, op, stamp, &changed);
+        if (!changed) return false;
+        
+        // Replacing the whole text starts a new edit history
+        if (op.contains("text")) {
+            op["rev"] = m_state.texts().value(textId).rev + 1;
+            m_textHistory.remove(textId);
+        }
+        return m_state.updateText(op);
+    }
+    if (type == "textEdit") {
+        QString textId = op["textId"].toString();
+        qint64 rev = op["rev"].toVariant().toLongLong();
+        TextOperation edit;
+        if (!TextOperation::fromJson(op["op"].toArray(), &edit) ||
+            !m_state.editText(textId, edit, rev)) {
+            return false;
+        }
+        
+        TextHistory &history = m_textHistory[textId];
+        if (history.ops.isEmpty()) {
+            history.baseRev = rev - 1;
+        }
+        history.ops.append(edit);
+        while (history.ops.size() > TEXT_HISTORY_LIMIT) {
+            history.ops.removeFirst();
+            history.baseRev++;
+        }
+        return true;
+    }
+    if (type == "textRemove") {
+        QString textId = op["textId"].toString();
+        if (!m_state.removeText(textId)) return false;
+        m_lww.remove(textId, stamp);
+        m_textHistory.remove(textId);
+        return true;
+    }
+    return false;
+}
+
+void Room::logOp(const QJsonObject &op)
+{
+    QString type = op["type"].toString();
+    if (type == "imageRemove") {
+        m_tombstoneSeqs.insert(op["imageId"].toString(), op["seq"].toVariant().toLongLong());
+    } else if (type == "textRemove") {
+        m_tombstoneSeqs.insert(op["textId"].toString(), op["seq"].toVariant().toLongLong());
+    }
+    
+    m_opLog.append(op);
+    while (m_opLog.size() > OP_LOG_LIMIT) {
+        m_opLog.removeFirst();
+    }
+}
+
+void Room::commitOp(const QString &clientId, QJsonObject op)
+{
+    op["seq"] = ++m_seq;
+    op["userId"] = clientId;
+    
+    logOp(op);
+    journal(op);
+    if (m_seq % TOMBSTONE_PRUNE_OPS == 0) {
+        pruneTombstones();
+    }
+    
+    // Keep replay short and the log from growing without bound. Only
+    // after an op, so a blob logged ahead of its image isn't cut off.
+    if (!m_walPath.isEmpty() &&
+        (m_walRecords >= COMPACT_RECORDS || m_walBytes >= COMPACT_BYTES)) {
+        compact();
+    }
+    
+    broadcast(op, clientId);
+    
+    // The sender already applied it locally; it only needs the number
+    QJsonObject ack;
+    ack["type"] = "ack";
+    ack["seq"] = m_seq;
+    sendToClient(clientId, ack);
+}
+
+void Room::sendCatchUp(const QString &clientId, const QJsonObject &request)
+{
+    qint64 sinceSeq = request["sinceSeq"].toVariant().toLongLong();
+    qint64 oldestSeq = m_opLog.isEmpty()
+        ? m_seq + 1
+        : m_opLog.first()["seq"].toVariant().toLongLong();
+    
+    // Unknown numbering, or fell behind the log horizon: snapshot instead
+    if (!request.contains("sinceSeq") || request["epoch"].toString() != m_epoch ||
+        sinceSeq > m_seq || sinceSeq + 1 < oldestSeq) {
+        queueFullSync(clientId);
+        return;
+    }
+    
+    QJsonArray ops;
+    for (const QJsonObject &op : m_opLog) {
+        if (op["seq"].toVariant().toLongLong() > sinceSeq) {
+            ops.append(op);
+        }
+    }
+    
+    QJsonObject catchUp;
+    catchUp["type"] = "catchUp";
+    catchUp["epoch"] = m_epoch;
+    catchUp["seq"] = m_seq;
+    catchUp["ops"] = ops;
+    sendToClient(clientId, catchUp);
+}
+
+void Room::sendReconcileDiff(const QString &clientId, const QJsonObject &request)
+{
+    BoardDigest digest;
+    for (const ImageRecord &image : m_state.images()) {
+        digest.addImage(image.imageId, image.blobHash, m_lww.latest(image.imageId));
+    }
+    for (const TextRecord &text : m_state.texts()) {
+        digest.addText(text.textId, text.text, m_lww.latest(text.textId));
+    }
+    
+    QSet<int> differing;
+    if (request["root"].toString() != digest.root()) {
+        QJsonArray theirs = request["buckets"].toArray();
+        QStringList ours = digest.bucketHashes();
+        for (int i = 0; i < BoardDigest::BUCKET_COUNT; ++i) {
+            if (theirs.at(i).toString() != ours.at(i)) {
+                differing.insert(i);
+            }
+        }
+    }
+    
+    // Our side of each differing bucket, so the client can tell what it
+    // lacks and what only it has
+    QJsonObject stamps;
+    QJsonArray images;
+    for (const ImageRecord &image : m_state.images()) {
+        if (differing.contains(BoardDigest::bucketOf(image.imageId))) {
+            images.append(RoomState::toJson(image));
+            stamps.insert(image.imageId, m_lww.stampsJson(image.imageId));
+        }
+    }
+    QJsonArray texts;
+    for (const TextRecord &text : m_state.texts()) {
+        if (differing.contains(BoardDigest::bucketOf(text.textId))) {
+            texts.append(RoomState::toJson(text));
+            stamps.insert(text.textId, m_lww.stampsJson(text.textId));
+        }
+    }
+    
+    QJsonArray buckets;
+    for (int bucket : differing) {
+        buckets.append(bucket);
+    }
+    
+    QJsonObject diff;
+    diff["type"] = "reconcileDiff";
+    diff["buckets"] = buckets;
+    diff["images"] = images;
+    diff["texts"] = texts;
+    diff["stamps"] = stamps;
+    sendToClient(clientId, diff);
+}
+
+bool Room::transformTextEdit(QJsonObject &edit) const
+{
+    auto it = m_state.texts().constFind(edit["textId"].toString());
+    if (it == m_state.texts().constEnd()) return false;
+    const TextRecord &record = it.value();
+    
+    TextOperation operation;
+    if (!TextOperation::fromJson(edit["op"].toArray(), &operation)) return false;
+    
+    // Made against rev; everything sequenced since went in first. Edits
+    // older than the history we keep can't be rebased.
+    qint64 rev = edit["rev"].toVariant().toLongLong();
+    const TextHistory history = m_textHistory.value(record.textId);
+    qint64 oldest = history.ops.isEmpty() ? record.rev : history.baseRev;
+    if (rev < oldest || rev > record.rev) return false;
+    
+    for (; rev < record.rev; ++rev) {
+        TextOperation rebased;
+        TextOperation ignored;
+        if (!TextOperation::transform(operation, history.ops.at(int(rev - history.baseRev)),
+                                      &rebased, &ignored)) {
+            return false;
+        }
+        operation = rebased;
+    }
+    if (operation.baseLength() != record.text.size()) return false;
+    
+    edit["op"] = operation.toJson();
+    edit["rev"] = record.rev + 1;
+    return true;
+}
+
+void Room::sendTextResync(const QString &clientId, const QString &textId)
+{
+    // The client's edit couldn't be placed; it takes our text as is
+    auto it = m_state.texts().constFind(textId);
+    if (it == m_state.texts().constEnd()) return;
+    
+    QJsonObject resync;
+    resync["type"] = "textResync";
+    resync["textId"] = textId;
+    resync["text"] = it.value().text;
+    resync["rev"] = it.value().rev;
+    sendToClient(clientId, resync);
+}
+
+QJsonObject Room::fullSyncMessage() const
+{
+    // Images are announced by hash; clients fetch whatever they don't hold
+    QJsonObject syncMsg;
+    syncMsg["type"] = "fullSync";
+    syncMsg["epoch"] = m_epoch;
+    syncMsg["seq"] = m_seq;
+    syncMsg["images"] = m_state.imagesJson();
+    syncMsg["texts"] = m_state.textsJson();
+    syncMsg["stamps"] = m_lww.stampsJson();
+    syncMsg["tombstones"] = m_lww.tombstonesJson();
+    return syncMsg;
+}
+
+void Room::queueFullSync(const QString &clientId)
+{
+    // Until it arrives the client drops sequenced ops; the snapshot it
+    // gets once its turn comes covers them
+    if (!m_syncQueue.contains(clientId) && !m_syncsSending.contains(clientId)) {
+        m_syncQueue.append(clientId);
+    }
+    pumpFullSyncs();
+}
+
+void Room::pumpFullSyncs()
+{
+    while (!m_syncQueue.isEmpty() && m_syncsSending.size() < SNAPSHOTS_IN_FLIGHT) {
+        QString clientId = m_syncQueue.takeFirst();
+        if (!m_clientsById.contains(clientId)) continue;
+        m_syncsSending.insert(clientId);
+        sendFullSync(clientId);
+        
+        // A client that stops reading mustn't hold the others up for long
+        QTimer::singleShot(SNAPSHOT_SLOT_MS, this, [this, clientId]() {
+            if (m_syncsSending.remove(clientId)) {
+                pumpFullSyncs();
+            }
+        });
+    }
+}
+
+void Room::sendFullSync(const QString &clientId)
+{
+    ClientConnection *client = m_clientsById.value(clientId);
+    if (!client) return;
+    
+    // State only changes through sequenced ops
+    if (m_snapshot.seq != m_seq || m_snapshot.epoch != m_epoch) {
+        m_snapshot = EncodedSnapshot();
+        m_snapshot.epoch = m_epoch;
+        m_snapshot.seq = m_seq;
+    }
+    
+    if (client->binaryFrames()) {
+        if (m_snapshot.binary.isEmpty()) {
+            m_snapshot.binary = FrameCodec::encode(fullSyncMessage());
+        }
+        client->enqueue(m_snapshot.binary, true, "fullSync");
+    } else {
+        if (m_snapshot.json.isEmpty()) {
+            m_snapshot.json = QJsonDocument(fullSyncMessage()).toJson(QJsonDocument::Compact);
+            m_snapshot.text = QString::fromUtf8(m_snapshot.json);
+        }
+        client->enqueue(m_snapshot.json, m_snapshot.text, "fullSync");
+    }
+}
+
+void Room::journal(const QJsonObject &record)
+{
+    if (m_saveFilePath.isEmpty()) return;
+    
+    // Snapshot-only rooms just note that the next save has work to do
+    m_walRecords++;
+    if (m_walPath.isEmpty()) return;
+    
+    QByteArray line = QJsonDocument(record).toJson(QJsonDocument::Compact) + '\n';
+    m_journal->append(m_walPath, line);
+    m_walBytes += line.size();
+}
+
+void Room::saveState()
+{
+    // Nothing logged since the last snapshot
+    if (m_walRecords == 0) return;
+    compact();
+}
+
+void Room::pruneTombstones()
+{
+    // A removal has to stay on record while ops made before it may still
+    // come in: from clients catching up across it, or from ones that were
+    // away a long while and push what they had. Past both horizons it
+    // only makes snapshots bigger.
+    qint64 catchUpFrom = m_opLog.isEmpty() ? m_seq + 1
+                                           : m_opLog.first()["seq"].toVariant().toLongLong();
+    qint64 horizon = qMin(catchUpFrom, m_seq - TOMBSTONE_KEEP_OPS);
+    
+    for (auto it = m_tombstoneSeqs.begin(); it != m_tombstoneSeqs.end();) {
+        if (it.value() < horizon) {
+            m_lww.dropTombstone(it.key());
+            it = m_tombstoneSeqs.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void Room::compact()
+{
+    if (m_saveFilePath.isEmpty()) return;
+    
+    // Only shallow copies here; serializing and writing happen on the writer thread
+    QJsonArray images = m_state.imagesJson();
+    QJsonArray texts = m_state.textsJson();
+    QJsonObject stamps = m_lww.stampsJson();
+    QJsonObject tombstones = m_lww.tombstonesJson();
+    QJsonObject tombstoneSeqs;
+    for (auto it = m_tombstoneSeqs.constBegin(); it != m_tombstoneSeqs.constEnd(); ++it) {
+        tombstoneSeqs.insert(it.key(), it.value());
+    }
+    qint64 seq = m_seq;
+    QString epoch = m_epoch;
+    
+    QJsonObject header;
+    header["type"] = "walHeader";
+    header["epoch"] = epoch;
+    header["seq"] = seq;
+    
+    m_journal->compact(m_saveFilePath, m_walPath,
+                       QJsonDocument(header).toJson(QJsonDocument::Compact) + '\n',
+                       [images, texts, stamps, tombstones, tombstoneSeqs, seq, epoch]() {
+        // Images are stored by hash; the bytes live in the blob store
+        QJsonObject root;
+        root["version"] = 2;
+        root["images"] = images;
+        root["texts"] = texts;
+        root["stamps"] = stamps;
+        root["tombstones"] = tombstones;
+        root["tombstoneSeqs"] = tombstoneSeqs;
+        root["epoch"] = epoch;
+        root["seq"] = seq;
+        root["savedAt"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+        return QJsonDocument(root).toJson();
+    });
+    
+    m_walRecords = 0;
+    m_walBytes = 0;
+}
+
+void Room::loadState()
+{
+    if (m_saveFilePath.isEmpty()) return;
+    
+    QByteArray snapshot;
+    QByteArray wal;
+    // A log left by an earlier journaling run is replayed either way
+    m_journal->load(m_saveFilePath, m_saveFilePath + ".wal", &snapshot, &wal);
+    
+    m_state.clear();
+    m_lww.clear();
+    m_tombstoneSeqs.clear();
+    m_textHistory.clear();
+    m_blobRefs.clear();
+    m_opLog.clear();
+    m_seq = 0;
+    m_epoch = QUuid::createUuid().toString(QUuid::WithoutBraces);
+    
+    bool migrated = false;
+    
+    QJsonDocument doc = QJsonDocument::fromJson(snapshot);
+    if (doc.isObject()) {
+        QJsonObject root = doc.object();
+        for (const QJsonValue &val : root["images"].toArray()) {
+            QJsonObject img = val.toObject();
+            
+            // Older files embed the bytes; move them into the blob store
+            if (img.contains("imageData")) {
+                QByteArray imageData = QByteArray::fromBase64(
+                    img["imageData"].toString().toUtf8());
+                if (!imageData.isEmpty()) {
+                    img["blobHash"] = m_blobs->insert(imageData);
+                }
+                migrated = true;
+            }
+            if (img["blobHash"].toString().isEmpty()) continue;
+            
+            img["type"] = "imageAdd";
+            applyOp(img);
+        }
+        for (const QJsonValue &val : root["texts"].toArray()) {
+            m_state.addText(val.toObject());
+        }
+        // Files from before stamping have none; the next edit wins
+        m_lww.loadStamps(root["stamps"].toObject());
+        m_lww.loadTombstones(root["tombstones"].toObject());
+        
+        // Files from older builds carry no numbering; theirs starts here
+        if (root.contains("epoch")) {
+            m_epoch = root["epoch"].toString();
+            m_seq = root["seq"].toVariant().toLongLong();
+        }
+        
+        // Removals from files without their seqs count as made at the snapshot
+        QJsonObject tombstoneSeqs = root["tombstoneSeqs"].toObject();
+        const QJsonObject tombstones = m_lww.tombstonesJson();
+        for (auto it = tombstones.constBegin(); it != tombstones.constEnd(); ++it) {
+            m_tombstoneSeqs.insert(it.key(), tombstoneSeqs.contains(it.key())
+                                   ? tombstoneSeqs.value(it.key()).toVariant().toLongLong()
+                                   : m_seq);
+        }
+    }
+    
+    // Replay whatever was committed after the snapshot. A log left over
+    // from other numbering is already covered by the snapshot, and a torn
+    // final line means the crash hit mid-write: stop there.
+    QList<QByteArray> lines = wal.split('\n');
+    QJsonObject walHeader = QJsonDocument::fromJson(lines.value(0)).object();
+    bool replayable = walHeader["type"].toString() == "walHeader" &&
+                      walHeader["epoch"].toString() == m_epoch;
+    
+    for (int i = 1; replayable && i < lines.size(); ++i) {
+        QJsonObject record = QJsonDocument::fromJson(lines[i]).object();
+        if (record.isEmpty()) break;
+        
+        if (record["type"].toString() == "blob") {
+            // Logs from before the blob store carry the bytes inline
+            m_blobs->insert(record["hash"].toString(),
+                            QByteArray::fromBase64(record["data"].toString().toLatin1()));
+            migrated = true;
+            continue;
+        }
+        
+        qint64 seq = record["seq"].toVariant().toLongLong();
+        if (seq <= m_seq) continue;
+        
+        applyOp(record);
+        logOp(record);
+        m_seq = seq;
+        m_walRecords++;
+    }
+    
+    // Our own stamps must stay ahead of everything already recorded
+    LamportStamp latest;
+    latest.counter = m_lww.maxCounter();
+    m_clock.observe(latest);
+    
+    // New numbering, a log we can't extend or inline bytes: anchor it with
+    // a fresh snapshot
+    if ((!replayable && !m_walPath.isEmpty()) || migrated || m_walRecords > 0) {
+        compact();
+    }
+    
+    // Boards saved before mips, or by a server that didn't make them
+    for (const ImageRecord &image : m_state.images()) {
+        requestMips(image.imageId);
+    }
+}
@@ -0,0 +1,184 @@
+#ifndef ROOM_H
+#define ROOM_H
+
+#include <QObject>
+#include <QList>
+#include <QHash>
+#include <QStringList>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QSet>
+#include <QRectF>
+#include <atomic>
+#include "RoomState.h"
+#include "data/LwwTable.h"
+#include "data/TextOperation.h"
+
+class JournalWriter;
+class DiskBlobStore;
+class ClientConnection;
+class ConnectionAcceptor;
+class TrafficStats;
+
+// One shared board hosted by SyncServer: its state, the clients that
+// joined it, its op log and its persistence file. Rooms are independent;
+// messages and broadcasts never cross between them.
+//
+// A room lives on one of the server's worker threads together with the
+// sockets of its clients. Only reserve(), memberCount() and isIdle() may be
+// called from the accept thread; everything else runs on the room's own
+// thread.
+class Room : public QObject
+{
+    Q_OBJECT
+
+public:
+    Room(const QString &roomId, const QString &saveFilePath, ConnectionAcceptor *hub);
+
+    QString roomId() const { return m_roomId; }
+    
+    // Accept thread: a client is on its way in (attach follows)
+    void reserve() { m_members++; }
+    int memberCount() const { return m_members.load(); }
+    bool isIdle(qint64 now, qint64 idleMs) const;
+    
+    // Takes over a client already moved to this thread and sends it the
+    // welcome + state
+    void attach(ClientConnection *client, const QJsonObject &joinMsg);
+    void handleMessage(ClientConnection *client, QJsonObject msg, const QByteArray &payload);
+    // A presence datagram, for the clients UDP didn't reach
+    void relayPresence(const QJsonObject &message, const QSet<QString> &reached);
+    // Saves and drops every client; the room is deleted right after
+    void shutdown();
+    
+    // Snapshots the board if anything was logged since the last snapshot
+    void saveState();
+    // Snapshot plus the write-ahead log tail
+    void loadState();
+    
+    // Answer to a client's ping: its own time back plus ours
+    static QJsonObject pong(const QJsonObject &ping);
+
+private:
+    // Blobs a client asked for and will get, most wanted first
+    struct ClientBlobs {
+        QStringList pending;
+        QRectF viewport;        // Scene rect it reported; invalid until then
+        qreal zoom = 1.0;
+    };
+    
+    // A fullSync frame in each wire format, valid for one epoch and seq
+    struct EncodedSnapshot {
+        QString epoch;
+        qint64 seq = -1;
+        QByteArray json;
+        QString text;       // json, as text frames send it
+        QByteArray binary;
+    };
+    
+    // Recent edits of one text; ops[i] took it from rev baseRev + i
+    struct TextHistory {
+        qint64 baseRev = 0;
+        QList<TextOperation> ops;
+    };
+    
+    void addClient(ClientConnection *client, QJsonObject joinMsg);
+    void removeClient(const QString &clientId);
+    void onClientDisconnected(ClientConnection *client);
+    void handOff(ClientConnection *client, const QJsonObject &joinMsg);
+    void broadcast(const QJsonObject &message, const QString &excludeClientId = QString());
+    void sendToClient(const QString &clientId, const QJsonObject &message);
+    void reportUdp(const QString &clientId, bool receiving);
+    bool storeImage(QJsonObject &image, const QByteArray &data, const QString &clientId);
+    // Edits to an item we already have, pushed with the client's register stamps
+    void mergePushed(const QString &clientId, const QJsonObject &item, const QJsonObject &stamps,
+                     const QString &idKey, const QString &updateType);
+    void releaseImage(const QString &hash);
+    void handleBlobData(const QJsonObject &msg, const QByteArray &payload);
+    void requestMips(const QString &imageId);
+    void addMips(const QString &hash, const QJsonObject &mips);
+    void queueBlob(const QString &clientId, const QString &hash);
+    void pumpBlobs(const QString &clientId);
+    QHash<QString, qreal> blobPriorities(const ClientBlobs &blobs) const;
+    void sendBlob(const QString &clientId, const QString &hash);
+    void stampOp(QJsonObject &op);
+    bool applyOp(QJsonObject &op);
+    void logOp(const QJsonObject &op);
+    void commitOp(const QString &clientId, QJsonObject op);
+    void journal(const QJsonObject &record);
+    void compact();
+    void pruneTombstones();
+    void sendCatchUp(const QString &clientId, const QJsonObject &request);
+    void sendReconcileDiff(const QString &clientId, const QJsonObject &request);
+    bool transformTextEdit(QJsonObject &edit) const;
+    void sendTextResync(const QString &clientId, const QString &textId);
+    QJsonObject fullSyncMessage() const;
+    void queueFullSync(const QString &clientId);
+    void pumpFullSyncs();
+    void sendFullSync(const QString &clientId);
+    static QString supersedeKey(const QJsonObject &message);
+
+    QString m_roomId;
+    QString m_saveFilePath;
+    ConnectionAcceptor *m_hub;
+    JournalWriter *m_journal;
+    
+    QList<ClientConnection*> m_clients;
+    QHash<QString, ClientConnection*> m_clientsById;
+    QHash<QString, QJsonObject> m_users;    // clientId -> oderId/userName from join
+    QSet<ClientConnection*> m_leaving;      // Switching rooms, hand-off queued
+    
+    // Shared with the accept thread
+    std::atomic<int> m_members;
+    std::atomic<qint64> m_emptySince;      // 0 while occupied
+    
+    // Board state
+    RoomState m_state;        // Images (metadata + blobHash) and texts
+    DiskBlobStore *m_blobs;   // blobHash -> encoded image bytes, shared by all rooms
+    TrafficStats *m_traffic;  // Shared by all rooms
+    QHash<QString, int> m_blobRefs;             // blobHash -> images using it
+    QHash<QString, QStringList> m_blobWaiters;  // blobHash -> clients waiting for it
+    QHash<QString, ClientBlobs> m_blobQueues;   // clientId -> blobs still to send
+    
+    // Snapshots go out a few at a time, in join order, so a crowd
+    // rejoining at once doesn't queue a copy for everyone up front. All
+    // of them are the same bytes until the next op; encoded once per seq.
+    QStringList m_syncQueue;
+    QSet<QString> m_syncsSending;               // Until the client's socket is flushed
+    EncodedSnapshot m_snapshot;
+    
+    // Concurrent edits resolve per property, newest stamp wins, instead
+    // of by arrival order. Ops from clients that don't stamp get ours.
+    LwwTable m_lww;
+    LamportClock m_clock;
+    QHash<QString, qint64> m_tombstoneSeqs;     // itemId -> seq of its removal
+    // Texts are edited character-wise instead: the room orders the edits
+    // and transforms each past the ones its author hadn't seen yet
+    QHash<QString, TextHistory> m_textHistory;
+    
+    // Every mutation gets the next room sequence number; the most recent
+    // ones are kept so reconnecting clients can catch up incrementally.
+    // The epoch changes whenever numbering restarts (new or reloaded state).
+    QList<QJsonObject> m_opLog;
+    qint64 m_seq;
+    QString m_epoch;
+    
+    // Write-ahead log next to the save file; compacted into a fresh
+    // snapshot periodically or once it grows past these limits. Empty when
+    // the server keeps snapshots only; ops are still counted then.
+    QString m_walPath;
+    int m_walRecords;
+    qint64 m_walBytes;
+    
+    static constexpr int OP_LOG_LIMIT = 5000;
+    static constexpr int TEXT_HISTORY_LIMIT = 500;
+    static constexpr qint64 TOMBSTONE_KEEP_OPS = 100000;
+    static constexpr int TOMBSTONE_PRUNE_OPS = 1000;
+    static constexpr qint64 BLOB_WINDOW_BYTES = 2 * 1024 * 1024;
+    static constexpr int SNAPSHOTS_IN_FLIGHT = 2;
+    static constexpr int SNAPSHOT_SLOT_MS = 5000;
+    static constexpr int COMPACT_RECORDS = 5000;
+    static constexpr qint64 COMPACT_BYTES = 64 * 1024 * 1024;
+};
+
+#endif // ROOM_H
@@ -0,0 +1,211 @@
+#include "RoomState.h"
+#include "data/TextOperation.h"
+
+#include <QList>
+#include <QSet>
+#include <algorithm>
+
+namespace {
+
+// Per-message envelope, never part of an item's state
+const QSet<QString> &transportKeys()
+{
+    static const QSet<QString> keys = {
+        "type", "oderId", "userId", "seq", "stamp", "live", "sentAt",
+        "imageData", "dataOffset", "dataSize", "pseq"
+    };
+    return keys;
+}
+
+template <typename Record>
+QJsonArray sortedJson(const QHash<QString, Record> &records)
+{
+    QList<const Record*> ordered;
+    ordered.reserve(records.size());
+    for (const Record &record : records) {
+        ordered.append(&record);
+    }
+    std::sort(ordered.begin(), ordered.end(), [](const Record *a, const Record *b) {
+        return a->order < b->order;
+    });
+    
+    QJsonArray array;
+    for (const Record *record : ordered) {
+        array.append(RoomState::toJson(*record));
+    }
+    return array;
+}
+
+} // namespace
+
+bool RoomState::addImage(const QJsonObject &image)
+{
+    QString imageId = image["imageId"].toString();
+    if (imageId.isEmpty() || m_images.contains(imageId)) return false;
+    
+    ImageRecord record;
+    record.imageId = imageId;
+    record.order = m_nextOrder++;
+    applyImageFields(record, image);
+    
+    m_images.insert(imageId, record);
+    m_imagesDirty = true;
+    return true;
+}
+
+bool RoomState::updateImage(const QJsonObject &update)
+{
+    auto it = m_images.find(update["imageId"].toString());
+    if (it == m_images.end()) return false;
+    
+    applyImageFields(it.value(), update);
+    m_imagesDirty = true;
+    return true;
+}
+
+bool RoomState::removeImage(const QString &imageId, ImageRecord *removed)
+{
+    auto it = m_images.find(imageId);
+    if (it == m_images.end()) return false;
+    
+    if (removed) {
+        *removed = it.value();
+    }
+    m_images.erase(it);
+    m_imagesDirty = true;
+    return true;
+}
+
+bool RoomState::addText(const QJsonObject &text)
+{
+    QString textId = text["textId"].toString();
+    if (textId.isEmpty() || m_texts.contains(textId)) return false;
+    
+    TextRecord record;
+    record.textId = textId;
+    record.order = m_nextOrder++;
+    applyTextFields(record, text);
+    
+    m_texts.insert(textId, record);
+    m_textsDirty = true;
+    return true;
+}
+
+bool RoomState::updateText(const QJsonObject &update)
+{
+    auto it = m_texts.find(update["textId"].toString());
+    if (it == m_texts.end()) return false;
+    
+    applyTextFields(it.value(), update);
+    m_textsDirty = true;
+    return true;
+}
+
+bool RoomState::editText(const QString &textId, const TextOperation &edit, qint64 rev)
+{
+    auto it = m_texts.find(textId);
+    if (it == m_texts.end() || !edit.apply(&it.value().text)) return false;
+    
+    it.value().rev = rev;
+    m_textsDirty = true;
+    return true;
+}
+
+bool RoomState::removeText(const QString &textId)
+{
+    if (!m_texts.remove(textId)) return false;
+    
+    m_textsDirty = true;
+    return true;
+}
+
+void RoomState::clear()
+{
+    m_images.clear();
+    m_texts.clear();
+    m_nextOrder = 0;
+    m_imagesDirty = true;
+    m_textsDirty = true;
+}
+
+QJsonArray RoomState::imagesJson() const
+{
+    if (m_imagesDirty) {
+        m_imagesJson = sortedJson(m_images);
+        m_imagesDirty = false;
+    }
+    return m_imagesJson;
+}
+
+QJsonArray RoomState::textsJson() const
+{
+    if (m_textsDirty) {
+        m_textsJson = sortedJson(m_texts);
+        m_textsDirty = false;
+    }
+    return m_textsJson;
+}
+
+QJsonObject RoomState::toJson(const ImageRecord &image)
+{
+    QJsonObject obj = image.extra;
+    obj["imageId"] = image.imageId;
+    obj["blobHash"] = image.blobHash;
+    if (!image.previewHash.isEmpty()) {
+        obj["previewHash"] = image.previewHash;
+    }
+    obj["x"] = image.x;
+    obj["y"] = image.y;
+    obj["rotation"] = image.rotation;
+    obj["scale"] = image.scale;
+    obj["zIndex"] = image.zIndex;
+    obj["isGif"] = image.isGif;
+    return obj;
+}
+
+QJsonObject RoomState::toJson(const TextRecord &text)
+{
+    QJsonObject obj = text.extra;
+    obj["textId"] = text.textId;
+    obj["text"] = text.text;
+    obj["x"] = text.x;
+    obj["y"] = text.y;
+    obj["rotation"] = text.rotation;
+    if (text.rev > 0) {
+        obj["rev"] = text.rev;
+    }
+    return obj;
+}
+
+void RoomState::applyImageFields(ImageRecord &image, const QJsonObject &fields)
+{
+    for (auto it = fields.begin(); it != fields.end(); ++it) {
+        const QString &key = it.key();
+        if (key == "imageId" || transportKeys().contains(key)) continue;
+        
+        if (key == "blobHash")         image.blobHash = it.value().toString();
+        else if (key == "previewHash") image.previewHash = it.value().toString();
+        else if (key == "x")           image.x = it.value().toDouble();
+        else if (key == "y")           image.y = it.value().toDouble();
+        else if (key == "rotation")    image.rotation = it.value().toDouble();
+        else if (key == "scale")       image.scale = it.value().toDouble(1.0);
+        else if (key == "zIndex")      image.zIndex = it.value().toDouble();
+        else if (key == "isGif")       image.isGif = it.value().toBool();
+        else                           image.extra.insert(key, it.value());
+    }
+}
+
+void RoomState::applyTextFields(TextRecord &text, const QJsonObject &fields)
+{
+    for (auto it = fields.begin(); it != fields.end(); ++it) {
+        const QString &key = it.key();
+        if (key == "textId" || transportKeys().contains(key)) continue;
+        
+        if (key == "text")          text.text = it.value().toString();
+        else if (key == "x")        text.x = it.value().toDouble();
+        else if (key == "y")        text.y = it.value().toDouble();
+        else if (key == "rotation") text.rotation = it.value().toDouble();
+        else if (key == "rev")      text.rev = it.value().toVariant().toLongLong();
+        else                        text.extra.insert(key, it.value());
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef ROOMSTATE_H
+#define ROOMSTATE_H
+
+#include <QString>
+#include <QHash>
+#include <QJsonObject>
+#include <QJsonArray>
+
+class TextOperation;
+
+// Server-side record of one image on the board. Bytes live in the blob
+// store under blobHash, and its preview (if any) under previewHash.
+struct ImageRecord {
+    QString imageId;
+    QString blobHash;
+    QString previewHash;
+    qreal x = 0;
+    qreal y = 0;
+    qreal rotation = 0;
+    qreal scale = 1.0;
+    qreal zIndex = 0;
+    bool isGif = false;
+    QJsonObject extra;      // Fields the server doesn't interpret, kept verbatim
+    quint64 order = 0;      // Insertion order, keeps snapshots stable
+};
+
+struct TextRecord {
+    QString textId;
+    QString text;
+    qreal x = 0;
+    qreal y = 0;
+    qreal rotation = 0;
+    qint64 rev = 0;         // Edits applied to the text so far
+    QJsonObject extra;
+    quint64 order = 0;
+};
+
+// In-memory board of a room, keyed by item id so every add, update and
+// remove is O(1). The JSON form is only built when a snapshot is needed
+// and cached until the next change.
+class RoomState
+{
+public:
+    RoomState() = default;
+
+    bool hasImage(const QString &imageId) const { return m_images.contains(imageId); }
+    bool hasText(const QString &textId) const { return m_texts.contains(textId); }
+    bool isEmpty() const { return m_images.isEmpty() && m_texts.isEmpty(); }
+    
+    // Return false when the item already exists (add) or is unknown (update/remove)
+    bool addImage(const QJsonObject &image);
+    bool updateImage(const QJsonObject &update);
+    bool removeImage(const QString &imageId, ImageRecord *removed = nullptr);
+    
+    bool addText(const QJsonObject &text);
+    bool updateText(const QJsonObject &update);
+    // Applies a sequenced edit that brings the text to rev
+    bool editText(const QString &textId, const TextOperation &edit, qint64 rev);
+    bool removeText(const QString &textId);
+    
+    void clear();
+    
+    const QHash<QString, ImageRecord> &images() const { return m_images; }
+    const QHash<QString, TextRecord> &texts() const { return m_texts; }
+    
+    // Snapshot form, in insertion order
+    QJsonArray imagesJson() const;
+    QJsonArray textsJson() const;
+    
+    static QJsonObject toJson(const ImageRecord &image);
+    static QJsonObject toJson(const TextRecord &text);
+
+private:
+    static void applyImageFields(ImageRecord &image, const QJsonObject &fields);
+    static void applyTextFields(TextRecord &text, const QJsonObject &fields);
+    
+    QHash<QString, ImageRecord> m_images;
+    QHash<QString, TextRecord> m_texts;
+    quint64 m_nextOrder = 0;
+    
+    mutable QJsonArray m_imagesJson;
+    mutable QJsonArray m_textsJson;
+    mutable bool m_imagesDirty = true;
+    mutable bool m_textsDirty = true;
+};
+
+#endif // ROOMSTATE_H
@@ -0,0 +1,28 @@
+#ifndef SERVERCONFIG_H
+#define SERVERCONFIG_H
+
+#include <QString>
+
+// How a SyncServer hosts its rooms. The defaults are what the app's
+// built-in server does; the standalone server sets them from its command
+// line.
+struct ServerConfig {
+    enum class Persistence {
+        Journal,        // Snapshots plus a write-ahead log of every op
+        Snapshots,      // Snapshots only; a crash loses up to one save interval
+        None            // Memory only; a room is gone once it unloads
+    };
+
+    QString saveFilePath;           // Default room's board file; empty for none
+    Persistence persistence = Persistence::Journal;
+    int maxRooms = 0;               // 0 for no limit
+    int maxClientsPerRoom = 0;      // 0 for no limit
+    int joinsPerSecond = 20;        // Admitted in bursts of up to this; 0 for no limit
+    int udpPort = 0;                // Presence datagrams; 0 for the WebSocket port, -1 for none
+    int workers = 0;                // Room threads; 0 to size by core count
+    int mipThreads = 0;             // Image mip decoders; 0 to size by core count, -1 for none
+    int saveIntervalMs = 30000;
+    int roomIdleMs = 5 * 60 * 1000; // Empty rooms unload after this
+};
+
+#endif // SERVERCONFIG_H
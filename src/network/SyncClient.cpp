@@ -1,14 +1,27 @@
 #include "SyncClient.h"
+#include "FrameCodec.h"
 
+#include <QDateTime>
 #include <QJsonDocument>
+#include <QJsonArray>
+#include <QNetworkDatagram>
+#include <QUdpSocket>
 #include <QUuid>
 
 SyncClient::SyncClient(QObject *parent)
     : QObject(parent)
     , m_socket(new QWebSocket(QString(), QWebSocketProtocol::VersionLatest, this))
+    , m_lastSeq(0)
+    , m_awaitingSync(false)
+    , m_unwritten(0)
+    , m_udp(nullptr)
+    , m_udpPort(0)
+    , m_udpReady(false)
+    , m_udpHeardAt(0)
+    , m_presenceSeq(0)
     , m_pingTimer(new QTimer(this))
     , m_reconnectTimer(new QTimer(this))
-    , m_reconnectAttempts(0)
+    , m_backoff(RECONNECT_BASE_MS, RECONNECT_MAX_MS)
 {
     m_oderId = QUuid::createUuid().toString(QUuid::WithoutBraces);
     
@@ -18,6 +31,10 @@ SyncClient::SyncClient(QObject *parent)
             this, &SyncClient::onDisconnected);
     connect(m_socket, &QWebSocket::textMessageReceived,
             this, &SyncClient::onTextMessageReceived);
+    connect(m_socket, &QWebSocket::binaryMessageReceived,
+            this, &SyncClient::onBinaryMessageReceived);
+    connect(m_socket, &QWebSocket::bytesWritten,
+            this, &SyncClient::onBytesWritten);
     
     // Qt version compatibility for error signal
 #if QT_VERSION >= QT_VERSION_CHECK(6, 5, 0)
@@ -27,16 +44,14 @@ SyncClient::SyncClient(QObject *parent)
     connect(m_socket, QOverload<QAbstractSocket::SocketError>::of(&QWebSocket::error),
             this, &SyncClient::onError);
 #endif
-    
+
     connect(m_pingTimer, &QTimer::timeout, this, &SyncClient::sendPing);
     
+    // Each failed attempt ends in onDisconnected, which schedules the next
+    m_reconnectTimer->setSingleShot(true);
     connect(m_reconnectTimer, &QTimer::timeout, this, [this]() {
-        if (m_reconnectAttempts < MAX_RECONNECT_ATTEMPTS && !m_serverUrl.isEmpty()) {
-            m_reconnectAttempts++;
+        if (!m_serverUrl.isEmpty()) {
             m_socket->open(QUrl(m_serverUrl));
-        } else {
-            m_reconnectTimer->stop();
-            emit errorOccurred("Failed to reconnect after multiple attempts");
         }
     });
 }
@@ -48,8 +63,13 @@ SyncClient::~SyncClient()
 
 void SyncClient::connectToServer(const QString &url)
 {
+    if (url != m_serverUrl) {
+        m_latency.reset();
+        m_traffic.reset();
+    }
     m_serverUrl = url;
-    m_reconnectAttempts = 0;
+    m_backoff.reset();
+    m_reconnectTimer->stop();
     m_socket->open(QUrl(url));
 }
 
@@ -69,23 +89,105 @@ bool SyncClient::isConnected() const
     return m_socket->state() == QAbstractSocket::ConnectedState;
 }
 
+bool SyncClient::isReconnecting() const
+{
+    return m_reconnectTimer->isActive() ||
+           m_socket->state() == QAbstractSocket::ConnectingState ||
+           m_socket->state() == QAbstractSocket::HostLookupState;
+}
+
 void SyncClient::sendMessage(const QJsonObject &message)
 {
     if (isConnected()) {
-        QJsonDocument doc(message);
-        m_socket->sendTextMessage(doc.toJson(QJsonDocument::Compact));
+        QJsonDocument doc(stampSent(message));
+        QByteArray json = doc.toJson(QJsonDocument::Compact);
+        qint64 sent = qMax<qint64>(m_socket->sendTextMessage(json), 0);
+        m_traffic.record(TrafficStats::Outbound, message["type"].toString(), QString(), sent);
+        m_unwritten += sent;
+        m_traffic.setQueue(QString(), 0, 0, m_unwritten);
+    }
+}
+
+void SyncClient::sendBinaryMessage(const QJsonObject &header, const QByteArray &payload)
+{
+    if (isConnected()) {
+        QByteArray frame = FrameCodec::encode(stampSent(header), payload);
+        qint64 sent = qMax<qint64>(m_socket->sendBinaryMessage(frame), 0);
+        m_traffic.record(TrafficStats::Outbound, header["type"].toString(), QString(), sent);
+        m_unwritten += sent;
+        m_traffic.setQueue(QString(), 0, 0, m_unwritten);
+    }
+}
+
+void SyncClient::sendPresence(const QJsonObject &message)
+{
+    QJsonObject numbered = message;
+    numbered["pseq"] = ++m_presenceSeq;
+    
+    if (m_udpReady && isConnected()) {
+        QJsonObject stamped = stampSent(numbered);
+        stamped["token"] = m_udpToken;
+        QByteArray datagram = QJsonDocument(stamped).toJson(QJsonDocument::Compact);
+        if (datagram.size() <= MAX_DATAGRAM &&
+            m_udp->writeDatagram(datagram, m_socket->peerAddress(), m_udpPort) >= 0) {
+            m_traffic.record(TrafficStats::Outbound, message["type"].toString(), QString(),
+                             datagram.size());
+            return;
+        }
     }
+    sendMessage(numbered);
+}
+
+bool SyncClient::serverSupports(const QString &feature) const
+{
+    return m_serverFeatures.contains(feature);
 }
 
 void SyncClient::joinRoom(const QString &roomId, const QString &userName)
 {
+    if (roomId != m_roomId) {
+        m_epoch.clear();
+        m_lastSeq = 0;
+    }
     m_roomId = roomId;
+    m_userName = userName;
     
+    if (isConnected()) {
+        sendJoin();
+    }
+}
+
+void SyncClient::sendJoin()
+{
     QJsonObject message;
     message["type"] = "join";
-    message["roomId"] = roomId;
+    message["roomId"] = m_roomId;
     message["oderId"] = m_oderId;
-    message["userName"] = userName;
+    message["userName"] = m_userName;
+    message["features"] = QJsonArray{ "binary" };
+    
+    // Resume where the last session stopped
+    if (!m_epoch.isEmpty()) {
+        message["epoch"] = m_epoch;
+        message["sinceSeq"] = m_lastSeq;
+    }
+    
+    m_awaitingSync = true;
+    sendMessage(message);
+}
+
+void SyncClient::requestCatchUp()
+{
+    if (m_awaitingSync) return;
+    m_awaitingSync = true;
+    
+    QJsonObject message;
+    message["type"] = "requestSync";
+    message["oderId"] = m_oderId;
+    if (!m_epoch.isEmpty()) {
+        message["epoch"] = m_epoch;
+        message["sinceSeq"] = m_lastSeq;
+    }
     
     sendMessage(message);
 }
@@ -100,35 +202,284 @@ void SyncClient::leaveRoom()
         
         sendMessage(message);
         m_roomId.clear();
+        m_epoch.clear();
+        m_lastSeq = 0;
     }
 }
 
 void SyncClient::onConnected()
 {
-    m_reconnectAttempts = 0;
+    m_backoff.reset();
     m_reconnectTimer->stop();
     m_pingTimer->start(PING_INTERVAL);
+    sendPing();
     
     emit connected();
+    
+    if (!m_roomId.isEmpty()) {
+        sendJoin();
+    }
 }
 
 void SyncClient::onDisconnected()
 {
     m_pingTimer->stop();
+    stopUdp();
+    m_serverFeatures.clear();
+    m_awaitingSync = false;
+    m_unwritten = 0;
+    m_traffic.setQueue(QString(), 0, 0, 0);
     emit disconnected();
     
-    // Try to reconnect
-    if (!m_serverUrl.isEmpty() && m_reconnectAttempts < MAX_RECONNECT_ATTEMPTS) {
-        m_reconnectTimer->start(RECONNECT_INTERVAL);
+    // Try to reconnect, later each time and never in step with the other
+    // clients of a server that just went away
+    if (m_serverUrl.isEmpty() || m_reconnectTimer->isActive()) return;
+    if (m_backoff.attempts() < MAX_RECONNECT_ATTEMPTS) {
+        m_reconnectTimer->start(m_backoff.nextDelay());
+    } else {
+        emit errorOccurred("Failed to reconnect after multiple attempts");
     }
 }
 
 void SyncClient::onTextMessageReceived(const QString &message)
 {
-    QJsonDocument doc = QJsonDocument::fromJson(message.toUtf8());
+    QByteArray utf8 = message.toUtf8();
+    QJsonDocument doc = QJsonDocument::fromJson(utf8);
     if (doc.isObject()) {
-        emit messageReceived(doc.object());
+        m_traffic.record(TrafficStats::Inbound, doc.object()["type"].toString(), QString(),
+                         utf8.size());
+        processMessage(doc.object(), QByteArray());
+    }
+}
+
+void SyncClient::onBinaryMessageReceived(const QByteArray &message)
+{
+    QJsonObject header;
+    QByteArray payload;
+    if (FrameCodec::decode(message, &header, &payload)) {
+        m_traffic.record(TrafficStats::Inbound, header["type"].toString(), QString(),
+                         message.size());
+        processMessage(header, payload);
+    }
+}
+
+void SyncClient::onBytesWritten(qint64 bytes)
+{
+    // Frame headers make the socket write a little more than we handed it
+    m_unwritten = qMax<qint64>(0, m_unwritten - bytes);
+    m_traffic.setQueue(QString(), 0, 0, m_unwritten);
+}
+
+void SyncClient::processMessage(const QJsonObject &msg, const QByteArray &payload)
+{
+    QString type = msg["type"].toString();
+    
+    if (type == "pong") {
+        m_latency.addPong(msg["t"].toVariant().toLongLong(),
+                          msg["serverTime"].toVariant().toLongLong(),
+                          QDateTime::currentMSecsSinceEpoch());
+        emit latencyUpdated();
+        return;
+    } else if (type == "welcome") {
+        m_serverFeatures.clear();
+        for (const QJsonValue &feature : msg["features"].toArray()) {
+            m_serverFeatures.append(feature.toString());
+        }
+        if (m_serverFeatures.contains("udp")) {
+            startUdp(quint16(msg["udpPort"].toInt()), msg["udpToken"].toString());
+        } else {
+            stopUdp();
+        }
+    } else if (type == "ack") {
+        // One of our own ops got its number
+        acceptSeq(msg["seq"].toVariant().toLongLong());
+        return;
+    } else if (type == "catchUp") {
+        m_epoch = msg["epoch"].toString();
+        for (const QJsonValue &op : msg["ops"].toArray()) {
+            QJsonObject opObj = op.toObject();
+            qint64 seq = opObj["seq"].toVariant().toLongLong();
+            if (seq > m_lastSeq) {
+                m_lastSeq = seq;
+                emit messageReceived(opObj);
+            }
+        }
+        m_lastSeq = qMax(m_lastSeq, msg["seq"].toVariant().toLongLong());
+        m_awaitingSync = false;
+        emit synchronized();
+        return;
+    } else if (type == "fullSync") {
+        // A snapshot replaces our position in the stream
+        if (msg.contains("seq")) {
+            m_epoch = msg["epoch"].toString();
+            m_lastSeq = msg["seq"].toVariant().toLongLong();
+        }
+        m_awaitingSync = false;
+        deliver(msg, payload);
+        emit synchronized();
+        return;
     }
+    
+    // Unsequenced traffic (cursors, presence, blobs) always goes through,
+    // unless presence the other channel already brought newer
+    if (msg.contains("seq") && !acceptSeq(msg["seq"].toVariant().toLongLong())) {
+        return;
+    }
+    if (!acceptPresence(msg)) return;
+    deliver(msg, payload);
+    recordDelivery(msg);
+}
+
+QJsonObject SyncClient::stampSent(const QJsonObject &message) const
+{
+    // In server time, so whoever receives it can tell how long it took
+    // without knowing our clock
+    QJsonObject stamped = message;
+    stamped["sentAt"] = m_latency.toServerTime(QDateTime::currentMSecsSinceEpoch());
+    return stamped;
+}
+
+void SyncClient::recordDelivery(const QJsonObject &message)
+{
+    // Measured once the handlers are done, so it covers applying it too.
+    // Replays (catch-ups, snapshots) never get here.
+    if (!message.contains("sentAt") || !m_latency.hasEstimate()) return;
+    
+    qint64 sentAt = message["sentAt"].toVariant().toLongLong();
+    qint64 now = m_latency.toServerTime(QDateTime::currentMSecsSinceEpoch());
+    m_latency.recordDelivery(message["type"].toString(), now - sentAt);
+}
+
+void SyncClient::deliver(const QJsonObject &message, const QByteArray &payload)
+{
+    if (payload.isEmpty()) {
+        emit messageReceived(message);
+    } else {
+        emit binaryMessageReceived(message, payload);
+    }
+}
+
+bool SyncClient::acceptPresence(const QJsonObject &message)
+{
+    if (!message.contains("pseq")) return true;
+    
+    // Final edits only move the mark: they're sequenced and never dropped
+    qint64 &newest = m_peerPresenceSeq[message["oderId"].toString()];
+    qint64 pseq = message["pseq"].toVariant().toLongLong();
+    bool presence = message["type"].toString() == "cursor" || message["live"].toBool();
+    if (presence && pseq <= newest) return false;
+    
+    newest = qMax(newest, pseq);
+    return true;
+}
+
+void SyncClient::startUdp(quint16 port, const QString &token)
+{
+    if (port == 0 || token.isEmpty()) {
+        stopUdp();
+        return;
+    }
+    
+    if (!m_udp) {
+        m_udp = new QUdpSocket(this);
+        connect(m_udp, &QUdpSocket::readyRead, this, &SyncClient::onUdpReadyRead);
+    }
+    if (m_udp->state() != QAbstractSocket::BoundState && !m_udp->bind()) {
+        return;     // Presence stays on the WebSocket
+    }
+    
+    m_udpPort = port;
+    m_udpToken = token;
+    m_udpReady = false;
+    
+    // Twice, in case the first is lost; pings keep it going after that
+    sendUdpHello();
+    QTimer::singleShot(1000, this, [this]() {
+        if (!m_udpReady) {
+            sendUdpHello();
+        }
+    });
+}
+
+void SyncClient::stopUdp()
+{
+    m_udpToken.clear();
+    m_udpPort = 0;
+    m_udpReady = false;
+    m_peerPresenceSeq.clear();
+    if (m_udp) {
+        m_udp->close();
+    }
+}
+
+void SyncClient::sendUdpHello()
+{
+    if (!m_udp || m_udpToken.isEmpty() || !isConnected()) return;
+    
+    // Also what keeps a NAT mapping towards the server open
+    QJsonObject hello;
+    hello["type"] = "udpHello";
+    hello["token"] = m_udpToken;
+    QByteArray datagram = QJsonDocument(hello).toJson(QJsonDocument::Compact);
+    m_udp->writeDatagram(datagram, m_socket->peerAddress(), m_udpPort);
+    m_traffic.record(TrafficStats::Outbound, "udpHello", QString(), datagram.size());
+}
+
+void SyncClient::setUdpReady(bool ready)
+{
+    if (ready == m_udpReady) return;
+    m_udpReady = ready;
+    
+    // Only datagrams that get through one way prove nothing: the server
+    // relays to us over UDP once we say its replies arrive, and goes back
+    // to the WebSocket when we say they stopped
+    QJsonObject status;
+    status["type"] = "udpStatus";
+    status["oderId"] = m_oderId;
+    status["receiving"] = ready;
+    sendMessage(status);
+}
+
+void SyncClient::onUdpReadyRead()
+{
+    while (m_udp->hasPendingDatagrams()) {
+        QNetworkDatagram datagram = m_udp->receiveDatagram();
+        // Only the server we're connected to speaks on this channel
+        QHostAddress server = m_socket->peerAddress();
+        if (!datagram.isValid() || m_udpToken.isEmpty() ||
+            !datagram.senderAddress().isEqual(server, QHostAddress::TolerantConversion)) {
+            continue;
+        }
+        
+        QJsonDocument doc = QJsonDocument::fromJson(datagram.data());
+        if (!doc.isObject()) continue;
+        QJsonObject msg = doc.object();
+        m_traffic.record(TrafficStats::Inbound, msg["type"].toString(), QString(),
+                         datagram.data().size());
+        
+        m_udpHeardAt = QDateTime::currentMSecsSinceEpoch();
+        setUdpReady(true);
+        if (msg["type"].toString() == "udpReady") continue;
+        
+        if (acceptPresence(msg)) {
+            deliver(msg, QByteArray());
+            recordDelivery(msg);
+        }
+    }
+}
+
+bool SyncClient::acceptSeq(qint64 seq)
+{
+    if (seq <= m_lastSeq) return false;  // Already applied
+    
+    if (seq == m_lastSeq + 1 && !m_awaitingSync) {
+        m_lastSeq = seq;
+        return true;
+    }
+    
+    // Missed something: the catch-up reply will include this op too
+    requestCatchUp();
+    return false;
 }
 
 void SyncClient::onError(QAbstractSocket::SocketError error)
@@ -139,8 +490,21 @@ void SyncClient::onError(QAbstractSocket::SocketError error)
 
 void SyncClient::sendPing()
 {
+    // No word over UDP in a while (a firewall, a NAT that forgot us):
+    // presence goes back to the WebSocket until a hello gets through
+    if (m_udpReady &&
+        QDateTime::currentMSecsSinceEpoch() - m_udpHeardAt > UDP_TIMEOUT_MS) {
+        setUdpReady(false);
+    }
+    sendUdpHello();
+    
     QJsonObject message;
     message["type"] = "ping";
     message["oderId"] = m_oderId;
+    message["t"] = QDateTime::currentMSecsSinceEpoch();
+    // Keeps the server's view of our UDP channel current
+    if (!m_udpToken.isEmpty()) {
+        message["udp"] = m_udpReady;
+    }
     sendMessage(message);
 }
@@ -4,7 +4,14 @@
 #include <QObject>
 #include <QWebSocket>
 #include <QTimer>
+#include <QHash>
 #include <QJsonObject>
+#include <QStringList>
+#include "LatencyStats.h"
+#include "ReconnectBackoff.h"
+#include "TrafficStats.h"
+
+class QUdpSocket;
 
 class SyncClient : public QObject
 {
@@ -18,39 +25,108 @@ public:
     void disconnect();
     
     bool isConnected() const;
+    // Waiting out the backoff before the next attempt, or mid-attempt
+    bool isReconnecting() const;
     
     void sendMessage(const QJsonObject &message);
+    void sendBinaryMessage(const QJsonObject &header, const QByteArray &payload);
+    // Cursors and live drags: over UDP when the server offers it and its
+    // replies get through, else like sendMessage. Numbered (pseq) so that
+    // receivers can drop whatever arrives after something newer.
+    void sendPresence(const QJsonObject &message);
+    // Number of the last presence message sent. Final edits carry it, so
+    // a live update still in transit can't land on top of them.
+    qint64 presenceSeq() const { return m_presenceSeq; }
+    bool presenceOverUdp() const { return m_udpReady; }
+    
+    // Features announced by the server's welcome message ("binary", ...)
+    bool serverSupports(const QString &feature) const;
+    // Remembers the room and joins it now or as soon as we are connected.
+    // Reconnects rejoin automatically and resume from lastSeq().
     void joinRoom(const QString &roomId, const QString &userName);
     void leaveRoom();
     
+    // Ask for every op after lastSeq() (or a snapshot if the server can't)
+    void requestCatchUp();
+    
     QString oderId() const { return m_oderId; }
     QString roomId() const { return m_roomId; }
+    qint64 lastSeq() const { return m_lastSeq; }
+    
+    // Round trip, clock offset and per-type delivery latency so far
+    const LatencyStats &latency() const { return m_latency; }
+    // Messages and bytes each way by type, and what the socket still holds
+    const TrafficStats &traffic() const { return m_traffic; }
 
 signals:
     void connected();
     void disconnected();
     void messageReceived(const QJsonObject &message);
+    void binaryMessageReceived(const QJsonObject &header, const QByteArray &payload);
+    // A snapshot or catch-up for the current join has been delivered
+    void synchronized();
+    // A pong came back and the round trip estimate moved
+    void latencyUpdated();
     void errorOccurred(const QString &error);
 
 private slots:
     void onConnected();
     void onDisconnected();
     void onTextMessageReceived(const QString &message);
+    void onBinaryMessageReceived(const QByteArray &message);
     void onError(QAbstractSocket::SocketError error);
+    void onBytesWritten(qint64 bytes);
+    void onUdpReadyRead();
     void sendPing();
 
 private:
+    void sendJoin();
+    void processMessage(const QJsonObject &msg, const QByteArray &payload);
+    void deliver(const QJsonObject &message, const QByteArray &payload);
+    bool acceptSeq(qint64 seq);
+    bool acceptPresence(const QJsonObject &message);
+    void startUdp(quint16 port, const QString &token);
+    void stopUdp();
+    void sendUdpHello();
+    void setUdpReady(bool ready);
+    QJsonObject stampSent(const QJsonObject &message) const;
+    void recordDelivery(const QJsonObject &message);
+    
     QWebSocket *m_socket;
     QString m_serverUrl;
     QString m_roomId;
     QString m_oderId;
+    QString m_userName;
+    QStringList m_serverFeatures;
+    
+    // Position in the room's op stream
+    QString m_epoch;
+    qint64 m_lastSeq;
+    bool m_awaitingSync;
+    
+    LatencyStats m_latency;
+    TrafficStats m_traffic;
+    qint64 m_unwritten;     // Handed to the socket, not on the wire yet
+    
+    // Presence channel; bound once the welcome offers one
+    QUdpSocket *m_udp;
+    QString m_udpToken;
+    quint16 m_udpPort;
+    bool m_udpReady;                        // The server's replies arrive (and it knows)
+    qint64 m_udpHeardAt;
+    qint64 m_presenceSeq;
+    QHash<QString, qint64> m_peerPresenceSeq;   // oderId -> newest pseq seen
+    
     QTimer *m_pingTimer;
     QTimer *m_reconnectTimer;
-    int m_reconnectAttempts;
+    ReconnectBackoff m_backoff;
     
-    static constexpr int PING_INTERVAL = 30000;
-    static constexpr int RECONNECT_INTERVAL = 5000;
-    static constexpr int MAX_RECONNECT_ATTEMPTS = 10;
+    static constexpr int PING_INTERVAL = 5000;
+    static constexpr int UDP_TIMEOUT_MS = 3 * PING_INTERVAL;    // Silent that long: back to TCP
+    static constexpr int MAX_DATAGRAM = 1200;
+    static constexpr int RECONNECT_BASE_MS = 1000;
+    static constexpr int RECONNECT_MAX_MS = 60000;
+    static constexpr int MAX_RECONNECT_ATTEMPTS = 12;
 };
 
 #endif // SYNCCLIENT_H
@@ -1,25 +1,21 @@
 #include "SyncServer.h"
+#include "ConnectionAcceptor.h"
 #include <QNetworkInterface>
-#include <QUuid>
-#include <QJsonArray>
-#include <QFile>
 #include <QDir>
 #include <QStandardPaths>
-#include <QDateTime>
 
 SyncServer::SyncServer(QObject *parent)
     : QObject(parent)
-    , m_server(nullptr)
-    , m_roomId(QUuid::createUuid().toString(QUuid::WithoutBraces).left(8))
-    , m_saveTimer(new QTimer(this))
+    , m_acceptThread(new QThread(this))
+    , m_acceptor(nullptr)
+    , m_port(0)
 {
-    // Auto-save every 30 seconds
-    connect(m_saveTimer, &QTimer::timeout, this, &SyncServer::saveState);
+    m_acceptThread->setObjectName("CollabRef accept");
     
     // Default save location
     QString dataDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
     QDir().mkpath(dataDir);
-    m_saveFilePath = dataDir + "/shared_board.json";
+    m_config.saveFilePath = dataDir + "/shared_board.json";
 }
 
 SyncServer::~SyncServer()
@@ -29,68 +25,89 @@ SyncServer::~SyncServer()
 
 bool SyncServer::start(quint16 port)
 {
-    if (m_server) {
+    if (m_acceptor) {
         stop();
     }
 
-    m_server = new QWebSocketServer("CollabRef Server", 
-                                     QWebSocketServer::NonSecureMode, this);
+    m_acceptor = new ConnectionAcceptor(m_config);
+    m_acceptor->moveToThread(m_acceptThread);
+    connect(m_acceptor, &ConnectionAcceptor::clientConnected,
+            this, &SyncServer::clientConnected);
+    connect(m_acceptor, &ConnectionAcceptor::clientDisconnected,
+            this, &SyncServer::clientDisconnected);
+    m_acceptThread->start();
     
-    if (m_server->listen(QHostAddress::Any, port)) {
-        connect(m_server, &QWebSocketServer::newConnection,
-                this, &SyncServer::onNewConnection);
-        
-        // Load existing state from disk
-        loadState();
-        
-        // Start auto-save timer
-        m_saveTimer->start(30000);  // 30 seconds
-        
-        emit serverStarted(m_server->serverPort());
-        return true;
-    } else {
-        QString error = m_server->errorString();
-        delete m_server;
-        m_server = nullptr;
+    // Listening is quick; wait for it so callers get the result directly
+    ConnectionAcceptor *acceptor = m_acceptor;
+    QString error;
+    bool listening = false;
+    QMetaObject::invokeMethod(acceptor, [acceptor, port, &error]() {
+        return acceptor->listen(port, &error);
+    }, Qt::BlockingQueuedConnection, &listening);
+    
+    if (!listening) {
+        releaseAcceptor();
         emit errorOccurred(error);
         return false;
     }
+    
+    QMetaObject::invokeMethod(acceptor, [acceptor]() {
+        return acceptor->port();
+    }, Qt::BlockingQueuedConnection, &m_port);
+    
+    emit serverStarted(m_port);
+    return true;
 }
 
 void SyncServer::stop()
 {
-    if (m_server) {
-        // Save state before stopping
-        saveState();
-        m_saveTimer->stop();
-        
-        // Close all client connections
-        for (QWebSocket *client : m_clients) {
-            client->close();
-        }
-        m_clients.clear();
-        m_clientIds.clear();
-        m_clientsById.clear();
-        
-        // Don't clear state - keep it for next start
-        // m_boardState = QJsonArray();
-        // m_textState = QJsonArray();
-        
-        m_server->close();
-        delete m_server;
-        m_server = nullptr;
-        emit serverStopped();
-    }
+    if (!m_acceptor) return;
+    
+    // Rooms save their state and close their clients on the way down
+    ConnectionAcceptor *acceptor = m_acceptor;
+    QMetaObject::invokeMethod(acceptor, [acceptor]() {
+        acceptor->shutdown();
+    }, Qt::BlockingQueuedConnection);
+    
+    releaseAcceptor();
+    m_port = 0;
+    
+    emit serverStopped();
+}
+
+void SyncServer::releaseAcceptor()
+{
+    // Bring it back to this thread so it can be deleted here
+    ConnectionAcceptor *acceptor = m_acceptor;
+    QThread *home = thread();
+    QMetaObject::invokeMethod(acceptor, [acceptor, home]() {
+        acceptor->moveToThread(home);
+    }, Qt::BlockingQueuedConnection);
+    
+    m_acceptThread->quit();
+    m_acceptThread->wait();
+    delete m_acceptor;
+    m_acceptor = nullptr;
 }
 
 bool SyncServer::isRunning() const
 {
-    return m_server && m_server->isListening();
+    return m_acceptor != nullptr;
 }
 
 quint16 SyncServer::port() const
 {
-    return m_server ? m_server->serverPort() : 0;
+    return m_port;
+}
+
+int SyncServer::clientCount() const
+{
+    return m_acceptor ? m_acceptor->clientCount() : 0;
+}
+
+QJsonObject SyncServer::trafficJson() const
+{
+    return m_acceptor ? m_acceptor->traffic()->toJson() : QJsonObject();
 }
 
 QString SyncServer::localAddress() const
@@ -120,320 +137,23 @@ QString SyncServer::localAddress() const
     return "127.0.0.1";
 }
 
-void SyncServer::onNewConnection()
-{
-    QWebSocket *client = m_server->nextPendingConnection();
-    if (!client) return;
-
-    QString clientId = QUuid::createUuid().toString(QUuid::WithoutBraces).left(8);
-    
-    m_clients.append(client);
-    m_clientIds.insert(client, clientId);
-    m_clientsById.insert(clientId, client);
-
-    connect(client, &QWebSocket::textMessageReceived,
-            this, &SyncServer::onTextMessageReceived);
-    connect(client, &QWebSocket::disconnected,
-            this, &SyncServer::onClientDisconnected);
-
-    emit clientConnected(clientId);
-
-    // Send current board state to new client
-    if (!m_boardState.isEmpty() || !m_textState.isEmpty()) {
-        QJsonObject syncMsg;
-        syncMsg["type"] = "fullSync";
-        syncMsg["images"] = m_boardState;
-        syncMsg["texts"] = m_textState;
-        sendToClient(clientId, syncMsg);
-    }
-}
-
-void SyncServer::onClientDisconnected()
-{
-    QWebSocket *client = qobject_cast<QWebSocket*>(sender());
-    if (!client) return;
-
-    QString clientId = m_clientIds.value(client);
-    
-    m_clients.removeAll(client);
-    m_clientIds.remove(client);
-    m_clientsById.remove(clientId);
-    
-    client->deleteLater();
-
-    emit clientDisconnected(clientId);
-
-    // Notify other clients
-    QJsonObject leaveMsg;
-    leaveMsg["type"] = "leave";
-    leaveMsg["userId"] = clientId;
-    broadcast(leaveMsg, clientId);
-}
-
-void SyncServer::onTextMessageReceived(const QString &message)
-{
-    QWebSocket *client = qobject_cast<QWebSocket*>(sender());
-    if (!client) return;
-
-    QString clientId = m_clientIds.value(client);
-
-    QJsonDocument doc = QJsonDocument::fromJson(message.toUtf8());
-    if (!doc.isObject()) return;
-
-    QJsonObject msg = doc.object();
-    QString type = msg["type"].toString();
-
-    // Handle different message types
-    if (type == "join") {
-        // Broadcast join to others
-        msg["userId"] = clientId;
-        broadcast(msg, clientId);
-        
-        // Send user list to the joining client
-        QJsonObject userListMsg;
-        userListMsg["type"] = "userList";
-        QJsonArray users;
-        for (const QString &id : m_clientsById.keys()) {
-            if (id != clientId) {
-                QJsonObject user;
-                user["userId"] = id;
-                users.append(user);
-            }
-        }
-        userListMsg["users"] = users;
-        sendToClient(clientId, userListMsg);
-    }
-    else if (type == "cursor") {
-        // Forward cursor updates to others
-        msg["userId"] = clientId;
-        broadcast(msg, clientId);
-    }
-    else if (type == "imageAdd") {
-        // Check if image already exists (from another client's sync)
-        QString imageId = msg["imageId"].toString();
-        bool exists = false;
-        for (int i = 0; i < m_boardState.count(); i++) {
-            QJsonObject img = m_boardState[i].toObject();
-            if (img["imageId"].toString() == imageId) {
-                exists = true;
-                break;
-            }
-        }
-        if (!exists) {
-            m_boardState.append(msg);
-            saveState();  // Save immediately on add
-        }
-        msg["userId"] = clientId;
-        broadcast(msg, clientId);
-    }
-    else if (type == "imageUpdate") {
-        // Update stored state and broadcast
-        QString imageId = msg["imageId"].toString();
-        for (int i = 0; i < m_boardState.count(); i++) {
-            QJsonObject img = m_boardState[i].toObject();
-            if (img["imageId"].toString() == imageId) {
-                // Merge update into stored image
-                for (auto it = msg.begin(); it != msg.end(); ++it) {
-                    img[it.key()] = it.value();
-                }
-                m_boardState[i] = img;
-                break;
-            }
-        }
-        msg["userId"] = clientId;
-        broadcast(msg, clientId);
-    }
-    else if (type == "imageRemove") {
-        // Remove from stored state and broadcast
-        QString imageId = msg["imageId"].toString();
-        for (int i = 0; i < m_boardState.count(); i++) {
-            QJsonObject img = m_boardState[i].toObject();
-            if (img["imageId"].toString() == imageId) {
-                m_boardState.removeAt(i);
-                saveState();  // Save immediately on delete
-                break;
-            }
-        }
-        msg["userId"] = clientId;
-        broadcast(msg, clientId);
-    }
-    else if (type == "textAdd") {
-        // Check if text already exists
-        QString textId = msg["textId"].toString();
-        bool exists = false;
-        for (int i = 0; i < m_textState.count(); i++) {
-            QJsonObject txt = m_textState[i].toObject();
-            if (txt["textId"].toString() == textId) {
-                exists = true;
-                break;
-            }
-        }
-        if (!exists) {
-            m_textState.append(msg);
-            saveState();  // Save immediately on add
-        }
-        msg["userId"] = clientId;
-        broadcast(msg, clientId);
-    }
-    else if (type == "textUpdate") {
-        QString textId = msg["textId"].toString();
-        for (int i = 0; i < m_textState.count(); i++) {
-            QJsonObject txt = m_textState[i].toObject();
-            if (txt["textId"].toString() == textId) {
-                for (auto it = msg.begin(); it != msg.end(); ++it) {
-                    txt[it.key()] = it.value();
-                }
-                m_textState[i] = txt;
-                break;
-            }
-        }
-        msg["userId"] = clientId;
-        broadcast(msg, clientId);
-    }
-    else if (type == "textRemove") {
-        QString textId = msg["textId"].toString();
-        for (int i = 0; i < m_textState.count(); i++) {
-            QJsonObject txt = m_textState[i].toObject();
-            if (txt["textId"].toString() == textId) {
-                m_textState.removeAt(i);
-                saveState();  // Save immediately on delete
-                break;
-            }
-        }
-        msg["userId"] = clientId;
-        broadcast(msg, clientId);
-    }
-    else if (type == "requestSync") {
-        // Send full board state
-        QJsonObject syncMsg;
-        syncMsg["type"] = "fullSync";
-        syncMsg["images"] = m_boardState;
-        syncMsg["texts"] = m_textState;
-        sendToClient(clientId, syncMsg);
-    }
-    else if (type == "pushSync") {
-        // Client is pushing their local state (after reconnect)
-        // Merge with existing state
-        QJsonArray clientImages = msg["images"].toArray();
-        QJsonArray clientTexts = msg["texts"].toArray();
-        
-        bool stateChanged = false;
-        
-        // Merge images
-        for (const QJsonValue &val : clientImages) {
-            QJsonObject img = val.toObject();
-            QString imageId = img["imageId"].toString();
-            bool exists = false;
-            for (int i = 0; i < m_boardState.count(); i++) {
-                if (m_boardState[i].toObject()["imageId"].toString() == imageId) {
-                    exists = true;
-                    break;
-                }
-            }
-            if (!exists) {
-                m_boardState.append(img);
-                stateChanged = true;
-            }
-        }
-        
-        // Merge texts
-        for (const QJsonValue &val : clientTexts) {
-            QJsonObject txt = val.toObject();
-            QString textId = txt["textId"].toString();
-            bool exists = false;
-            for (int i = 0; i < m_textState.count(); i++) {
-                if (m_textState[i].toObject()["textId"].toString() == textId) {
-                    exists = true;
-                    break;
-                }
-            }
-            if (!exists) {
-                m_textState.append(txt);
-                stateChanged = true;
-            }
-        }
-        
-        // Always send full state to the pushing client
-        QJsonObject syncMsg;
-        syncMsg["type"] = "fullSync";
-        syncMsg["images"] = m_boardState;
-        syncMsg["texts"] = m_textState;
-        sendToClient(clientId, syncMsg);
-        
-        // If state changed, broadcast full state to ALL other clients too
-        // This ensures everyone gets synced regardless of timing
-        if (stateChanged) {
-            broadcast(syncMsg, clientId);
-        }
-    }
-    else {
-        // Forward other messages
-        msg["userId"] = clientId;
-        broadcast(msg, clientId);
-    }
-
-    emit messageReceived(clientId, msg);
-}
-
-void SyncServer::broadcast(const QJsonObject &message, const QString &excludeClientId)
-{
-    QByteArray data = QJsonDocument(message).toJson(QJsonDocument::Compact);
-    
-    for (QWebSocket *client : m_clients) {
-        QString clientId = m_clientIds.value(client);
-        if (clientId != excludeClientId) {
-            client->sendTextMessage(QString::fromUtf8(data));
-        }
-    }
-}
-
-void SyncServer::sendToClient(const QString &clientId, const QJsonObject &message)
-{
-    QWebSocket *client = m_clientsById.value(clientId);
-    if (client) {
-        QByteArray data = QJsonDocument(message).toJson(QJsonDocument::Compact);
-        client->sendTextMessage(QString::fromUtf8(data));
-    }
-}
-
 void SyncServer::setSaveFile(const QString &path)
 {
-    m_saveFilePath = path;
+    // Takes effect on the next start()
+    m_config.saveFilePath = path;
 }
 
-void SyncServer::saveState()
+void SyncServer::setConfig(const ServerConfig &config)
 {
-    if (m_saveFilePath.isEmpty()) return;
-    if (m_boardState.isEmpty() && m_textState.isEmpty()) return;
-    
-    QJsonObject root;
-    root["images"] = m_boardState;
-    root["texts"] = m_textState;
-    root["savedAt"] = QDateTime::currentDateTime().toString(Qt::ISODate);
-    
-    QFile file(m_saveFilePath);
-    if (file.open(QIODevice::WriteOnly)) {
-        file.write(QJsonDocument(root).toJson());
-        file.close();
-    }
+    m_config = config;
 }
 
-void SyncServer::loadState()
+void SyncServer::saveState()
 {
-    if (m_saveFilePath.isEmpty()) return;
-    
-    QFile file(m_saveFilePath);
-    if (!file.exists()) return;
+    if (!m_acceptor) return;
     
-    if (file.open(QIODevice::ReadOnly)) {
-        QByteArray data = file.readAll();
-        file.close();
-        
-        QJsonDocument doc = QJsonDocument::fromJson(data);
-        if (doc.isObject()) {
-            QJsonObject root = doc.object();
-            m_boardState = root["images"].toArray();
-            m_textState = root["texts"].toArray();
-        }
-    }
+    ConnectionAcceptor *acceptor = m_acceptor;
+    QMetaObject::invokeMethod(acceptor, [acceptor]() {
+        acceptor->saveAll();
+    }, Qt::QueuedConnection);
 }
@@ -2,14 +2,16 @@
 #define SYNCSERVER_H
 
 #include <QObject>
-#include <QWebSocketServer>
-#include <QWebSocket>
-#include <QList>
+#include <QThread>
+#include <QString>
 #include <QJsonObject>
-#include <QJsonDocument>
-#include <QJsonArray>
-#include <QTimer>
+#include "ServerConfig.h"
 
+class ConnectionAcceptor;
+
+// GUI-thread facade for the built-in server. Connections are accepted on
+// a dedicated thread and every room (with its clients' sockets) runs on a
+// worker thread, so parsing, merging and saving never block the host's UI.
 class SyncServer : public QObject
 {
     Q_OBJECT
@@ -23,43 +25,32 @@ public:
     bool isRunning() const;
     quint16 port() const;
     QString localAddress() const;
-    int clientCount() const { return m_clients.count(); }
+    int clientCount() const;
+    // Traffic of every room by type and client, with queue depths; safe
+    // to read while the server runs
+    QJsonObject trafficJson() const;
     
+    // Board file of the default room; other rooms are saved next to it
     void setSaveFile(const QString &path);
+    // Limits and persistence; like the save file, used from the next start()
+    void setConfig(const ServerConfig &config);
+    ServerConfig config() const { return m_config; }
     void saveState();
-    void loadState();
 
 signals:
     void clientConnected(const QString &clientId);
     void clientDisconnected(const QString &clientId);
-    void messageReceived(const QString &clientId, const QJsonObject &message);
     void serverStarted(quint16 port);
     void serverStopped();
     void errorOccurred(const QString &error);
 
-public slots:
-    void broadcast(const QJsonObject &message, const QString &excludeClientId = QString());
-    void sendToClient(const QString &clientId, const QJsonObject &message);
-
-private slots:
-    void onNewConnection();
-    void onClientDisconnected();
-    void onTextMessageReceived(const QString &message);
-
 private:
-    QWebSocketServer *m_server;
-    QList<QWebSocket*> m_clients;
-    QHash<QWebSocket*, QString> m_clientIds;
-    QHash<QString, QWebSocket*> m_clientsById;
-    
-    // Room state for syncing
-    QJsonArray m_boardState;  // Images
-    QJsonArray m_textState;   // Text items
-    QString m_roomId;
+    void releaseAcceptor();
     
-    // Persistence
-    QString m_saveFilePath;
-    QTimer *m_saveTimer;
+    QThread *m_acceptThread;
+    ConnectionAcceptor *m_acceptor;
+    ServerConfig m_config;
+    quint16 m_port;
 };
 
 #endif // SYNCSERVER_H
@@ -0,0 +1,201 @@
+#include "TrafficStats.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <QJsonDocument>
+#include <QMutexLocker>
+
+namespace {
+
+qint64 currentSecond()
+{
+    return QDateTime::currentMSecsSinceEpoch() / 1000;
+}
+
+QString directionKey(TrafficStats::Direction direction)
+{
+    return direction == TrafficStats::Inbound ? QStringLiteral("in") : QStringLiteral("out");
+}
+
+} // namespace
+
+void TrafficStats::Counter::add(qint64 size, qint64 second)
+{
+    messages++;
+    bytes += size;
+    
+    int slot = int(second % RATE_WINDOW);
+    if (slotSecond[slot] != second) {
+        slotSecond[slot] = second;
+        slotMessages[slot] = 0;
+        slotBytes[slot] = 0;
+    }
+    slotMessages[slot]++;
+    slotBytes[slot] += size;
+}
+
+QJsonObject TrafficStats::Counter::toJson(qint64 second) const
+{
+    // Whole seconds only; the current one is still filling up
+    qint64 windowMessages = 0;
+    qint64 windowBytes = 0;
+    for (int i = 0; i < RATE_WINDOW; ++i) {
+        if (slotSecond[i] < second && slotSecond[i] >= second - RATE_WINDOW) {
+            windowMessages += slotMessages[i];
+            windowBytes += slotBytes[i];
+        }
+    }
+    
+    QJsonObject json;
+    json["messages"] = messages;
+    json["bytes"] = bytes;
+    json["messagesPerSec"] = double(windowMessages) / RATE_WINDOW;
+    json["bytesPerSec"] = double(windowBytes) / RATE_WINDOW;
+    return json;
+}
+
+TrafficStats::TrafficStats()
+    : m_since(QDateTime::currentMSecsSinceEpoch())
+{
+}
+
+void TrafficStats::record(Direction direction, const QString &type, const QString &peer,
+                          qint64 bytes)
+{
+    qint64 second = currentSecond();
+    QMutexLocker locker(&m_mutex);
+    
+    m_total[direction].add(bytes, second);
+    m_byType[direction][type].add(bytes, second);
+    if (!peer.isEmpty()) {
+        m_byPeer[direction][peer].add(bytes, second);
+    }
+}
+
+void TrafficStats::setQueue(const QString &peer, int frames, qint64 bytes, qint64 unwritten)
+{
+    QMutexLocker locker(&m_mutex);
+    
+    Queue &queue = m_queues[peer];
+    queue.frames = frames;
+    queue.bytes = bytes;
+    queue.unwritten = unwritten;
+    queue.peakBytes = qMax(queue.peakBytes, bytes + unwritten);
+}
+
+void TrafficStats::forgetPeer(const QString &peer)
+{
+    QMutexLocker locker(&m_mutex);
+    
+    m_byPeer[Inbound].remove(peer);
+    m_byPeer[Outbound].remove(peer);
+    m_queues.remove(peer);
+}
+
+qint64 TrafficStats::totalMessages(Direction direction) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_total[direction].messages;
+}
+
+qint64 TrafficStats::totalBytes(Direction direction) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_total[direction].bytes;
+}
+
+QJsonObject TrafficStats::toJson() const
+{
+    qint64 second = currentSecond();
+    QMutexLocker locker(&m_mutex);
+    
+    QJsonObject json;
+    json["since"] = m_since;
+    json["at"] = QDateTime::currentMSecsSinceEpoch();
+    
+    for (Direction direction : {Inbound, Outbound}) {
+        QJsonObject byType;
+        for (auto it = m_byType[direction].constBegin(); it != m_byType[direction].constEnd(); ++it) {
+            byType[it.key()] = it.value().toJson(second);
+        }
+        QJsonObject byPeer;
+        for (auto it = m_byPeer[direction].constBegin(); it != m_byPeer[direction].constEnd(); ++it) {
+            byPeer[it.key()] = it.value().toJson(second);
+        }
+        
+        QJsonObject traffic;
+        traffic["total"] = m_total[direction].toJson(second);
+        traffic["byType"] = byType;
+        if (!byPeer.isEmpty()) {
+            traffic["byPeer"] = byPeer;
+        }
+        json[directionKey(direction)] = traffic;
+    }
+    
+    QJsonObject queues;
+    for (auto it = m_queues.constBegin(); it != m_queues.constEnd(); ++it) {
+        QJsonObject queue;
+        queue["frames"] = it.value().frames;
+        queue["bytes"] = it.value().bytes;
+        queue["unwritten"] = it.value().unwritten;
+        queue["peakBytes"] = it.value().peakBytes;
+        queues[it.key().isEmpty() ? QStringLiteral("server") : it.key()] = queue;
+    }
+    json["queues"] = queues;
+    return json;
+}
+
+void TrafficStats::reset()
+{
+    QMutexLocker locker(&m_mutex);
+    
+    m_since = QDateTime::currentMSecsSinceEpoch();
+    for (Direction direction : {Inbound, Outbound}) {
+        m_total[direction] = Counter();
+        m_byType[direction].clear();
+        m_byPeer[direction].clear();
+    }
+    m_queues.clear();
+}
+
+TrafficLog::TrafficLog(const QString &path, QObject *parent)
+    : QObject(parent)
+    , m_path(path)
+    , m_timer(new QTimer(this))
+{
+    connect(m_timer, &QTimer::timeout, this, &TrafficLog::writeEntry);
+}
+
+void TrafficLog::addSource(const QString &name, std::function<QJsonObject()> source)
+{
+    m_sources.append(qMakePair(name, std::move(source)));
+}
+
+void TrafficLog::start(int intervalMs)
+{
+    m_timer->start(intervalMs);
+}
+
+void TrafficLog::stop()
+{
+    m_timer->stop();
+}
+
+void TrafficLog::writeEntry()
+{
+    QJsonObject entry;
+    entry["time"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODateWithMs);
+    for (const auto &source : m_sources) {
+        entry[source.first] = source.second();
+    }
+    
+    // JSON lines: one object per entry, easy to tail and to load
+    QFile file(m_path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qWarning() << "Traffic log: cannot write" << m_path;
+        m_timer->stop();
+        return;
+    }
+    file.write(QJsonDocument(entry).toJson(QJsonDocument::Compact) + '\n');
+}
@@ -0,0 +1,92 @@
+#ifndef TRAFFICSTATS_H
+#define TRAFFICSTATS_H
+
+#include <QObject>
+#include <QHash>
+#include <QJsonObject>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QTimer>
+#include <array>
+#include <functional>
+
+// Messages and bytes in and out, per message type and per peer, each with
+// its rate over the last few seconds, plus how much is waiting to go out
+// to every peer. Thread-safe: all of a server's rooms record into one.
+class TrafficStats
+{
+public:
+    enum Direction { Inbound, Outbound };
+
+    TrafficStats();
+
+    // peer is a client id on the server; empty where there's only one peer
+    void record(Direction direction, const QString &type, const QString &peer, qint64 bytes);
+    // Frames and bytes queued for peer, and bytes its socket took but
+    // hasn't written to the network yet
+    void setQueue(const QString &peer, int frames, qint64 bytes, qint64 unwritten);
+    // The peer is gone; drops its counters and queue
+    void forgetPeer(const QString &peer);
+
+    qint64 totalMessages(Direction direction) const;
+    qint64 totalBytes(Direction direction) const;
+
+    QJsonObject toJson() const;
+    void reset();
+
+private:
+    static constexpr int RATE_WINDOW = 10;     // Seconds the rates average over
+
+    // Running totals plus per-second counts of the last RATE_WINDOW seconds
+    struct Counter {
+        qint64 messages = 0;
+        qint64 bytes = 0;
+        std::array<qint64, RATE_WINDOW> slotSecond {};
+        std::array<qint64, RATE_WINDOW> slotMessages {};
+        std::array<qint64, RATE_WINDOW> slotBytes {};
+
+        void add(qint64 size, qint64 second);
+        QJsonObject toJson(qint64 second) const;
+    };
+
+    struct Queue {
+        int frames = 0;
+        qint64 bytes = 0;
+        qint64 unwritten = 0;
+        qint64 peakBytes = 0;
+    };
+
+    mutable QMutex m_mutex;
+    qint64 m_since;
+    Counter m_total[2];
+    QHash<QString, Counter> m_byType[2];
+    QHash<QString, Counter> m_byPeer[2];
+    QHash<QString, Queue> m_queues;
+};
+
+// Appends one line of JSON per interval to a file, built from any number
+// of named sources (client and server traffic, latency, ...)
+class TrafficLog : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TrafficLog(const QString &path, QObject *parent = nullptr);
+
+    void addSource(const QString &name, std::function<QJsonObject()> source);
+    void start(int intervalMs = DEFAULT_INTERVAL_MS);
+    void stop();
+
+private slots:
+    void writeEntry();
+
+private:
+    QString m_path;
+    QList<QPair<QString, std::function<QJsonObject()>>> m_sources;
+    QTimer *m_timer;
+
+    static constexpr int DEFAULT_INTERVAL_MS = 10000;
+};
+
+#endif // TRAFFICSTATS_H
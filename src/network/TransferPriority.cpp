@@ -0,0 +1,42 @@
+#include "TransferPriority.h"
+#include <QtMath>
+
+QRectF TransferPriority::itemRect(qreal x, qreal y, const QSizeF &size, qreal scale)
+{
+    QSizeF scaled = size * scale;
+    return QRectF(x - scaled.width() / 2, y - scaled.height() / 2,
+                  scaled.width(), scaled.height());
+}
+
+int TransferPriority::standInSize(const QJsonObject &mips)
+{
+    int largest = PREVIEW_SIZE;
+    for (auto it = mips.begin(); it != mips.end(); ++it) {
+        largest = qMax(largest, it.key().toInt());
+    }
+    return largest;
+}
+
+qreal TransferPriority::score(const QRectF &itemRect, bool isPreview, bool hasPreview,
+                              const QRectF &viewport, qreal zoom, int previewSize)
+{
+    // Gap between the item and the viewport, zero when it's on screen
+    qreal dx = qMax<qreal>(0, qMax(viewport.left() - itemRect.right(),
+                                   itemRect.left() - viewport.right()));
+    qreal dy = qMax<qreal>(0, qMax(viewport.top() - itemRect.bottom(),
+                                   itemRect.top() - viewport.bottom()));
+    qreal distance = qSqrt(dx * dx + dy * dy);
+    bool visible = distance == 0;
+    
+    // A preview already looks sharp while the item is drawn this small
+    qreal shownPixels = qMax(itemRect.width(), itemRect.height()) * zoom;
+    bool previewEnough = hasPreview && shownPixels <= previewSize;
+    
+    int tier;
+    if (isPreview) {
+        tier = visible ? 0 : 2;
+    } else {
+        tier = (visible && !previewEnough) ? 1 : 3;
+    }
+    return tier * TIER_SPAN + distance;
+}
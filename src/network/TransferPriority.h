@@ -0,0 +1,32 @@
+#ifndef TRANSFERPRIORITY_H
+#define TRANSFERPRIORITY_H
+
+#include <QJsonObject>
+#include <QRectF>
+#include <QSizeF>
+
+// Orders blob transfers by what a viewer actually needs: previews of what
+// is on screen first, then the on-screen images whose previews are too
+// small at the current zoom, then the same for everything off screen,
+// nearest first. Lower scores go out sooner.
+class TransferPriority
+{
+public:
+    // Board items are positioned by their centre
+    static QRectF itemRect(qreal x, qreal y, const QSizeF &size, qreal scale);
+    
+    // previewSize is the longest edge of the sharpest stand-in the item has
+    static qreal score(const QRectF &itemRect, bool isPreview, bool hasPreview,
+                       const QRectF &viewport, qreal zoom, int previewSize = PREVIEW_SIZE);
+    // Largest level of a server-made mip set, or PREVIEW_SIZE without one
+    static int standInSize(const QJsonObject &mips);
+
+    static constexpr int PREVIEW_SIZE = 256;    // Longest preview edge, in pixels
+
+private:
+    TransferPriority() = default;
+    
+    static constexpr qreal TIER_SPAN = 1e9;     // Larger than any scene distance
+};
+
+#endif // TRANSFERPRIORITY_H
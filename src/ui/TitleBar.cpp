@@ -52,6 +52,12 @@ void TitleBar::setupUI()
     m_connectionIndicator->setToolTip("Not connected");
     layout->addWidget(m_connectionIndicator);
     
+    // Round trip to the server
+    m_latencyLabel = new QLabel(this);
+    m_latencyLabel->setStyleSheet("color: #888; font-size: 10px; margin-left: 6px;");
+    m_latencyLabel->hide();
+    layout->addWidget(m_latencyLabel);
+    
     layout->addSpacing(16);
     
     // Notification label
@@ -128,6 +134,26 @@ void TitleBar::setConnectionStatus(bool connected)
     }
 }
 
+void TitleBar::setLatency(int rttMs, const QString &details)
+{
+    if (rttMs < 0) {
+        m_latencyLabel->hide();
+        return;
+    }
+    
+    QString color = "#888";
+    if (rttMs >= 250) {
+        color = "#e74c3c";
+    } else if (rttMs >= 100) {
+        color = "#f1c40f";
+    }
+    m_latencyLabel->setStyleSheet(
+        QString("color: %1; font-size: 10px; margin-left: 6px;").arg(color));
+    m_latencyLabel->setText(QString("%1 ms").arg(rttMs));
+    m_latencyLabel->setToolTip(details);
+    m_latencyLabel->show();
+}
+
 void TitleBar::showNotification(const QString &text, int durationMs)
 {
     m_notificationLabel->setText(text);
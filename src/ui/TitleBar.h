@@ -17,6 +17,9 @@ public:
 
     void setTitle(const QString &title);
     void setConnectionStatus(bool connected);
+    // Round trip next to the connection dot, details in its tooltip;
+    // hidden while rttMs is negative
+    void setLatency(int rttMs, const QString &details);
     void showNotification(const QString &text, int durationMs = 3000);
 
 signals:
@@ -37,6 +40,7 @@ private:
     QLabel *m_titleLabel;
     QLabel *m_notificationLabel;
     QLabel *m_connectionIndicator;
+    QLabel *m_latencyLabel;
     QPushButton *m_minimizeBtn;
     QPushButton *m_maximizeBtn;
     QPushButton *m_closeBtn;
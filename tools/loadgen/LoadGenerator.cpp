@@ -0,0 +1,207 @@
+#include "LoadGenerator.h"
+#include "network/LatencyStats.h"
+#include "network/SyncClient.h"
+#include "network/TrafficStats.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QMap>
+#include <QTimer>
+
+namespace {
+
+QString megabytes(double bytes)
+{
+    return QString::number(bytes / (1024.0 * 1024.0), 'f', 1) + " MB";
+}
+
+} // namespace
+
+LoadGenerator::LoadGenerator(const Options &options, const LoadProfile &profile,
+                             QObject *parent)
+    : QObject(parent)
+    , m_options(options)
+    , m_profile(profile)
+    , m_rampTimer(new QTimer(this))
+    , m_reportTimer(new QTimer(this))
+    , m_out(stdout)
+    , m_lastReportMs(0)
+    , m_lastMessagesOut(0)
+    , m_lastBytesOut(0)
+    , m_lastMessagesIn(0)
+    , m_lastBytesIn(0)
+    , m_peakServerMemory(-1)
+{
+    connect(m_rampTimer, &QTimer::timeout, this, &LoadGenerator::spawnUser);
+    connect(m_reportTimer, &QTimer::timeout, this, &LoadGenerator::report);
+}
+
+void LoadGenerator::start()
+{
+    m_out << "Simulating " << m_options.users << " users in room \"" << m_options.roomId
+          << "\" on " << m_options.url << " for " << m_options.durationSec << " s" << Qt::endl;
+    
+    m_clock.start();
+    spawnUser();
+    m_rampTimer->start(qMax(1, m_options.rampMs));
+    m_reportTimer->start(qMax(1, m_options.reportEverySec) * 1000);
+    QTimer::singleShot(m_options.durationSec * 1000, this, &LoadGenerator::finish);
+}
+
+void LoadGenerator::spawnUser()
+{
+    if (m_users.size() >= m_options.users) {
+        m_rampTimer->stop();
+        return;
+    }
+    
+    SimulatedUser *user = new SimulatedUser(m_users.size(), m_profile, this);
+    m_users.append(user);
+    user->start(m_options.url, m_options.roomId);
+}
+
+void LoadGenerator::report()
+{
+    qint64 messagesOut = 0;
+    qint64 bytesOut = 0;
+    qint64 messagesIn = 0;
+    qint64 bytesIn = 0;
+    int synchronized = 0;
+    for (const SimulatedUser *user : m_users) {
+        const TrafficStats &traffic = user->client()->traffic();
+        messagesOut += traffic.totalMessages(TrafficStats::Outbound);
+        bytesOut += traffic.totalBytes(TrafficStats::Outbound);
+        messagesIn += traffic.totalMessages(TrafficStats::Inbound);
+        bytesIn += traffic.totalBytes(TrafficStats::Inbound);
+        if (user->isSynchronized()) {
+            synchronized++;
+        }
+    }
+    
+    qint64 now = m_clock.elapsed();
+    double seconds = qMax<qint64>(1, now - m_lastReportMs) / 1000.0;
+    
+    m_out << QString("%1s  users %2/%3  out %4 msg/s %5/s  in %6 msg/s %7/s")
+                 .arg(now / 1000, 4)
+                 .arg(synchronized)
+                 .arg(m_options.users)
+                 .arg(qRound((messagesOut - m_lastMessagesOut) / seconds))
+                 .arg(megabytes((bytesOut - m_lastBytesOut) / seconds))
+                 .arg(qRound((messagesIn - m_lastMessagesIn) / seconds))
+                 .arg(megabytes((bytesIn - m_lastBytesIn) / seconds));
+    
+    qint64 memory = serverMemory();
+    if (memory >= 0) {
+        m_peakServerMemory = qMax(m_peakServerMemory, memory);
+        m_out << "  server " << megabytes(memory);
+    }
+    m_out << Qt::endl;
+    
+    m_lastReportMs = now;
+    m_lastMessagesOut = messagesOut;
+    m_lastBytesOut = bytesOut;
+    m_lastMessagesIn = messagesIn;
+    m_lastBytesIn = bytesIn;
+}
+
+void LoadGenerator::finish()
+{
+    m_rampTimer->stop();
+    m_reportTimer->stop();
+    report();
+    
+    QJsonObject result = summary();
+    
+    // Fan-out: a sender's send until each receiver has handled it
+    m_out << Qt::endl << "Fan-out latency (ms)" << Qt::endl;
+    m_out << QString("  %1 %2 %3 %4 %5 %6 %7")
+                 .arg("type", -14).arg("count", 9).arg("mean", 7)
+                 .arg("p50", 6).arg("p95", 6).arg("p99", 6).arg("max", 7) << Qt::endl;
+    const QJsonObject fanOut = result["fanOut"].toObject();
+    for (auto it = fanOut.constBegin(); it != fanOut.constEnd(); ++it) {
+        QJsonObject row = it.value().toObject();
+        m_out << QString("  %1 %2 %3 %4 %5 %6 %7")
+                     .arg(it.key(), -14)
+                     .arg(row["count"].toVariant().toLongLong(), 9)
+                     .arg(row["mean"].toDouble(), 7, 'f', 1)
+                     .arg(row["p50"].toVariant().toLongLong(), 6)
+                     .arg(row["p95"].toVariant().toLongLong(), 6)
+                     .arg(row["p99"].toVariant().toLongLong(), 6)
+                     .arg(row["max"].toVariant().toLongLong(), 7)
+              << Qt::endl;
+    }
+    m_out << "Mean round trip " << QString::number(result["rtt"].toDouble(), 'f', 1) << " ms";
+    if (m_peakServerMemory >= 0) {
+        m_out << ", peak server memory " << megabytes(m_peakServerMemory);
+    }
+    m_out << Qt::endl;
+    
+    if (!m_options.jsonPath.isEmpty()) {
+        QFile file(m_options.jsonPath);
+        if (file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            file.write(QJsonDocument(result).toJson());
+        } else {
+            m_out << "Cannot write " << m_options.jsonPath << Qt::endl;
+        }
+    }
+    
+    for (SimulatedUser *user : m_users) {
+        user->stop();
+    }
+    emit finished();
+}
+
+qint64 LoadGenerator::serverMemory() const
+{
+    if (m_options.serverPid <= 0) return -1;
+    
+    QFile status(QString("/proc/%1/status").arg(m_options.serverPid));
+    if (!status.open(QIODevice::ReadOnly)) return -1;
+    
+    // "VmRSS:    123456 kB"
+    while (!status.atEnd()) {
+        QByteArray line = status.readLine();
+        if (line.startsWith("VmRSS:")) {
+            return line.mid(6).trimmed().split(' ').first().toLongLong() * 1024;
+        }
+    }
+    return -1;
+}
+
+QJsonObject LoadGenerator::summary() const
+{
+    QMap<QString, LatencyHistogram> fanOut;
+    double rttSum = 0;
+    int rttCount = 0;
+    qint64 imagesAdded = 0;
+    for (const SimulatedUser *user : m_users) {
+        const LatencyStats &latency = user->client()->latency();
+        for (const QString &type : latency.types()) {
+            fanOut[type].merge(latency.histogram(type));
+        }
+        if (latency.hasEstimate()) {
+            rttSum += latency.rtt();
+            rttCount++;
+        }
+        imagesAdded += user->imagesAdded();
+    }
+    
+    QJsonObject fanOutJson;
+    for (auto it = fanOut.constBegin(); it != fanOut.constEnd(); ++it) {
+        QJsonObject row = it.value().toJson();
+        row["p99"] = it.value().percentile(0.99);
+        fanOutJson[it.key()] = row;
+    }
+    
+    QJsonObject result;
+    result["users"] = m_users.size();
+    result["durationSec"] = m_clock.elapsed() / 1000.0;
+    result["imagesAdded"] = imagesAdded;
+    result["rtt"] = rttCount > 0 ? rttSum / rttCount : 0.0;
+    result["fanOut"] = fanOutJson;
+    if (m_peakServerMemory >= 0) {
+        result["peakServerMemory"] = m_peakServerMemory;
+    }
+    return result;
+}
@@ -0,0 +1,70 @@
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+#include <QTextStream>
+#include "SimulatedUser.h"
+
+class QTimer;
+
+// Brings up simulated users against a server one after the other, prints
+// throughput (and the server's memory, given its pid) every few seconds,
+// and at the end how long each kind of op took to fan out from its sender
+// to everyone else.
+class LoadGenerator : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Options {
+        QString url = "ws://127.0.0.1:8080";
+        QString roomId = "loadgen";
+        int users = 10;
+        int rampMs = 100;           // Between two users joining
+        int durationSec = 60;       // From the first join
+        int reportEverySec = 5;
+        qint64 serverPid = 0;       // Sampled for memory when set (Linux)
+        QString jsonPath;           // Final report as JSON, when set
+    };
+
+    LoadGenerator(const Options &options, const LoadProfile &profile,
+                  QObject *parent = nullptr);
+
+    void start();
+
+signals:
+    void finished();
+
+private slots:
+    void spawnUser();
+    void report();
+    void finish();
+
+private:
+    // Resident memory of the server in bytes, or -1 if it can't be read
+    qint64 serverMemory() const;
+    QJsonObject summary() const;
+
+    Options m_options;
+    LoadProfile m_profile;
+    QList<SimulatedUser*> m_users;
+
+    QTimer *m_rampTimer;
+    QTimer *m_reportTimer;
+    QElapsedTimer m_clock;
+    QTextStream m_out;
+
+    // Totals at the previous report, for the rates in between
+    qint64 m_lastReportMs;
+    qint64 m_lastMessagesOut;
+    qint64 m_lastBytesOut;
+    qint64 m_lastMessagesIn;
+    qint64 m_lastBytesIn;
+    qint64 m_peakServerMemory;
+};
+
+#endif // LOADGENERATOR_H
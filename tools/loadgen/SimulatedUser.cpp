@@ -0,0 +1,296 @@
+#include "SimulatedUser.h"
+#include "network/SyncClient.h"
+#include "data/TextOperation.h"
+
+#include <QBuffer>
+#include <QColor>
+#include <QImageWriter>
+#include <QTimer>
+#include <QUuid>
+
+SimulatedUser::SimulatedUser(int index, const LoadProfile &profile, QObject *parent)
+    : QObject(parent)
+    , m_client(new SyncClient(this))
+    , m_profile(profile)
+    , m_userName(QString("loadgen-%1").arg(index))
+    , m_random(quint32(index) + 1)
+    , m_synchronized(false)
+    , m_dragStepsLeft(0)
+    , m_dragTimer(new QTimer(this))
+    , m_imagesAdded(0)
+    , m_textLength(0)
+    , m_textRev(0)
+    , m_editInFlight(false)
+{
+    m_color = QColor::fromHsv(int(m_random.bounded(360)), 200, 230).name();
+    m_cursor = QPointF(m_random.bounded(2000.0), m_random.bounded(1500.0));
+    
+    connect(m_client, &SyncClient::synchronized, this, &SimulatedUser::onSynchronized);
+    connect(m_client, &SyncClient::messageReceived, this, &SimulatedUser::onMessageReceived);
+    connect(m_dragTimer, &QTimer::timeout, this, &SimulatedUser::dragStep);
+}
+
+void SimulatedUser::start(const QString &url, const QString &roomId)
+{
+    m_client->joinRoom(roomId, m_userName);
+    m_client->connectToServer(url);
+}
+
+void SimulatedUser::stop()
+{
+    for (QTimer *timer : m_timers) {
+        timer->stop();
+    }
+    m_dragTimer->stop();
+    m_client->disconnect();
+}
+
+void SimulatedUser::onSynchronized()
+{
+    // Reconnects resync too; the activities are already running then
+    if (m_synchronized) return;
+    m_synchronized = true;
+    
+    // Something of our own to drag and to type into
+    addImage();
+    addText();
+    
+    if (m_profile.cursorHz > 0) {
+        every(1000 / m_profile.cursorHz, &SimulatedUser::moveCursor);
+    }
+    if (m_profile.dragEverySec > 0 && m_profile.dragHz > 0) {
+        every(m_profile.dragEverySec * 1000, &SimulatedUser::startDrag);
+    }
+    if (m_profile.imageEverySec > 0) {
+        every(m_profile.imageEverySec * 1000, &SimulatedUser::addImage);
+    }
+    if (m_profile.textHz > 0) {
+        every(1000 / m_profile.textHz, &SimulatedUser::editText);
+    }
+    if (m_profile.syncEverySec > 0) {
+        every(m_profile.syncEverySec * 1000, &SimulatedUser::requestSync);
+    }
+}
+
+void SimulatedUser::every(int intervalMs, void (SimulatedUser::*action)())
+{
+    intervalMs = qMax(1, intervalMs);
+    
+    QTimer *timer = new QTimer(this);
+    connect(timer, &QTimer::timeout, this, action);
+    m_timers.append(timer);
+    
+    QTimer::singleShot(int(m_random.bounded(intervalMs)), timer, [timer, intervalMs]() {
+        timer->start(intervalMs);
+    });
+}
+
+void SimulatedUser::onMessageReceived(const QJsonObject &message)
+{
+    QString type = message["type"].toString();
+    bool ours = message["oderId"].toString() == m_client->oderId();
+    
+    if (type == "blobRequest") {
+        sendBlobs(message["hashes"].toArray());
+    } else if (type == "imageAdd" && !ours && m_profile.fetchImages) {
+        // Like a viewer: fetch what others drop, preview first
+        QJsonArray hashes;
+        if (message.contains("previewHash")) {
+            hashes.append(message["previewHash"]);
+        }
+        if (message.contains("blobHash")) {
+            hashes.append(message["blobHash"]);
+        }
+        if (!hashes.isEmpty()) {
+            QJsonObject request;
+            request["type"] = "blobRequest";
+            request["oderId"] = m_client->oderId();
+            request["hashes"] = hashes;
+            m_client->sendMessage(request);
+        }
+    } else if ((type == "textAck" || (type == "textEdit" && ours)) &&
+               message["textId"].toString() == m_textId) {
+        m_textRev = message["rev"].toVariant().toLongLong();
+        m_editInFlight = false;
+    } else if (type == "textResync" && message["textId"].toString() == m_textId) {
+        m_textLength = message["text"].toString().size();
+        m_textRev = message["rev"].toVariant().toLongLong();
+        m_editInFlight = false;
+    }
+}
+
+void SimulatedUser::moveCursor()
+{
+    m_cursor += QPointF(m_random.bounded(40.0) - 20.0, m_random.bounded(40.0) - 20.0);
+    
+    QJsonObject message;
+    message["type"] = "cursor";
+    message["oderId"] = m_client->oderId();
+    message["x"] = m_cursor.x();
+    message["y"] = m_cursor.y();
+    message["color"] = m_color;
+    m_client->sendMessage(message);
+}
+
+void SimulatedUser::startDrag()
+{
+    if (m_dragImageId.isEmpty() || m_dragTimer->isActive()) return;
+    
+    m_dragStepsLeft = qMax(1, m_profile.dragDurationMs * m_profile.dragHz / 1000);
+    m_dragTimer->start(1000 / m_profile.dragHz);
+}
+
+void SimulatedUser::dragStep()
+{
+    m_dragPos += QPointF(m_random.bounded(20.0) - 10.0, m_random.bounded(20.0) - 10.0);
+    
+    QJsonObject message;
+    message["type"] = "imageUpdate";
+    message["oderId"] = m_client->oderId();
+    message["imageId"] = m_dragImageId;
+    message["x"] = m_dragPos.x();
+    message["y"] = m_dragPos.y();
+    
+    // Mid-drag updates are relayed only; the drop is sequenced
+    if (--m_dragStepsLeft > 0) {
+        message["live"] = true;
+        message["rotation"] = 0.0;
+        message["scale"] = 1.0;
+    } else {
+        m_dragTimer->stop();
+    }
+    m_client->sendMessage(message);
+}
+
+void SimulatedUser::addImage()
+{
+    if (m_profile.imageSize.isEmpty()) return;
+    
+    QByteArray data = encodeImage();
+    QString imageId = QUuid::createUuid().toString(QUuid::WithoutBraces);
+    QPointF pos(m_random.bounded(4000.0), m_random.bounded(3000.0));
+    
+    QJsonObject message;
+    message["type"] = "imageAdd";
+    message["oderId"] = m_client->oderId();
+    message["imageId"] = imageId;
+    message["x"] = pos.x();
+    message["y"] = pos.y();
+    message["rotation"] = 0.0;
+    message["scale"] = 1.0;
+    message["zIndex"] = m_imagesAdded;
+    message["isGif"] = false;
+    
+    // Announce by hash; the server asks for the bytes
+    if (m_client->serverSupports("blobs")) {
+        message["blobHash"] = m_blobs.insert(data);
+    } else {
+        message["imageData"] = QString::fromLatin1(data.toBase64());
+    }
+    m_client->sendMessage(message);
+    
+    if (m_dragImageId.isEmpty()) {
+        m_dragImageId = imageId;
+        m_dragPos = pos;
+    }
+    m_imagesAdded++;
+}
+
+QByteArray SimulatedUser::encodeImage()
+{
+    if (m_noise.size() != m_profile.imageSize) {
+        m_noise = QImage(m_profile.imageSize, QImage::Format_RGB32);
+        for (int y = 0; y < m_noise.height(); ++y) {
+            quint32 *line = reinterpret_cast<quint32*>(m_noise.scanLine(y));
+            m_random.fillRange(line, m_noise.width());
+        }
+    }
+    
+    // A different pixel each time, so every add is a new blob
+    m_noise.setPixel(0, 0, qRgb(m_imagesAdded & 0xff, (m_imagesAdded >> 8) & 0xff, 0));
+    
+    static const bool hasJpeg = QImageWriter::supportedImageFormats().contains("jpg");
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    if (hasJpeg) {
+        m_noise.save(&buffer, "JPG", 90);
+    } else {
+        m_noise.save(&buffer, "PNG");
+    }
+    return data;
+}
+
+void SimulatedUser::sendBlobs(const QJsonArray &hashes)
+{
+    for (const QJsonValue &value : hashes) {
+        QString hash = value.toString();
+        if (!m_blobs.contains(hash)) continue;
+        
+        QJsonObject header;
+        header["type"] = "blobData";
+        header["hash"] = hash;
+        m_client->sendBinaryMessage(header, m_blobs.value(hash));
+        // The server keeps it from here
+        m_blobs.remove(hash);
+    }
+}
+
+void SimulatedUser::addText()
+{
+    m_textId = QUuid::createUuid().toString(QUuid::WithoutBraces);
+    m_text = m_userName;
+    m_textLength = m_text.size();
+    m_textRev = 0;
+    
+    QJsonObject message;
+    message["type"] = "textAdd";
+    message["oderId"] = m_client->oderId();
+    message["textId"] = m_textId;
+    message["text"] = m_text;
+    message["x"] = m_random.bounded(4000.0);
+    message["y"] = m_random.bounded(3000.0);
+    message["rotation"] = 0.0;
+    m_client->sendMessage(message);
+}
+
+void SimulatedUser::editText()
+{
+    if (m_textId.isEmpty() || m_editInFlight) return;
+    
+    // Mostly typing, some backspacing, bounded so the text stays small
+    int position = int(m_random.bounded(m_textLength + 1));
+    int removed = 0;
+    QString inserted;
+    if (m_textLength > 0 && (m_textLength > 200 || m_random.bounded(4) == 0)) {
+        position = qMin(position, m_textLength - 1);
+        removed = 1;
+    } else {
+        inserted = QChar('a' + int(m_random.bounded(26)));
+    }
+    
+    QJsonObject message;
+    message["oderId"] = m_client->oderId();
+    message["textId"] = m_textId;
+    if (m_client->serverSupports("textEdit")) {
+        message["type"] = "textEdit";
+        message["rev"] = m_textRev;
+        message["op"] = TextOperation::fromSplice(m_textLength, position, removed,
+                                                  inserted).toJson();
+        m_editInFlight = true;
+    } else {
+        m_text.replace(qMin(position, m_text.size()), removed, inserted);
+        message["type"] = "textUpdate";
+        message["text"] = m_text;
+    }
+    m_textLength += inserted.size() - removed;
+    m_client->sendMessage(message);
+}
+
+void SimulatedUser::requestSync()
+{
+    QJsonObject message;
+    message["type"] = "requestSync";
+    message["oderId"] = m_client->oderId();
+    m_client->sendMessage(message);
+}
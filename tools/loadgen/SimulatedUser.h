@@ -0,0 +1,95 @@
+#ifndef SIMULATEDUSER_H
+#define SIMULATEDUSER_H
+
+#include <QObject>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QList>
+#include <QPointF>
+#include <QRandomGenerator>
+#include <QSize>
+#include <QString>
+#include "network/BlobStore.h"
+
+class QTimer;
+class SyncClient;
+
+// What each simulated collaborator does and how often. A rate or interval
+// of 0 turns that activity off.
+struct LoadProfile {
+    int cursorHz = 10;              // Cursor moves per second
+    int dragEverySec = 5;           // A drag of our own image every so often
+    int dragHz = 30;                // Live transform updates while dragging
+    int dragDurationMs = 1000;
+    int imageEverySec = 30;         // New image of imageSize
+    QSize imageSize = QSize(1024, 768);
+    int textHz = 2;                 // Character edits of our own text
+    int syncEverySec = 0;           // Full snapshot requests
+    bool fetchImages = true;        // Download others' images like a viewer
+};
+
+// One fake collaborator: a SyncClient speaking the same protocol as the
+// app, joined to the room, producing the traffic of someone moving the
+// mouse, dragging, dropping images and typing. It owns one image and one
+// text to drag and edit, so its ops never conflict with other users'.
+class SimulatedUser : public QObject
+{
+    Q_OBJECT
+
+public:
+    SimulatedUser(int index, const LoadProfile &profile, QObject *parent = nullptr);
+
+    void start(const QString &url, const QString &roomId);
+    void stop();
+
+    bool isSynchronized() const { return m_synchronized; }
+    const SyncClient *client() const { return m_client; }
+    int imagesAdded() const { return m_imagesAdded; }
+
+private slots:
+    void onSynchronized();
+    void onMessageReceived(const QJsonObject &message);
+    void moveCursor();
+    void startDrag();
+    void dragStep();
+    void addImage();
+    void addText();
+    void editText();
+    void requestSync();
+
+private:
+    // Ticks every intervalMs, first after a random part of it so that
+    // many users don't all fire at once
+    void every(int intervalMs, void (SimulatedUser::*action)());
+    QByteArray encodeImage();
+    void sendBlobs(const QJsonArray &hashes);
+
+    SyncClient *m_client;
+    LoadProfile m_profile;
+    QString m_userName;
+    QString m_color;
+    QRandomGenerator m_random;
+    QList<QTimer*> m_timers;
+    bool m_synchronized;
+
+    QPointF m_cursor;
+
+    // Dragging our first image around
+    QString m_dragImageId;
+    QPointF m_dragPos;
+    int m_dragStepsLeft;
+    QTimer *m_dragTimer;
+
+    QImage m_noise;             // Incompressible base; one pixel varies per add
+    BlobStore m_blobs;          // Until the server has fetched them
+    int m_imagesAdded;
+
+    QString m_textId;
+    QString m_text;             // For servers without character edits
+    int m_textLength;
+    qint64 m_textRev;
+    bool m_editInFlight;
+};
+
+#endif // SIMULATEDUSER_H
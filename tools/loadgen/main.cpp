@@ -0,0 +1,110 @@
+/**
+ * collabref-loadgen - simulated collaborators for capacity planning
+ * Runs N fake users against a CollabRef server on this machine
+ */
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QHostAddress>
+#include <QTextStream>
+#include <QUrl>
+#include "LoadGenerator.h"
+
+namespace {
+
+// Load tests stay on this machine; never point them at a shared server
+bool isLocal(const QUrl &url)
+{
+    QString host = url.host();
+    return host == "localhost" || QHostAddress(host).isLoopback();
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("collabref-loadgen");
+    app.setApplicationVersion("1.0.0");
+    
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Simulates collaborators against a local CollabRef server");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    
+    LoadGenerator::Options options;
+    LoadProfile profile;
+    
+    QCommandLineOption urlOption("url", "Server to load (localhost only).", "url", options.url);
+    QCommandLineOption roomOption("room", "Room the users join.", "room-id", options.roomId);
+    QCommandLineOption usersOption("users", "Number of simulated users.", "n",
+                                   QString::number(options.users));
+    QCommandLineOption rampOption("ramp-ms", "Delay between two users joining.", "ms",
+                                  QString::number(options.rampMs));
+    QCommandLineOption durationOption("duration", "Length of the run in seconds.", "s",
+                                      QString::number(options.durationSec));
+    QCommandLineOption reportOption("report-every", "Seconds between progress lines.", "s",
+                                    QString::number(options.reportEverySec));
+    QCommandLineOption pidOption("server-pid", "Server process to sample memory from.", "pid");
+    QCommandLineOption jsonOption("json", "Write the final report as JSON.", "path");
+    
+    QCommandLineOption cursorOption("cursor-hz", "Cursor moves per user per second.", "hz",
+                                    QString::number(profile.cursorHz));
+    QCommandLineOption dragEveryOption("drag-every", "Seconds between drags.", "s",
+                                       QString::number(profile.dragEverySec));
+    QCommandLineOption dragHzOption("drag-hz", "Live updates per second while dragging.", "hz",
+                                    QString::number(profile.dragHz));
+    QCommandLineOption imageEveryOption("image-every", "Seconds between image adds.", "s",
+                                        QString::number(profile.imageEverySec));
+    QCommandLineOption imageSizeOption("image-size", "Size of added images.", "WxH",
+                                       QString("%1x%2").arg(profile.imageSize.width())
+                                                       .arg(profile.imageSize.height()));
+    QCommandLineOption textOption("text-hz", "Character edits per user per second.", "hz",
+                                  QString::number(profile.textHz));
+    QCommandLineOption syncOption("sync-every", "Seconds between full sync requests.", "s",
+                                  QString::number(profile.syncEverySec));
+    QCommandLineOption noFetchOption("no-fetch", "Don't download images others add.");
+    
+    parser.addOptions({urlOption, roomOption, usersOption, rampOption, durationOption,
+                       reportOption, pidOption, jsonOption, cursorOption, dragEveryOption,
+                       dragHzOption, imageEveryOption, imageSizeOption, textOption,
+                       syncOption, noFetchOption});
+    parser.process(app);
+    
+    options.url = parser.value(urlOption);
+    options.roomId = parser.value(roomOption);
+    options.users = parser.value(usersOption).toInt();
+    options.rampMs = parser.value(rampOption).toInt();
+    options.durationSec = parser.value(durationOption).toInt();
+    options.reportEverySec = parser.value(reportOption).toInt();
+    options.serverPid = parser.value(pidOption).toLongLong();
+    options.jsonPath = parser.value(jsonOption);
+    
+    profile.cursorHz = parser.value(cursorOption).toInt();
+    profile.dragEverySec = parser.value(dragEveryOption).toInt();
+    profile.dragHz = parser.value(dragHzOption).toInt();
+    profile.imageEverySec = parser.value(imageEveryOption).toInt();
+    profile.textHz = parser.value(textOption).toInt();
+    profile.syncEverySec = parser.value(syncOption).toInt();
+    profile.fetchImages = !parser.isSet(noFetchOption);
+    
+    QStringList size = parser.value(imageSizeOption).split('x');
+    profile.imageSize = size.size() == 2 ? QSize(size[0].toInt(), size[1].toInt()) : QSize();
+    
+    QTextStream err(stderr);
+    if (!isLocal(QUrl(options.url))) {
+        err << "Refusing to load " << options.url << ": only local servers" << Qt::endl;
+        return 1;
+    }
+    if (options.users <= 0 || options.durationSec <= 0) {
+        err << "Need at least one user and a positive duration" << Qt::endl;
+        return 1;
+    }
+    
+    LoadGenerator generator(options, profile);
+    QObject::connect(&generator, &LoadGenerator::finished, &app, &QCoreApplication::quit,
+                     Qt::QueuedConnection);
+    generator.start();
+    
+    return app.exec();
+}
@@ -0,0 +1,174 @@
+/**
+ * collabref-server - headless CollabRef server
+ * Hosts shared boards without the GUI, e.g. as a daemon on a farm node
+ */
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QStandardPaths>
+#include <QTextStream>
+#include <QTimer>
+#include <csignal>
+#include "network/ServerConfig.h"
+#include "network/SyncServer.h"
+#include "network/TrafficStats.h"
+
+namespace {
+
+volatile std::sig_atomic_t stopRequested = 0;
+
+void requestStop(int)
+{
+    stopRequested = 1;
+}
+
+bool parsePersistence(const QString &name, ServerConfig::Persistence *out)
+{
+    if (name == "journal") {
+        *out = ServerConfig::Persistence::Journal;
+    } else if (name == "snapshots") {
+        *out = ServerConfig::Persistence::Snapshots;
+    } else if (name == "none") {
+        *out = ServerConfig::Persistence::None;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("collabref-server");
+    app.setApplicationVersion("1.0.0");
+    app.setOrganizationName("CollabRef");
+    
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Hosts CollabRef boards without a GUI");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    
+    ServerConfig config;
+    QString defaultDataDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    
+    QCommandLineOption portOption(QStringList() << "p" << "port",
+        "Port to listen on.", "port", "8080");
+    QCommandLineOption dataDirOption(QStringList() << "d" << "data-dir",
+        "Folder for boards and image blobs.", "path", defaultDataDir);
+    QCommandLineOption persistenceOption("persistence",
+        "journal (every op logged), snapshots (periodic saves only) or none (memory only).",
+        "policy", "journal");
+    QCommandLineOption saveIntervalOption("save-interval", "Seconds between snapshots.", "s",
+                                          QString::number(config.saveIntervalMs / 1000));
+    QCommandLineOption maxRoomsOption("max-rooms", "Rooms hosted at once, 0 for no limit.", "n",
+                                      QString::number(config.maxRooms));
+    QCommandLineOption maxClientsOption("max-clients", "Clients per room, 0 for no limit.", "n",
+                                        QString::number(config.maxClientsPerRoom));
+    QCommandLineOption roomIdleOption("room-idle", "Seconds before an empty room is unloaded.",
+                                      "s", QString::number(config.roomIdleMs / 1000));
+    QCommandLineOption joinRateOption("join-rate", "Joins admitted per second, 0 for no limit.",
+                                      "n", QString::number(config.joinsPerSecond));
+    QCommandLineOption udpPortOption("udp-port",
+        "UDP port for cursor presence, 0 for the WebSocket port, -1 to disable.", "port",
+        QString::number(config.udpPort));
+    QCommandLineOption workersOption("workers", "Room threads, 0 to size by core count.", "n",
+                                     QString::number(config.workers));
+    QCommandLineOption mipThreadsOption("mip-threads",
+        "Threads making image mips, 0 to size by core count, -1 to disable.", "n",
+        QString::number(config.mipThreads));
+    QCommandLineOption trafficLogOption("traffic-log",
+        "Append network traffic stats to a JSON-lines file.", "path");
+    
+    parser.addOptions({portOption, dataDirOption, persistenceOption, saveIntervalOption,
+                       maxRoomsOption, maxClientsOption, roomIdleOption, joinRateOption,
+                       udpPortOption, workersOption, mipThreadsOption, trafficLogOption});
+    parser.process(app);
+    
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+    
+    bool portOk = false;
+    uint port = parser.value(portOption).toUInt(&portOk);
+    if (!portOk || port > 65535) {
+        err << "Invalid port " << parser.value(portOption) << Qt::endl;
+        return 1;
+    }
+    if (!parsePersistence(parser.value(persistenceOption), &config.persistence)) {
+        err << "Unknown persistence policy " << parser.value(persistenceOption) << Qt::endl;
+        return 1;
+    }
+    config.saveIntervalMs = parser.value(saveIntervalOption).toInt() * 1000;
+    config.maxRooms = qMax(0, parser.value(maxRoomsOption).toInt());
+    config.maxClientsPerRoom = qMax(0, parser.value(maxClientsOption).toInt());
+    config.roomIdleMs = qMax(0, parser.value(roomIdleOption).toInt()) * 1000;
+    config.joinsPerSecond = qMax(0, parser.value(joinRateOption).toInt());
+    config.udpPort = qBound(-1, parser.value(udpPortOption).toInt(), 65535);
+    config.workers = qMax(0, parser.value(workersOption).toInt());
+    config.mipThreads = qMax(-1, parser.value(mipThreadsOption).toInt());
+    
+    // Same file names as a host's built-in server, so its folder can be served as is
+    QString dataDir = parser.value(dataDirOption);
+    if (config.persistence != ServerConfig::Persistence::None) {
+        if (!QDir().mkpath(dataDir)) {
+            err << "Cannot create data directory " << dataDir << Qt::endl;
+            return 1;
+        }
+        config.saveFilePath = QDir(dataDir).absoluteFilePath("shared_board.json");
+    }
+    
+    SyncServer server;
+    server.setConfig(config);
+    QObject::connect(&server, &SyncServer::errorOccurred, [&err](const QString &error) {
+        err << "Server error: " << error << Qt::endl;
+    });
+    QObject::connect(&server, &SyncServer::clientConnected, [&out, &server](const QString &id) {
+        out << "Client " << id << " connected (" << server.clientCount() << " online)"
+            << Qt::endl;
+    });
+    QObject::connect(&server, &SyncServer::clientDisconnected, [&out, &server](const QString &id) {
+        out << "Client " << id << " left (" << server.clientCount() << " online)" << Qt::endl;
+    });
+    
+    if (!server.start(quint16(port))) {
+        return 1;
+    }
+    out << "Listening on port " << server.port() << ", persistence "
+        << parser.value(persistenceOption);
+    if (!config.saveFilePath.isEmpty()) {
+        out << " in " << QDir::toNativeSeparators(dataDir);
+    }
+    out << Qt::endl;
+    
+    TrafficLog *trafficLog = nullptr;
+    if (parser.isSet(trafficLogOption)) {
+        trafficLog = new TrafficLog(parser.value(trafficLogOption), &app);
+        trafficLog->addSource("server", [&server]() {
+            return server.trafficJson();
+        });
+        trafficLog->start();
+    }
+    
+    // Ctrl+C or a service manager's stop: leave the event loop so every
+    // room gets saved. The handler only sets a flag; the loop polls it.
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
+    QTimer stopPoll;
+    QObject::connect(&stopPoll, &QTimer::timeout, &app, [&app]() {
+        if (stopRequested) {
+            app.quit();
+        }
+    });
+    stopPoll.start(200);
+    
+    int result = app.exec();
+    
+    if (trafficLog) {
+        trafficLog->stop();
+    }
+    out << "Saving rooms and shutting down" << Qt::endl;
+    server.stop();
+    return result;
+}